@@ -0,0 +1,48 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+/**
+ * @brief Call function repeatedly for at least given time and 
+ * compute throughput.
+ * 
+ * @param bytes Number of bytes processed by a single call
+ * @param fn Function to measure
+ * @param min_sec Minimum measurement time in seconds
+ * @return Throughput in MB/s
+ */
+template<class F>
+inline double throughput(size_t bytes, F &&fn, double min_sec = 0.25)
+{
+    using clock = std::chrono::steady_clock;
+
+    size_t calls = 0;
+    auto begin = clock::now();
+    std::chrono::duration<double> elapsed {};
+
+    do {
+        fn();
+        ++calls;
+        elapsed = clock::now() - begin;
+    } while (elapsed.count() < min_sec);
+
+    return double(bytes) * calls / elapsed.count() / 1e6;
+}
+
+/**
+ * @brief Print single benchmark result line.
+ * 
+ * @param name Benchmark name
+ * @param bytes Input size
+ * @param mbps Throughput in MB/s
+ */
+inline void report(const char *name, size_t bytes, double mbps)
+{
+    printf("%-40s %10zu B %12.2f MB/s\n", name, bytes, mbps);
+}
+
+#endif
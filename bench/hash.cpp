@@ -0,0 +1,106 @@
+#include "_util.h"
+#include "shoc/hash/md4.h"
+#include "shoc/hash/md5.h"
+#include "shoc/hash/sha1.h"
+#include "shoc/hash/sha2.h"
+#include "shoc/hash/sha2_multi.h"
+#include "shoc/hash/tree.h"
+#include "shoc/hash/merkle.h"
+
+using namespace shoc;
+
+template<class H>
+static void bench_hash(const char *name)
+{
+    for (size_t len : {64, 1024, 1 << 20}) {
+        std::vector<byte> in(len, 0x5a);
+        byte out[H::SIZE];
+        H hash;
+
+        report(name, len, throughput(len, [&] {
+            hash(in.data(), len, out);
+        }));
+    }
+}
+
+TEST(Bench, Hash)
+{
+    bench_hash<Md4>("Md4");
+    bench_hash<Md5>("Md5");
+    bench_hash<Sha1>("Sha1");
+    bench_hash<Sha2<SHA_256>>("Sha2<SHA_256>");
+    bench_hash<Sha2<SHA_512>>("Sha2<SHA_512>");
+}
+
+TEST(Bench, Sha256Multi)
+{
+    for (size_t len : {64, 1024}) {
+        static constexpr size_t count = 4096;
+        std::vector<byte> in(len * count, 0x5a);
+        std::vector<span_i<>> msgs;
+        std::vector<sha256_digest> out(count);
+
+        for (size_t i = 0; i < count; ++i)
+            msgs.emplace_back(in.data() + i * len, len);
+
+        report("Sha2<SHA_256> one by one", len, throughput(len * count, [&] {
+            for (size_t i = 0; i < count; ++i)
+                Sha2<SHA_256>{}(msgs[i].data(), len, out[i].data());
+        }));
+        report("sha256_multi", len, throughput(len * count, [&] {
+            sha256_multi(msgs, out);
+        }));
+#ifdef SHOC_X86
+        if (cpu_avx2()) {
+            report("sha256_multi AVX2", len, throughput(len * count, [&] {
+                impl::sha2::multi_run<8>(msgs, out, impl::sha2::multi_avx2);
+            }));
+        }
+#endif
+    }
+}
+
+TEST(Bench, TreeHash)
+{
+    size_t len = 64 << 20;
+    std::vector<byte> in(len, 0x5a);
+    byte out[32];
+
+    report("Sha2<SHA_256>", len, throughput(len, [&] {
+        Sha2<SHA_256>{}(in.data(), len, out);
+    }));
+    report("sha256_tree_hash, 1 thread", len, throughput(len, [&] {
+        sha256_tree_hash(in.data(), len, out, TREE_LEAF_SIZE, 1);
+    }));
+    report("sha256_tree_hash, all threads", len, throughput(len, [&] {
+        sha256_tree_hash(in.data(), len, out);
+    }));
+}
+
+TEST(Bench, MerkleTree)
+{
+    // 10^8 leaves need about 10 GB for nodes and leaf data
+    for (size_t n : {1'000'000, 10'000'000}) {
+        size_t len = n * 32;
+        std::vector<byte> in(len);
+        std::vector<span_i<>> spans(65536);
+
+        for (size_t i = 0; i < len; ++i)
+            in[i] = i * 7 + (i >> 8);
+
+        report("merkle_tree::append, 1 leaf", len, throughput(len, [&] {
+            merkle_tree tree;
+            for (size_t i = 0; i < n; ++i)
+                tree.append(in.data() + i * 32, 32);
+        }));
+        report("merkle_tree::append, 64K leaves", len, throughput(len, [&] {
+            merkle_tree tree;
+            for (size_t i = 0; i < n; i += spans.size()) {
+                size_t k = std::min(spans.size(), n - i);
+                for (size_t j = 0; j < k; ++j)
+                    spans[j] = { in.data() + (i + j) * 32, 32 };
+                tree.append({ spans.data(), k });
+            }
+        }));
+    }
+}
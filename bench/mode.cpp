@@ -0,0 +1,89 @@
+#include "_util.h"
+#include "shoc/cipher/aes.h"
+#include "shoc/mode/ccm.h"
+#include "shoc/mode/ecb.h"
+#include "shoc/mode/gcm.h"
+#include "shoc/mode/ocb.h"
+#include "shoc/mode/chacha20_poly1305.h"
+
+using namespace shoc;
+
+static const byte key[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c, 
+};
+static const byte nonce[12] = {
+    0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88,
+};
+
+TEST(Bench, EcbAes128)
+{
+    for (size_t len : {32, 64, 1024, 16384}) {
+        std::vector<byte> in(len, 0x5a);
+        std::vector<byte> out(len);
+        aes128 ctx {key};
+
+        report("aes128::encrypt, block by block", len, throughput(len, [&] {
+            for (size_t i = 0; i < len; i += 16)
+                ctx.encrypt(span_i<16>{in.data() + i, 16}, span_o<16>{out.data() + i, 16});
+        }));
+        report("ecb_encrypt<aes128>", len, throughput(len, [&] {
+            ecb_encrypt(ctx, in, out);
+        }));
+        report("ecb_decrypt<aes128>", len, throughput(len, [&] {
+            ecb_decrypt(ctx, in, out);
+        }));
+    }
+}
+
+TEST(Bench, AeadAes128)
+{
+    for (size_t len : {64, 1024, 16384}) {
+        std::vector<byte> in(len, 0x5a);
+        std::vector<byte> out(len);
+        byte aad[16] = {};
+        byte tag[16];
+
+        report("gcm_encrypt<aes128>", len, throughput(len, [&] {
+            gcm_encrypt<aes128>(key, nonce, sizeof(nonce), aad, sizeof(aad), tag, sizeof(tag), in.data(), out.data(), len);
+        }));
+        report("ccm_encrypt<aes128, 3>", len, throughput(len, [&] {
+            ccm_encrypt<aes128, 3>(key, nonce, aad, sizeof(aad), tag, sizeof(tag), in.data(), out.data(), len);
+        }));
+        report("ocb_encrypt<aes128>", len, throughput(len, [&] {
+            ocb_encrypt<aes128>(key, nonce, sizeof(nonce), aad, sizeof(aad), tag, sizeof(tag), in.data(), out.data(), len);
+        }));
+        ocb_context<aes128> ctx {key};
+        report("ocb_context<aes128>::encrypt", len, throughput(len, [&] {
+            ctx.encrypt(nonce, sizeof(nonce), aad, sizeof(aad), tag, sizeof(tag), in.data(), out.data(), len);
+        }));
+    }
+}
+
+TEST(Bench, AeadChacha20Poly1305)
+{
+    byte key_256[32] = {};
+
+    for (size_t len : {64, 1024, 16384}) {
+        std::vector<byte> in(len, 0x5a);
+        std::vector<byte> out(len);
+        byte aad[16] = {};
+        byte tag[16];
+
+        report("gcm_encrypt<aes128>", len, throughput(len, [&] {
+            gcm_encrypt<aes128>(key, nonce, sizeof(nonce), aad, sizeof(aad), tag, sizeof(tag), in.data(), out.data(), len);
+        }));
+        report("gcm_encrypt<aes256>", len, throughput(len, [&] {
+            gcm_encrypt<aes256>(key_256, nonce, sizeof(nonce), aad, sizeof(aad), tag, sizeof(tag), in.data(), out.data(), len);
+        }));
+        report("chacha20_poly1305_encrypt", len, throughput(len, [&] {
+            chacha20_poly1305_encrypt(key_256, nonce, aad, sizeof(aad), tag, in.data(), out.data(), len);
+        }));
+        chacha20_poly1305_context ctx {key_256};
+        report("chacha20_poly1305_context", len, throughput(len, [&] {
+            ctx.start(nonce);
+            ctx.aad(aad, sizeof(aad));
+            ctx.update(in.data(), out.data(), len);
+            ctx.finish(tag);
+        }));
+    }
+}
@@ -2,6 +2,7 @@
 #define SHOC_CIPHER_AES_H
 
 #include "shoc/util.h"
+#include "shoc/cpu.h"
 
 namespace shoc {
 namespace impl::aes {
@@ -79,6 +80,107 @@ constexpr auto inv_mult_row_col(const byte* in, byte* out)
     out[3] = gf_mul(in[0], 0xb) ^ gf_mul(in[1], 0xd) ^ gf_mul(in[2], 0x9) ^ gf_mul(in[3], 0xe);
 }
 
+#ifdef SHOC_X86
+
+/**
+ * @brief Expand round keys for AES-NI: encryption keys in AES-NI byte order,
+ * key words are stored as big endian integers, and decryption keys for
+ * equivalent inverse cipher, converted with AESIMC.
+ *
+ * @param words Expanded key
+ * @param nr Number of rounds
+ * @param ek Encryption round keys, nr + 1 vectors
+ * @param dk Decryption round keys, nr + 1 vectors
+ */
+SHOC_TARGET("aes")
+inline void load_keys_ni(const word *words, size_t nr, __m128i *ek, __m128i *dk)
+{
+    byte buf[16];
+
+    for (size_t r = 0; r <= nr; ++r) {
+        for (size_t i = 0; i < 4; ++i)
+            putbe(words[r * 4 + i], buf + i * 4);
+        ek[r] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf));
+    }
+    zero(buf, sizeof(buf));
+
+    dk[0] = ek[nr];
+    for (size_t r = 1; r < nr; ++r)
+        dk[r] = _mm_aesimc_si128(ek[nr - r]);
+    dk[nr] = ek[0];
+}
+
+/**
+ * @brief Encrypt or decrypt K independent blocks with AES-NI, interleaved
+ * to hide AESENC/AESDEC latency. Decryption uses equivalent inverse cipher.
+ *
+ * @tparam D Direction
+ * @tparam K Number of blocks
+ * @param rk Round keys for given direction
+ * @param nr Number of rounds
+ * @param in Input blocks
+ * @param out Output blocks
+ */
+template<direction D, size_t K>
+SHOC_TARGET("aes")
+inline void crypt_ni(const __m128i *rk, size_t nr, const byte *in, byte *out)
+{
+    __m128i b[K];
+
+    for (size_t j = 0; j < K; ++j)
+        b[j] = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + j * 16)), rk[0]);
+    for (size_t r = 1; r < nr; ++r) {
+#pragma GCC unroll 8
+        for (size_t j = 0; j < K; ++j) {
+            if constexpr (D == direction::encrypt)
+                b[j] = _mm_aesenc_si128(b[j], rk[r]);
+            else
+                b[j] = _mm_aesdec_si128(b[j], rk[r]);
+        }
+    }
+    for (size_t j = 0; j < K; ++j) {
+        if constexpr (D == direction::encrypt)
+            b[j] = _mm_aesenclast_si128(b[j], rk[nr]);
+        else
+            b[j] = _mm_aesdeclast_si128(b[j], rk[nr]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j * 16), b[j]);
+    }
+}
+
+/**
+ * @brief Encrypt or decrypt consecutive blocks with AES-NI, 8 blocks at a
+ * time and the rest as 4, 2 and 1, so short batches are interleaved too.
+ * MUST be called only if cpu_aes() is true. Input and output may be the same.
+ *
+ * @tparam D Direction
+ * @param rk Round keys for given direction, see load_keys_ni(...)
+ * @param nr Number of rounds
+ * @param in Input blocks
+ * @param out Output blocks
+ * @param n Number of blocks
+ */
+template<direction D>
+SHOC_TARGET("aes")
+inline void process_ni(const __m128i *rk, size_t nr, const byte *in, byte *out, size_t n)
+{
+    for (; n >= 8; n -= 8, in += 8 * 16, out += 8 * 16)
+        crypt_ni<D, 8>(rk, nr, in, out);
+    if (n & 4) {
+        crypt_ni<D, 4>(rk, nr, in, out);
+        in  += 4 * 16;
+        out += 4 * 16;
+    }
+    if (n & 2) {
+        crypt_ni<D, 2>(rk, nr, in, out);
+        in  += 2 * 16;
+        out += 2 * 16;
+    }
+    if (n & 1)
+        crypt_ni<D, 1>(rk, nr, in, out);
+}
+
+#endif
+
 enum type {
     type_128,
     type_192,
@@ -103,6 +205,8 @@ public:
     constexpr void deinit();
     constexpr void encrypt(span_i<block_size> in, span_o<block_size> out);
     constexpr void decrypt(span_i<block_size> in, span_o<block_size> out);
+    constexpr void encrypt_blocks(span_i<> in, span_o<> out);
+    constexpr void decrypt_blocks(span_i<> in, span_o<> out);
 private:
     constexpr void add_round_key(const word* key);
     constexpr void sub_bytes();
@@ -114,6 +218,11 @@ private:
 private:
     byte state[nb * 4] = {};
     word words[nb * (nr + 1)] = {};
+#ifdef SHOC_X86
+    __m128i ek[nr + 1] = {};
+    __m128i dk[nr + 1] = {};
+    bool ni = false; // Whether ek and dk are set, not in constant evaluation
+#endif
 };
 
 template<type T> 
@@ -137,6 +246,11 @@ constexpr void context<T>::init(span_i<key_size> key)
         }
         words[i] = words[i - nk] ^ tmp;
     }
+#ifdef SHOC_X86
+    ni = !std::is_constant_evaluated() && cpu_aes();
+    if (ni)
+        load_keys_ni(words, nr, ek, dk);
+#endif
 }
 
 template<type T> 
@@ -188,6 +302,48 @@ constexpr void context<T>::decrypt(span_i<block_size> in, span_o<block_size> out
     zero(state, sizeof(state));
 }
 
+/**
+ * @brief Encrypt consecutive blocks, with AES-NI when CPU supports it.
+ * Input and output may be the same span. Lengths MUST be equal and
+ * multiple of block_size.
+ *
+ * @param in Plain text blocks
+ * @param out Cipher text blocks
+ */
+template<type T>
+constexpr void context<T>::encrypt_blocks(span_i<> in, span_o<> out)
+{
+    assert(in.size() == out.size());
+    assert(in.size() % block_size == 0);
+#ifdef SHOC_X86
+    if (!std::is_constant_evaluated() && ni)
+        return process_ni<direction::encrypt>(ek, nr, in.data(), out.data(), in.size() / block_size);
+#endif
+    for (size_t i = 0; i < in.size(); i += block_size)
+        encrypt(in.subspan(i).template first<block_size>(), out.subspan(i).template first<block_size>());
+}
+
+/**
+ * @brief Decrypt consecutive blocks, with AES-NI when CPU supports it.
+ * Input and output may be the same span. Lengths MUST be equal and
+ * multiple of block_size.
+ *
+ * @param in Cipher text blocks
+ * @param out Plain text blocks
+ */
+template<type T>
+constexpr void context<T>::decrypt_blocks(span_i<> in, span_o<> out)
+{
+    assert(in.size() == out.size());
+    assert(in.size() % block_size == 0);
+#ifdef SHOC_X86
+    if (!std::is_constant_evaluated() && ni)
+        return process_ni<direction::decrypt>(dk, nr, in.data(), out.data(), in.size() / block_size);
+#endif
+    for (size_t i = 0; i < in.size(); i += block_size)
+        decrypt(in.subspan(i).template first<block_size>(), out.subspan(i).template first<block_size>());
+}
+
 template<type T>
 constexpr void context<T>::add_round_key(const word *key)
 {
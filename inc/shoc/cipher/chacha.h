@@ -0,0 +1,400 @@
+#ifndef SHOC_CIPHER_CHACHA_H
+#define SHOC_CIPHER_CHACHA_H
+
+#include "shoc/util.h"
+#include "shoc/cpu.h"
+
+namespace shoc {
+namespace impl::chacha {
+
+using word = uint32_t;
+
+inline constexpr word sigma[4] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+
+constexpr word getle(const byte *in)
+{
+    return word(in[0]) | word(in[1]) << 8 | word(in[2]) << 16 | word(in[3]) << 24;
+}
+
+constexpr void quarter_round(word &a, word &b, word &c, word &d)
+{
+    a += b; d ^= a; d = rol(d, 16);
+    c += d; b ^= c; b = rol(b, 12);
+    a += b; d ^= a; d = rol(d, 8);
+    c += d; b ^= c; b = rol(b, 7);
+}
+
+/**
+ * @brief ChaCha20 block function, 20 rounds over the given state.
+ *
+ * @param in Input state, 16 words
+ * @param out Output keystream block, 64 bytes
+ */
+constexpr void block(const word *in, byte *out)
+{
+    word x[16];
+
+    for (int i = 0; i < 16; ++i)
+        x[i] = in[i];
+
+    for (int i = 0; i < 10; ++i) {
+        quarter_round(x[0], x[4], x[8],  x[12]);
+        quarter_round(x[1], x[5], x[9],  x[13]);
+        quarter_round(x[2], x[6], x[10], x[14]);
+        quarter_round(x[3], x[7], x[11], x[15]);
+        quarter_round(x[0], x[5], x[10], x[15]);
+        quarter_round(x[1], x[6], x[11], x[12]);
+        quarter_round(x[2], x[7], x[8],  x[13]);
+        quarter_round(x[3], x[4], x[9],  x[14]);
+    }
+    for (int i = 0; i < 16; ++i)
+        putle(word(x[i] + in[i]), out + i * 4);
+}
+
+/**
+ * @brief XOR full blocks with keystream one block at a time. Block
+ * counter in state is advanced.
+ *
+ * @param st State, 16 words
+ * @param in Input data
+ * @param out Output data
+ * @param n Number of blocks
+ * @return Number of processed blocks, always n
+ */
+inline size_t crypt_scalar(word *st, const byte *in, byte *out, size_t n)
+{
+    byte ks[64];
+
+    for (size_t i = 0; i < n; ++i, ++st[12]) {
+        block(st, ks);
+        xorb(out + i * 64, in + i * 64, ks, 64);
+    }
+    zero(ks, sizeof(ks));
+
+    return n;
+}
+
+#ifdef __SSE2__
+
+#define SHOC_CHACHA_ROL_SSE2(x, s) _mm_or_si128(_mm_slli_epi32(x, s), _mm_srli_epi32(x, 32 - s))
+#define SHOC_CHACHA_QR_SSE2(a, b, c, d)                                         \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = SHOC_CHACHA_ROL_SSE2(d, 16); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = SHOC_CHACHA_ROL_SSE2(b, 12); \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = SHOC_CHACHA_ROL_SSE2(d, 8);  \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = SHOC_CHACHA_ROL_SSE2(b, 7);
+
+/**
+ * @brief XOR full blocks with keystream, 4 blocks at a time with SSE2.
+ * Each vector holds the same state word of 4 consecutive blocks.
+ * Block counter in state is advanced.
+ *
+ * @param st State, 16 words
+ * @param in Input data
+ * @param out Output data
+ * @param n Number of blocks
+ * @return Number of processed blocks, multiple of 4
+ */
+inline size_t crypt_sse2(word *st, const byte *in, byte *out, size_t n)
+{
+    size_t done = 0;
+
+    for (; n - done >= 4; done += 4, st[12] += 4, in += 256, out += 256) {
+        __m128i s[16];
+        __m128i x[16];
+
+        for (int i = 0; i < 16; ++i)
+            s[i] = _mm_set1_epi32(st[i]);
+        s[12] = _mm_add_epi32(s[12], _mm_setr_epi32(0, 1, 2, 3));
+
+        for (int i = 0; i < 16; ++i)
+            x[i] = s[i];
+
+        for (int i = 0; i < 10; ++i) {
+            SHOC_CHACHA_QR_SSE2(x[0], x[4], x[8],  x[12])
+            SHOC_CHACHA_QR_SSE2(x[1], x[5], x[9],  x[13])
+            SHOC_CHACHA_QR_SSE2(x[2], x[6], x[10], x[14])
+            SHOC_CHACHA_QR_SSE2(x[3], x[7], x[11], x[15])
+            SHOC_CHACHA_QR_SSE2(x[0], x[5], x[10], x[15])
+            SHOC_CHACHA_QR_SSE2(x[1], x[6], x[11], x[12])
+            SHOC_CHACHA_QR_SSE2(x[2], x[7], x[8],  x[13])
+            SHOC_CHACHA_QR_SSE2(x[3], x[4], x[9],  x[14])
+        }
+        for (int g = 0; g < 4; ++g) {
+            auto a = _mm_add_epi32(x[g * 4 + 0], s[g * 4 + 0]);
+            auto b = _mm_add_epi32(x[g * 4 + 1], s[g * 4 + 1]);
+            auto c = _mm_add_epi32(x[g * 4 + 2], s[g * 4 + 2]);
+            auto d = _mm_add_epi32(x[g * 4 + 3], s[g * 4 + 3]);
+            auto t0 = _mm_unpacklo_epi32(a, b);
+            auto t1 = _mm_unpacklo_epi32(c, d);
+            auto t2 = _mm_unpackhi_epi32(a, b);
+            auto t3 = _mm_unpackhi_epi32(c, d);
+            __m128i r[4] = {
+                _mm_unpacklo_epi64(t0, t1),
+                _mm_unpackhi_epi64(t0, t1),
+                _mm_unpacklo_epi64(t2, t3),
+                _mm_unpackhi_epi64(t2, t3),
+            };
+            for (int j = 0; j < 4; ++j) {
+                auto p = (const __m128i*) (in + j * 64 + g * 16);
+                auto q = (__m128i*) (out + j * 64 + g * 16);
+                _mm_storeu_si128(q, _mm_xor_si128(_mm_loadu_si128(p), r[j]));
+            }
+        }
+    }
+    return done;
+}
+
+#undef SHOC_CHACHA_QR_SSE2
+#undef SHOC_CHACHA_ROL_SSE2
+
+#endif
+
+#ifdef SHOC_X86
+
+#define SHOC_CHACHA_ROL_AVX2(x, s) _mm256_or_si256(_mm256_slli_epi32(x, s), _mm256_srli_epi32(x, 32 - s))
+#define SHOC_CHACHA_QR_AVX2(a, b, c, d)                                                     \
+    a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rot16);  \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = SHOC_CHACHA_ROL_AVX2(b, 12);   \
+    a = _mm256_add_epi32(a, b); d = _mm256_xor_si256(d, a); d = _mm256_shuffle_epi8(d, rot8);   \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = SHOC_CHACHA_ROL_AVX2(b, 7);
+
+/**
+ * @brief XOR full blocks with keystream, 8 blocks at a time with AVX2.
+ * Each vector holds the same state word of 8 consecutive blocks, rotations
+ * by 16 and 8 are byte shuffles. MUST be called only if cpu_avx2() is true.
+ * Block counter in state is advanced.
+ *
+ * @param st State, 16 words
+ * @param in Input data
+ * @param out Output data
+ * @param n Number of blocks
+ * @return Number of processed blocks, multiple of 8
+ */
+SHOC_TARGET("avx2") inline size_t crypt_avx2(word *st, const byte *in, byte *out, size_t n)
+{
+    const auto rot16 = _mm256_setr_epi8(
+        2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+        2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const auto rot8 = _mm256_setr_epi8(
+        3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+        3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    size_t done = 0;
+
+    for (; n - done >= 8; done += 8, st[12] += 8, in += 512, out += 512) {
+        __m256i s[16];
+        __m256i x[16];
+
+        for (int i = 0; i < 16; ++i)
+            s[i] = _mm256_set1_epi32(st[i]);
+        s[12] = _mm256_add_epi32(s[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+        for (int i = 0; i < 16; ++i)
+            x[i] = s[i];
+
+        for (int i = 0; i < 10; ++i) {
+            SHOC_CHACHA_QR_AVX2(x[0], x[4], x[8],  x[12])
+            SHOC_CHACHA_QR_AVX2(x[1], x[5], x[9],  x[13])
+            SHOC_CHACHA_QR_AVX2(x[2], x[6], x[10], x[14])
+            SHOC_CHACHA_QR_AVX2(x[3], x[7], x[11], x[15])
+            SHOC_CHACHA_QR_AVX2(x[0], x[5], x[10], x[15])
+            SHOC_CHACHA_QR_AVX2(x[1], x[6], x[11], x[12])
+            SHOC_CHACHA_QR_AVX2(x[2], x[7], x[8],  x[13])
+            SHOC_CHACHA_QR_AVX2(x[3], x[4], x[9],  x[14])
+        }
+        for (int g = 0; g < 4; ++g) {
+            auto a = _mm256_add_epi32(x[g * 4 + 0], s[g * 4 + 0]);
+            auto b = _mm256_add_epi32(x[g * 4 + 1], s[g * 4 + 1]);
+            auto c = _mm256_add_epi32(x[g * 4 + 2], s[g * 4 + 2]);
+            auto d = _mm256_add_epi32(x[g * 4 + 3], s[g * 4 + 3]);
+            auto t0 = _mm256_unpacklo_epi32(a, b);
+            auto t1 = _mm256_unpacklo_epi32(c, d);
+            auto t2 = _mm256_unpackhi_epi32(a, b);
+            auto t3 = _mm256_unpackhi_epi32(c, d);
+            __m256i r[4] = {
+                _mm256_unpacklo_epi64(t0, t1),
+                _mm256_unpackhi_epi64(t0, t1),
+                _mm256_unpacklo_epi64(t2, t3),
+                _mm256_unpackhi_epi64(t2, t3),
+            };
+            // Low lane holds block j, high lane holds block j + 4
+            for (int j = 0; j < 4; ++j) {
+                auto p0 = (const __m128i*) (in + j * 64 + g * 16);
+                auto p1 = (const __m128i*) (in + (j + 4) * 64 + g * 16);
+                auto q0 = (__m128i*) (out + j * 64 + g * 16);
+                auto q1 = (__m128i*) (out + (j + 4) * 64 + g * 16);
+                _mm_storeu_si128(q0, _mm_xor_si128(_mm_loadu_si128(p0), _mm256_castsi256_si128(r[j])));
+                _mm_storeu_si128(q1, _mm_xor_si128(_mm_loadu_si128(p1), _mm256_extracti128_si256(r[j], 1)));
+            }
+        }
+    }
+    return done;
+}
+
+#undef SHOC_CHACHA_QR_AVX2
+#undef SHOC_CHACHA_ROL_AVX2
+
+#endif
+
+/**
+ * @brief XOR full blocks with keystream using the widest available kernel:
+ * AVX2 for 8 blocks if supported at runtime, then SSE2 for 4 blocks, then
+ * scalar for the rest. Block counter in state is advanced.
+ *
+ * @param st State, 16 words
+ * @param in Input data
+ * @param out Output data
+ * @param n Number of blocks
+ */
+inline void crypt_blocks(word *st, const byte *in, byte *out, size_t n)
+{
+    size_t i = 0;
+#ifdef SHOC_X86
+    if (cpu_avx2())
+        i += crypt_avx2(st, in, out, n);
+#endif
+#ifdef __SSE2__
+    i += crypt_sse2(st, in + i * 64, out + i * 64, n - i);
+#endif
+    crypt_scalar(st, in + i * 64, out + i * 64, n - i);
+}
+
+/**
+ * @brief ChaCha20 stream cipher (RFC 8439) with 32-bit block counter and
+ * 96-bit nonce. Expanded key is kept, so many messages can be processed
+ * with start(...) and crypt(...). Data may be fed in chunks of any size.
+ *
+ */
+class context {
+public:
+    static constexpr size_t key_size    = 32;
+    static constexpr size_t nonce_size  = 12;
+    static constexpr size_t block_size  = 64;
+public:
+    context() = default;
+    context(span_i<key_size> key) { init(key); }
+    ~context() { deinit(); }
+public:
+    void init(span_i<key_size> key);
+    void deinit();
+    void start(span_i<nonce_size> nonce, word counter = 0);
+    void crypt(const byte *in, byte *out, size_t len);
+    void keystream(byte *out, size_t len);
+private:
+    word st[16] = {};
+    byte ks[block_size] = {};
+    size_t idx = block_size;
+};
+
+inline void context::init(span_i<key_size> key)
+{
+    for (int i = 0; i < 4; ++i)
+        st[i] = sigma[i];
+    for (int i = 0; i < 8; ++i)
+        st[4 + i] = getle(key.data() + i * 4);
+    idx = block_size;
+}
+
+inline void context::deinit()
+{
+    zero(st, sizeof(st));
+    zero(ks, sizeof(ks));
+    idx = block_size;
+}
+
+/**
+ * @brief Start new message under the same key.
+ *
+ * @param nonce Nonce
+ * @param counter Initial block counter
+ */
+inline void context::start(span_i<nonce_size> nonce, word counter)
+{
+    st[12] = counter;
+    for (int i = 0; i < 3; ++i)
+        st[13 + i] = getle(nonce.data() + i * 4);
+    idx = block_size;
+}
+
+/**
+ * @brief Encrypt or decrypt next chunk. Full blocks go through
+ * crypt_blocks(...). Input and output may be the same array.
+ *
+ * @param in Input data
+ * @param out Output data
+ * @param len Chunk length
+ */
+inline void context::crypt(const byte *in, byte *out, size_t len)
+{
+    if (idx < block_size && len) {
+        size_t n = block_size - idx < len ? block_size - idx : len;
+        xorb(out, in, ks + idx, n);
+        idx += n;
+        in  += n;
+        out += n;
+        len -= n;
+    }
+    size_t full = len / block_size;
+
+    crypt_blocks(st, in, out, full);
+
+    if (len %= block_size) {
+        in  += full * block_size;
+        out += full * block_size;
+        block(st, ks);
+        ++st[12];
+        xorb(out, in, ks, len);
+        idx = len;
+    }
+}
+
+/**
+ * @brief Output raw keystream, continuing from current position.
+ *
+ * @param out Output keystream
+ * @param len Keystream length
+ */
+inline void context::keystream(byte *out, size_t len)
+{
+    zero(out, len);
+    crypt(out, out, len);
+}
+
+}
+
+using chacha20 = impl::chacha::context;
+
+/**
+ * @brief Encrypt with ChaCha20 (RFC 8439). Input and output may be the same array.
+ *
+ * @param key Key
+ * @param nonce Nonce, 12 bytes
+ * @param counter Initial block counter
+ * @param in Input data
+ * @param out Output data
+ * @param len Data length
+ */
+inline void chacha20_encrypt(span_i<32> key, const byte *nonce, uint32_t counter, const byte *in, byte *out, size_t len)
+{
+    chacha20 ciph {key};
+    ciph.start(span_i<12>{nonce, 12}, counter);
+    ciph.crypt(in, out, len);
+}
+
+/**
+ * @brief Decrypt with ChaCha20 (RFC 8439). Input and output may be the same array.
+ *
+ * @param key Key
+ * @param nonce Nonce, 12 bytes
+ * @param counter Initial block counter
+ * @param in Input data
+ * @param out Output data
+ * @param len Data length
+ */
+inline void chacha20_decrypt(span_i<32> key, const byte *nonce, uint32_t counter, const byte *in, byte *out, size_t len)
+{
+    chacha20_encrypt(key, nonce, counter, in, out, len);
+}
+
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef SHOC_CPU_H
+#define SHOC_CPU_H
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SHOC_X86 1
+#define SHOC_TARGET(x) __attribute__((target(x)))
+#include <immintrin.h>
+#endif
+
+namespace shoc {
+
+/**
+ * @brief Check at runtime whether CPU supports AVX2. Result is cached.
+ * 
+ * @return true if AVX2 kernels may be used
+ */
+inline bool cpu_avx2()
+{
+#ifdef SHOC_X86
+    static const bool res = __builtin_cpu_supports("avx2");
+    return res;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Check at runtime whether CPU supports AVX-512 Foundation. 
+ * Result is cached.
+ * 
+ * @return true if AVX-512 kernels may be used
+ */
+inline bool cpu_avx512()
+{
+#ifdef SHOC_X86
+    static const bool res = __builtin_cpu_supports("avx512f");
+    return res;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Check at runtime whether CPU supports AES-NI. Result is cached.
+ *
+ * @return true if AES-NI kernels may be used
+ */
+inline bool cpu_aes()
+{
+#ifdef SHOC_X86
+    static const bool res = __builtin_cpu_supports("aes");
+    return res;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Check at runtime whether CPU supports SHA extensions (SHA-NI),
+ * together with SSSE3 and SSE4.1 used around them. Result is cached.
+ *
+ * @return true if SHA-NI kernels may be used
+ */
+inline bool cpu_sha()
+{
+#ifdef SHOC_X86
+    static const bool res =
+        __builtin_cpu_supports("sha") &&
+        __builtin_cpu_supports("ssse3") &&
+        __builtin_cpu_supports("sse4.1");
+    return res;
+#else
+    return false;
+#endif
+}
+
+}
+
+#endif
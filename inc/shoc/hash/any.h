@@ -0,0 +1,209 @@
+#ifndef SHOC_HASH_ANY_H
+#define SHOC_HASH_ANY_H
+
+#include "shoc/hash/md2.h"
+#include "shoc/hash/md4.h"
+#include "shoc/hash/md5.h"
+#include "shoc/hash/sha1.h"
+#include "shoc/hash/sha2.h"
+#include "shoc/hash/gimli.h"
+#include <concepts>
+#include <new>
+#include <string_view>
+#include <utility>
+
+namespace shoc {
+
+/**
+ * @brief Hash with init/feed/stop interface, digest size and block size.
+ * Templates constrained by it call hash directly, without indirection.
+ *
+ */
+template<class H>
+concept hash_function = std::default_initializable<H> && std::copy_constructible<H> &&
+    requires(H h, const void *in, size_t len, byte *out) {
+        { H::SIZE }         -> std::convertible_to<size_t>;
+        { H::BLOCK_SIZE }   -> std::convertible_to<size_t>;
+        h.init();
+        h.feed(in, len);
+        h.stop(out);
+    };
+
+/**
+ * @brief Type-erased hash. Context of any hash_function is stored inline
+ * if it fits into BUFFER_SIZE bytes, which holds for every hash in this
+ * library, otherwise on heap. Each call goes through one indirect call, so
+ * feed() should be given chunks, not single bytes.
+ *
+ */
+struct any_hash {
+    static constexpr size_t BUFFER_SIZE = 224;
+public:
+    any_hash() = default;
+    any_hash(const any_hash &other)                 { assign(other); }
+    any_hash(any_hash &&other) noexcept             { assign(std::move(other)); }
+    any_hash& operator=(const any_hash &other)      { if (this != &other) { reset(); assign(other); } return *this; }
+    any_hash& operator=(any_hash &&other) noexcept  { if (this != &other) { reset(); assign(std::move(other)); } return *this; }
+    ~any_hash()                                     { reset(); }
+
+    template<hash_function H>
+    explicit any_hash(std::in_place_type_t<H>)      { emplace<H>(nullptr); }
+
+    template<hash_function H>
+    explicit any_hash(const H &h)                   { emplace<H>(&h); }
+
+    void init()                                     { assert(vt); vt->init(get()); }
+    void feed(const void *in, size_t len)           { assert(vt); vt->feed(get(), in, len); }
+    void stop(byte *out)                            { assert(vt); vt->stop(get(), out); }
+    void operator()(const void *in, size_t len, byte *out)
+    {
+        init();
+        feed(in, len);
+        stop(out);
+    }
+    size_t size() const                             { return vt ? vt->size : 0; }
+    size_t block_size() const                       { return vt ? vt->block_size : 0; }
+    explicit operator bool() const                  { return vt; }
+private:
+    struct ops {
+        size_t size;
+        size_t block_size;
+        bool local;
+        void (*init)(void *h);
+        void (*feed)(void *h, const void *in, size_t len);
+        void (*stop)(void *h, byte *out);
+        void (*copy)(any_hash &dst, const void *h);
+        void (*destroy)(void *h);
+    };
+
+    template<class H>
+    static constexpr bool fits =
+        sizeof(H) <= BUFFER_SIZE &&
+        alignof(H) <= alignof(std::max_align_t) &&
+        std::is_nothrow_copy_constructible_v<H>;
+
+    template<class H>
+    static const ops table;
+
+    template<class H>
+    void emplace(const H *src)
+    {
+        if constexpr (fits<H>) {
+            if (src)
+                new (buf) H(*src);
+            else
+                new (buf) H();
+        } else {
+            H *p = src ? new H(*src) : new H();
+            std::memcpy(buf, &p, sizeof(p));
+        }
+        vt = &table<H>;
+    }
+    void *get() const
+    {
+        if (vt->local)
+            return const_cast<byte*>(buf);
+        void *p;
+        std::memcpy(&p, buf, sizeof(p));
+        return p;
+    }
+    void assign(const any_hash &other)
+    {
+        if (other.vt)
+            other.vt->copy(*this, other.get());
+    }
+    void assign(any_hash &&other)
+    {
+        if (!other.vt)
+            return;
+        if (other.vt->local) {
+            assign(other);
+            other.reset();
+        } else {
+            std::memcpy(buf, other.buf, sizeof(void*));
+            vt = other.vt;
+            other.vt = nullptr;
+        }
+    }
+    void reset()
+    {
+        if (vt)
+            vt->destroy(get());
+        vt = nullptr;
+    }
+private:
+    alignas(std::max_align_t) byte buf[BUFFER_SIZE];
+    const ops *vt = nullptr;
+};
+
+template<class H>
+constexpr any_hash::ops any_hash::table = {
+    H::SIZE,
+    H::BLOCK_SIZE,
+    fits<H>,
+    [](void *h)                             { static_cast<H*>(h)->init(); },
+    [](void *h, const void *in, size_t len) { static_cast<H*>(h)->feed(in, len); },
+    [](void *h, byte *out)                  { static_cast<H*>(h)->stop(out); },
+    [](any_hash &dst, const void *h)        { dst.emplace<H>(static_cast<const H*>(h)); },
+    [](void *h) {
+        if constexpr (fits<H>)
+            static_cast<H*>(h)->~H();
+        else
+            delete static_cast<H*>(h);
+    },
+};
+
+/**
+ * @brief Entry of hash registry.
+ *
+ */
+struct hash_entry {
+    std::string_view name;
+    any_hash (*make)();
+};
+
+namespace impl::hash {
+
+template<hash_function H>
+any_hash make()
+{
+    return any_hash(std::in_place_type<H>);
+}
+
+}
+
+/**
+ * @brief All hashes of the library by name, names follow OpenSSL.
+ *
+ */
+inline constexpr hash_entry hash_registry[] = {
+    { "md2",        impl::hash::make<Md2> },
+    { "md4",        impl::hash::make<Md4> },
+    { "md5",        impl::hash::make<Md5> },
+    { "sha1",       impl::hash::make<Sha1> },
+    { "sha224",     impl::hash::make<Sha2<SHA_224>> },
+    { "sha256",     impl::hash::make<Sha2<SHA_256>> },
+    { "sha384",     impl::hash::make<Sha2<SHA_384>> },
+    { "sha512",     impl::hash::make<Sha2<SHA_512>> },
+    { "sha512-224", impl::hash::make<Sha2<SHA_512_224>> },
+    { "sha512-256", impl::hash::make<Sha2<SHA_512_256>> },
+    { "gimli",      impl::hash::make<Gimli> },
+};
+
+/**
+ * @brief Create hash by name from hash_registry.
+ *
+ * @param name Algorithm name, e.g. "sha256"
+ * @return Hash, empty if name is unknown
+ */
+inline any_hash make_hash(std::string_view name)
+{
+    for (auto &it : hash_registry)
+        if (it.name == name)
+            return it.make();
+    return {};
+}
+
+}
+
+#endif
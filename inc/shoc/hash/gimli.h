@@ -9,10 +9,14 @@ struct Gimli : Eater<Gimli> {
     static constexpr size_t SIZE        = 32;
     static constexpr size_t STATE_SIZE  = 48;   // In bytes
     static constexpr size_t BLOCK_SIZE  = 16;   // In bytes
+    static constexpr size_t SAVE_SIZE   = 4 + STATE_SIZE;
 public:
     void init();
     void feed(const void *in, size_t len);
     void stop(byte *out);
+    size_t save_state(byte *out) const;
+    bool load_state(const byte *in, size_t len);
+    Gimli clone() const { return *this; }
 private:
     void step();
 private:
@@ -59,6 +63,45 @@ inline void Gimli::stop(byte *out)
     zero(this, sizeof(*this));
 }
 
+/**
+ * @brief Save intermediate state as: version, algorithm id, position
+ * within rate and whole permutation state.
+ *
+ * @param out Output, at least SAVE_SIZE bytes
+ * @return Number of bytes written
+ */
+inline size_t Gimli::save_state(byte *out) const
+{
+    assert(out);
+
+    out[0] = impl::hash::state_version;
+    putle(uint16_t(impl::hash::state_id::gimli), out + 1);
+    out[3] = idx;
+    copy(out + 4, state8, STATE_SIZE);
+
+    return SAVE_SIZE;
+}
+
+/**
+ * @brief Restore state saved by save_state().
+ *
+ * @param in Saved state
+ * @param len Length of saved state
+ * @return true on success, false if state is malformed or belongs to
+ * different algorithm, in which case context is unchanged
+ */
+inline bool Gimli::load_state(const byte *in, size_t len)
+{
+    if (!in || len != SAVE_SIZE || in[0] != impl::hash::state_version ||
+        getle<uint16_t>(in + 1) != uint16_t(impl::hash::state_id::gimli) || in[3] >= BLOCK_SIZE)
+        return false;
+
+    idx = in[3];
+    copy(state8, in + 4, STATE_SIZE);
+
+    return true;
+}
+
 inline void Gimli::step()
 {
     word x, y, z;
@@ -13,14 +13,13 @@ public:
     void init();
     void feed(const void *in, size_t len);
     void stop(byte *out);
-private:
-    void pad();
-    void step();
 private:
     using word = uint32_t;
+private:
+    void pad();
+    static void compress(word *state, const byte *in, size_t nblocks);
 private:    
-    word length_low;
-    word length_high;
+    uint64_t length;
     word state[STATE_SIZE];
     byte block[BLOCK_SIZE];
     byte block_idx;
@@ -33,7 +32,8 @@ inline void Md4::init()
     state[2] = 0x98badcfe;
     state[3] = 0x10325476;
 
-    block_idx = length_high = length_low = 0;
+    length = 0;
+    block_idx = 0;
 }
 
 inline void Md4::feed(const void *in, size_t len)
@@ -42,15 +42,26 @@ inline void Md4::feed(const void *in, size_t len)
 
     auto p = static_cast<const byte*>(in);
 
-    while (len--) {
-
-        block[block_idx++] = *p++;
-
-        if ((length_low += 8) == 0)
-            length_high += 1;
-        if (block_idx == BLOCK_SIZE)
-            step();
+    length += len;
+
+    if (block_idx) {
+        size_t n = BLOCK_SIZE - block_idx < len ? BLOCK_SIZE - block_idx : len;
+        copy(block + block_idx, p, n);
+        block_idx += n;
+        p   += n;
+        len -= n;
+        if (block_idx < BLOCK_SIZE)
+            return;
+        compress(state, block, 1);
+        block_idx = 0;
+    }
+    if (len >= BLOCK_SIZE) {
+        compress(state, p, len / BLOCK_SIZE);
+        p   += len & ~(BLOCK_SIZE - 1);
+        len &= BLOCK_SIZE - 1;
     }
+    copy(block, p, len);
+    block_idx = len;
 }
 
 inline void Md4::stop(byte *out)
@@ -75,32 +86,23 @@ inline void Md4::pad()
 
     if (block_idx > pad_start) {
         fill(block + block_idx, 0, BLOCK_SIZE - block_idx);
-        step();
+        compress(state, block, 1);
+        block_idx = 0;
     }
     fill(block + block_idx, 0, pad_start - block_idx);
-
-    for (size_t i = 0, j = 0; i < 4; ++i, j += 8) {
-        block[BLOCK_SIZE - 8 + i] = length_low  >> j;
-        block[BLOCK_SIZE - 4 + i] = length_high >> j;
-    }
-    step();
+    putle(length << 3, block + pad_start);
+    compress(state, block, 1);
 }
 
-inline void Md4::step()
+/**
+ * @brief Process consecutive full blocks directly from input.
+ * 
+ * @param state Hash state
+ * @param in Input blocks
+ * @param nblocks Number of blocks
+ */
+inline void Md4::compress(word *state, const byte *in, size_t nblocks)
 {
-    word a = state[0];
-    word b = state[1];
-    word c = state[2];
-    word d = state[3];
-    word buf[16];
-
-    for (size_t i = 0, j = 0; j < BLOCK_SIZE; ++i, j +=4) {
-        buf[i]  = block[j + 0] << 0;
-        buf[i] |= block[j + 1] << 8;
-        buf[i] |= block[j + 2] << 16;
-        buf[i] |= block[j + 3] << 24;
-    }
-
 #define FF(a, b, c, d, x, s)                \
     a += ch(b, c, d) + x;                   \
     a = rol(a, s);
@@ -128,67 +130,76 @@ inline void Md4::step()
         S34 = 15,
     };
 
-    FF(a, b, c, d, buf[ 0], S11);
-    FF(d, a, b, c, buf[ 1], S12);
-    FF(c, d, a, b, buf[ 2], S13);
-    FF(b, c, d, a, buf[ 3], S14);
-    FF(a, b, c, d, buf[ 4], S11);
-    FF(d, a, b, c, buf[ 5], S12);
-    FF(c, d, a, b, buf[ 6], S13);
-    FF(b, c, d, a, buf[ 7], S14);
-    FF(a, b, c, d, buf[ 8], S11);
-    FF(d, a, b, c, buf[ 9], S12);
-    FF(c, d, a, b, buf[10], S13);
-    FF(b, c, d, a, buf[11], S14);
-    FF(a, b, c, d, buf[12], S11);
-    FF(d, a, b, c, buf[13], S12);
-    FF(c, d, a, b, buf[14], S13);
-    FF(b, c, d, a, buf[15], S14);
-
-    GG(a, b, c, d, buf[ 0], S21);
-    GG(d, a, b, c, buf[ 4], S22);
-    GG(c, d, a, b, buf[ 8], S23);
-    GG(b, c, d, a, buf[12], S24);
-    GG(a, b, c, d, buf[ 1], S21);
-    GG(d, a, b, c, buf[ 5], S22);
-    GG(c, d, a, b, buf[ 9], S23);
-    GG(b, c, d, a, buf[13], S24);
-    GG(a, b, c, d, buf[ 2], S21);
-    GG(d, a, b, c, buf[ 6], S22);
-    GG(c, d, a, b, buf[10], S23);
-    GG(b, c, d, a, buf[14], S24);
-    GG(a, b, c, d, buf[ 3], S21);
-    GG(d, a, b, c, buf[ 7], S22);
-    GG(c, d, a, b, buf[11], S23);
-    GG(b, c, d, a, buf[15], S24);
-
-    HH(a, b, c, d, buf[ 0], S31);
-    HH(d, a, b, c, buf[ 8], S32);
-    HH(c, d, a, b, buf[ 4], S33);
-    HH(b, c, d, a, buf[12], S34);
-    HH(a, b, c, d, buf[ 2], S31);
-    HH(d, a, b, c, buf[10], S32);
-    HH(c, d, a, b, buf[ 6], S33);
-    HH(b, c, d, a, buf[14], S34);
-    HH(a, b, c, d, buf[ 1], S31);
-    HH(d, a, b, c, buf[ 9], S32);
-    HH(c, d, a, b, buf[ 5], S33);
-    HH(b, c, d, a, buf[13], S34);
-    HH(a, b, c, d, buf[ 3], S31);
-    HH(d, a, b, c, buf[11], S32);
-    HH(c, d, a, b, buf[ 7], S33);
-    HH(b, c, d, a, buf[15], S34);
+    for (; nblocks--; in += BLOCK_SIZE) {
+        word a = state[0];
+        word b = state[1];
+        word c = state[2];
+        word d = state[3];
+        word buf[16];
+
+        for (size_t i = 0; i < 16; ++i)
+            buf[i] = getle<word>(in + i * 4);
+
+        FF(a, b, c, d, buf[ 0], S11);
+        FF(d, a, b, c, buf[ 1], S12);
+        FF(c, d, a, b, buf[ 2], S13);
+        FF(b, c, d, a, buf[ 3], S14);
+        FF(a, b, c, d, buf[ 4], S11);
+        FF(d, a, b, c, buf[ 5], S12);
+        FF(c, d, a, b, buf[ 6], S13);
+        FF(b, c, d, a, buf[ 7], S14);
+        FF(a, b, c, d, buf[ 8], S11);
+        FF(d, a, b, c, buf[ 9], S12);
+        FF(c, d, a, b, buf[10], S13);
+        FF(b, c, d, a, buf[11], S14);
+        FF(a, b, c, d, buf[12], S11);
+        FF(d, a, b, c, buf[13], S12);
+        FF(c, d, a, b, buf[14], S13);
+        FF(b, c, d, a, buf[15], S14);
+
+        GG(a, b, c, d, buf[ 0], S21);
+        GG(d, a, b, c, buf[ 4], S22);
+        GG(c, d, a, b, buf[ 8], S23);
+        GG(b, c, d, a, buf[12], S24);
+        GG(a, b, c, d, buf[ 1], S21);
+        GG(d, a, b, c, buf[ 5], S22);
+        GG(c, d, a, b, buf[ 9], S23);
+        GG(b, c, d, a, buf[13], S24);
+        GG(a, b, c, d, buf[ 2], S21);
+        GG(d, a, b, c, buf[ 6], S22);
+        GG(c, d, a, b, buf[10], S23);
+        GG(b, c, d, a, buf[14], S24);
+        GG(a, b, c, d, buf[ 3], S21);
+        GG(d, a, b, c, buf[ 7], S22);
+        GG(c, d, a, b, buf[11], S23);
+        GG(b, c, d, a, buf[15], S24);
+
+        HH(a, b, c, d, buf[ 0], S31);
+        HH(d, a, b, c, buf[ 8], S32);
+        HH(c, d, a, b, buf[ 4], S33);
+        HH(b, c, d, a, buf[12], S34);
+        HH(a, b, c, d, buf[ 2], S31);
+        HH(d, a, b, c, buf[10], S32);
+        HH(c, d, a, b, buf[ 6], S33);
+        HH(b, c, d, a, buf[14], S34);
+        HH(a, b, c, d, buf[ 1], S31);
+        HH(d, a, b, c, buf[ 9], S32);
+        HH(c, d, a, b, buf[ 5], S33);
+        HH(b, c, d, a, buf[13], S34);
+        HH(a, b, c, d, buf[ 3], S31);
+        HH(d, a, b, c, buf[11], S32);
+        HH(c, d, a, b, buf[ 7], S33);
+        HH(b, c, d, a, buf[15], S34);
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
 
 #undef FF
 #undef GG
 #undef HH
-
-    state[0] += a;
-    state[1] += b;
-    state[2] += c;
-    state[3] += d;
-
-    block_idx = 0;
 }
 
 }
@@ -9,18 +9,21 @@ struct Md5 : Eater<Md5> {
     static constexpr size_t SIZE        = 16;
     static constexpr size_t STATE_SIZE  = 4;    // In words
     static constexpr size_t BLOCK_SIZE  = 64;   // In bytes
+    static constexpr size_t SAVE_SIZE   = impl::hash::md_state_size<uint32_t>(STATE_SIZE, BLOCK_SIZE);
 public:
     void init();
     void feed(const void *in, size_t len);
     void stop(byte *out);
-private:
-    void pad();
-    void step();
+    size_t save_state(byte *out) const;
+    bool load_state(const byte *in, size_t len);
+    Md5 clone() const { return *this; }
 private:
     using word = uint32_t;
+private:
+    void pad();
+    static void compress(word *state, const byte *in, size_t nblocks);
 private:  
-    word length_low;
-    word length_high;
+    uint64_t length;
     word state[STATE_SIZE];
     byte block[BLOCK_SIZE];
     byte block_idx;
@@ -33,7 +36,8 @@ inline void Md5::init()
     state[2] = 0x98badcfe;
     state[3] = 0x10325476;
 
-    block_idx = length_high = length_low = 0;
+    length = 0;
+    block_idx = 0;
 }
 
 inline void Md5::feed(const void *in, size_t len)
@@ -42,15 +46,26 @@ inline void Md5::feed(const void *in, size_t len)
 
     auto p = static_cast<const byte*>(in);
 
-    while (len--) {
-
-        block[block_idx++] = *p++;
-
-        if ((length_low += 8) == 0)
-            length_high += 1;
-        if (block_idx == BLOCK_SIZE)
-            step();
+    length += len;
+
+    if (block_idx) {
+        size_t n = BLOCK_SIZE - block_idx < len ? BLOCK_SIZE - block_idx : len;
+        copy(block + block_idx, p, n);
+        block_idx += n;
+        p   += n;
+        len -= n;
+        if (block_idx < BLOCK_SIZE)
+            return;
+        compress(state, block, 1);
+        block_idx = 0;
+    }
+    if (len >= BLOCK_SIZE) {
+        compress(state, p, len / BLOCK_SIZE);
+        p   += len & ~(BLOCK_SIZE - 1);
+        len &= BLOCK_SIZE - 1;
     }
+    copy(block, p, len);
+    block_idx = len;
 }
 
 inline void Md5::stop(byte *out)
@@ -67,6 +82,35 @@ inline void Md5::stop(byte *out)
     zero(this, sizeof(*this));
 }
 
+/**
+ * @brief Save intermediate state, so that hashing can be resumed later
+ * with load_state(), possibly by another instance. Context is unchanged.
+ *
+ * @param out Output, at least SAVE_SIZE bytes
+ * @return Number of bytes written
+ */
+inline size_t Md5::save_state(byte *out) const
+{
+    assert(out);
+    return impl::hash::md_save(impl::hash::state_id::md5, length, state, STATE_SIZE, block, BLOCK_SIZE, out);
+}
+
+/**
+ * @brief Restore state saved by save_state().
+ *
+ * @param in Saved state
+ * @param len Length of saved state
+ * @return true on success, false if state is malformed or belongs to
+ * different algorithm, in which case context is unchanged
+ */
+inline bool Md5::load_state(const byte *in, size_t len)
+{
+    if (!impl::hash::md_load(impl::hash::state_id::md5, in, len, length, state, STATE_SIZE, block, BLOCK_SIZE))
+        return false;
+    block_idx = length % BLOCK_SIZE;
+    return true;
+}
+
 inline void Md5::pad()
 {
     static constexpr size_t pad_start = BLOCK_SIZE - 8;
@@ -75,32 +119,23 @@ inline void Md5::pad()
 
     if (block_idx > pad_start) {
         fill(block + block_idx, 0, BLOCK_SIZE - block_idx);
-        step();
+        compress(state, block, 1);
+        block_idx = 0;
     }
     fill(block + block_idx, 0, pad_start - block_idx);
-
-    for (size_t i = 0, j = 0; i < 4; ++i, j += 8) {
-        block[BLOCK_SIZE - 8 + i] = length_low  >> j;
-        block[BLOCK_SIZE - 4 + i] = length_high >> j;
-    }
-    step();
+    putle(length << 3, block + pad_start);
+    compress(state, block, 1);
 }
 
-inline void Md5::step()
+/**
+ * @brief Process consecutive full blocks directly from input.
+ * 
+ * @param state Hash state
+ * @param in Input blocks
+ * @param nblocks Number of blocks
+ */
+inline void Md5::compress(word *state, const byte *in, size_t nblocks)
 {
-    word a = state[0];
-    word b = state[1];
-    word c = state[2];
-    word d = state[3];
-    word buf[16];
-
-    for (size_t i = 0, j = 0; j < BLOCK_SIZE; ++i, j +=4) {
-        buf[i]  = block[j + 0] << 0;
-        buf[i] |= block[j + 1] << 8;
-        buf[i] |= block[j + 2] << 16;
-        buf[i] |= block[j + 3] << 24;
-    }
-
 #define F(x, y, z) (((x) & (y)) | ((~x) & (z)))
 #define G(x, y, z) (((x) & (z)) | ((y) & (~z)))
 #define H(x, y, z) parity(x, y, z)
@@ -145,73 +180,89 @@ inline void Md5::step()
         S44 = 21,
     };
 
-    FF(a, b, c, d, buf[ 0], S11, 0xd76aa478);
-    FF(d, a, b, c, buf[ 1], S12, 0xe8c7b756);
-    FF(c, d, a, b, buf[ 2], S13, 0x242070db);
-    FF(b, c, d, a, buf[ 3], S14, 0xc1bdceee);
-    FF(a, b, c, d, buf[ 4], S11, 0xf57c0faf);
-    FF(d, a, b, c, buf[ 5], S12, 0x4787c62a);
-    FF(c, d, a, b, buf[ 6], S13, 0xa8304613);
-    FF(b, c, d, a, buf[ 7], S14, 0xfd469501);
-    FF(a, b, c, d, buf[ 8], S11, 0x698098d8);
-    FF(d, a, b, c, buf[ 9], S12, 0x8b44f7af);
-    FF(c, d, a, b, buf[10], S13, 0xffff5bb1);
-    FF(b, c, d, a, buf[11], S14, 0x895cd7be);
-    FF(a, b, c, d, buf[12], S11, 0x6b901122);
-    FF(d, a, b, c, buf[13], S12, 0xfd987193);
-    FF(c, d, a, b, buf[14], S13, 0xa679438e);
-    FF(b, c, d, a, buf[15], S14, 0x49b40821);
-
-    GG(a, b, c, d, buf[ 1], S21, 0xf61e2562);
-    GG(d, a, b, c, buf[ 6], S22, 0xc040b340);
-    GG(c, d, a, b, buf[11], S23, 0x265e5a51);
-    GG(b, c, d, a, buf[ 0], S24, 0xe9b6c7aa);
-    GG(a, b, c, d, buf[ 5], S21, 0xd62f105d);
-    GG(d, a, b, c, buf[10], S22, 0x02441453);
-    GG(c, d, a, b, buf[15], S23, 0xd8a1e681);
-    GG(b, c, d, a, buf[ 4], S24, 0xe7d3fbc8);
-    GG(a, b, c, d, buf[ 9], S21, 0x21e1cde6);
-    GG(d, a, b, c, buf[14], S22, 0xc33707d6);
-    GG(c, d, a, b, buf[ 3], S23, 0xf4d50d87);
-    GG(b, c, d, a, buf[ 8], S24, 0x455a14ed);
-    GG(a, b, c, d, buf[13], S21, 0xa9e3e905);
-    GG(d, a, b, c, buf[ 2], S22, 0xfcefa3f8);
-    GG(c, d, a, b, buf[ 7], S23, 0x676f02d9);
-    GG(b, c, d, a, buf[12], S24, 0x8d2a4c8a);
-
-    HH(a, b, c, d, buf[ 5], S31, 0xfffa3942);
-    HH(d, a, b, c, buf[ 8], S32, 0x8771f681);
-    HH(c, d, a, b, buf[11], S33, 0x6d9d6122);
-    HH(b, c, d, a, buf[14], S34, 0xfde5380c);
-    HH(a, b, c, d, buf[ 1], S31, 0xa4beea44);
-    HH(d, a, b, c, buf[ 4], S32, 0x4bdecfa9);
-    HH(c, d, a, b, buf[ 7], S33, 0xf6bb4b60);
-    HH(b, c, d, a, buf[10], S34, 0xbebfbc70);
-    HH(a, b, c, d, buf[13], S31, 0x289b7ec6);
-    HH(d, a, b, c, buf[ 0], S32, 0xeaa127fa);
-    HH(c, d, a, b, buf[ 3], S33, 0xd4ef3085);
-    HH(b, c, d, a, buf[ 6], S34, 0x04881d05);
-    HH(a, b, c, d, buf[ 9], S31, 0xd9d4d039);
-    HH(d, a, b, c, buf[12], S32, 0xe6db99e5);
-    HH(c, d, a, b, buf[15], S33, 0x1fa27cf8);
-    HH(b, c, d, a, buf[ 2], S34, 0xc4ac5665);
-
-    II(a, b, c, d, buf[ 0], S41, 0xf4292244);
-    II(d, a, b, c, buf[ 7], S42, 0x432aff97);
-    II(c, d, a, b, buf[14], S43, 0xab9423a7);
-    II(b, c, d, a, buf[ 5], S44, 0xfc93a039);
-    II(a, b, c, d, buf[12], S41, 0x655b59c3);
-    II(d, a, b, c, buf[ 3], S42, 0x8f0ccc92);
-    II(c, d, a, b, buf[10], S43, 0xffeff47d);
-    II(b, c, d, a, buf[ 1], S44, 0x85845dd1);
-    II(a, b, c, d, buf[ 8], S41, 0x6fa87e4f);
-    II(d, a, b, c, buf[15], S42, 0xfe2ce6e0);
-    II(c, d, a, b, buf[ 6], S43, 0xa3014314);
-    II(b, c, d, a, buf[13], S44, 0x4e0811a1);
-    II(a, b, c, d, buf[ 4], S41, 0xf7537e82);
-    II(d, a, b, c, buf[11], S42, 0xbd3af235);
-    II(c, d, a, b, buf[ 2], S43, 0x2ad7d2bb);
-    II(b, c, d, a, buf[ 9], S44, 0xeb86d391);
+    for (; nblocks--; in += BLOCK_SIZE) {
+        word a = state[0];
+        word b = state[1];
+        word c = state[2];
+        word d = state[3];
+        word buf[16];
+
+        for (size_t i = 0; i < 16; ++i)
+            buf[i] = getle<word>(in + i * 4);
+
+        FF(a, b, c, d, buf[ 0], S11, 0xd76aa478);
+        FF(d, a, b, c, buf[ 1], S12, 0xe8c7b756);
+        FF(c, d, a, b, buf[ 2], S13, 0x242070db);
+        FF(b, c, d, a, buf[ 3], S14, 0xc1bdceee);
+        FF(a, b, c, d, buf[ 4], S11, 0xf57c0faf);
+        FF(d, a, b, c, buf[ 5], S12, 0x4787c62a);
+        FF(c, d, a, b, buf[ 6], S13, 0xa8304613);
+        FF(b, c, d, a, buf[ 7], S14, 0xfd469501);
+        FF(a, b, c, d, buf[ 8], S11, 0x698098d8);
+        FF(d, a, b, c, buf[ 9], S12, 0x8b44f7af);
+        FF(c, d, a, b, buf[10], S13, 0xffff5bb1);
+        FF(b, c, d, a, buf[11], S14, 0x895cd7be);
+        FF(a, b, c, d, buf[12], S11, 0x6b901122);
+        FF(d, a, b, c, buf[13], S12, 0xfd987193);
+        FF(c, d, a, b, buf[14], S13, 0xa679438e);
+        FF(b, c, d, a, buf[15], S14, 0x49b40821);
+
+        GG(a, b, c, d, buf[ 1], S21, 0xf61e2562);
+        GG(d, a, b, c, buf[ 6], S22, 0xc040b340);
+        GG(c, d, a, b, buf[11], S23, 0x265e5a51);
+        GG(b, c, d, a, buf[ 0], S24, 0xe9b6c7aa);
+        GG(a, b, c, d, buf[ 5], S21, 0xd62f105d);
+        GG(d, a, b, c, buf[10], S22, 0x02441453);
+        GG(c, d, a, b, buf[15], S23, 0xd8a1e681);
+        GG(b, c, d, a, buf[ 4], S24, 0xe7d3fbc8);
+        GG(a, b, c, d, buf[ 9], S21, 0x21e1cde6);
+        GG(d, a, b, c, buf[14], S22, 0xc33707d6);
+        GG(c, d, a, b, buf[ 3], S23, 0xf4d50d87);
+        GG(b, c, d, a, buf[ 8], S24, 0x455a14ed);
+        GG(a, b, c, d, buf[13], S21, 0xa9e3e905);
+        GG(d, a, b, c, buf[ 2], S22, 0xfcefa3f8);
+        GG(c, d, a, b, buf[ 7], S23, 0x676f02d9);
+        GG(b, c, d, a, buf[12], S24, 0x8d2a4c8a);
+
+        HH(a, b, c, d, buf[ 5], S31, 0xfffa3942);
+        HH(d, a, b, c, buf[ 8], S32, 0x8771f681);
+        HH(c, d, a, b, buf[11], S33, 0x6d9d6122);
+        HH(b, c, d, a, buf[14], S34, 0xfde5380c);
+        HH(a, b, c, d, buf[ 1], S31, 0xa4beea44);
+        HH(d, a, b, c, buf[ 4], S32, 0x4bdecfa9);
+        HH(c, d, a, b, buf[ 7], S33, 0xf6bb4b60);
+        HH(b, c, d, a, buf[10], S34, 0xbebfbc70);
+        HH(a, b, c, d, buf[13], S31, 0x289b7ec6);
+        HH(d, a, b, c, buf[ 0], S32, 0xeaa127fa);
+        HH(c, d, a, b, buf[ 3], S33, 0xd4ef3085);
+        HH(b, c, d, a, buf[ 6], S34, 0x04881d05);
+        HH(a, b, c, d, buf[ 9], S31, 0xd9d4d039);
+        HH(d, a, b, c, buf[12], S32, 0xe6db99e5);
+        HH(c, d, a, b, buf[15], S33, 0x1fa27cf8);
+        HH(b, c, d, a, buf[ 2], S34, 0xc4ac5665);
+
+        II(a, b, c, d, buf[ 0], S41, 0xf4292244);
+        II(d, a, b, c, buf[ 7], S42, 0x432aff97);
+        II(c, d, a, b, buf[14], S43, 0xab9423a7);
+        II(b, c, d, a, buf[ 5], S44, 0xfc93a039);
+        II(a, b, c, d, buf[12], S41, 0x655b59c3);
+        II(d, a, b, c, buf[ 3], S42, 0x8f0ccc92);
+        II(c, d, a, b, buf[10], S43, 0xffeff47d);
+        II(b, c, d, a, buf[ 1], S44, 0x85845dd1);
+        II(a, b, c, d, buf[ 8], S41, 0x6fa87e4f);
+        II(d, a, b, c, buf[15], S42, 0xfe2ce6e0);
+        II(c, d, a, b, buf[ 6], S43, 0xa3014314);
+        II(b, c, d, a, buf[13], S44, 0x4e0811a1);
+        II(a, b, c, d, buf[ 4], S41, 0xf7537e82);
+        II(d, a, b, c, buf[11], S42, 0xbd3af235);
+        II(c, d, a, b, buf[ 2], S43, 0x2ad7d2bb);
+        II(b, c, d, a, buf[ 9], S44, 0xeb86d391);
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
 
 #undef F
 #undef G
@@ -221,13 +272,6 @@ inline void Md5::step()
 #undef GG
 #undef HH
 #undef II
-
-    state[0] += a;
-    state[1] += b;
-    state[2] += c;
-    state[3] += d;
-
-    block_idx = 0;
 }
 
 }
@@ -0,0 +1,352 @@
+#ifndef SHOC_HASH_MERKLE_H
+#define SHOC_HASH_MERKLE_H
+
+#include "shoc/hash/sha2_multi.h"
+#include <algorithm>
+#include <bit>
+#include <vector>
+
+namespace shoc {
+namespace impl::merkle {
+
+/**
+ * @brief Domain separation prefixes of RFC 6962, leaf data can't be
+ * passed off as an interior node and vice versa.
+ *
+ */
+inline constexpr byte leaf_prefix = 0x00;
+inline constexpr byte node_prefix = 0x01;
+
+/**
+ * @brief Messages collected before one multi-buffer call.
+ *
+ */
+inline constexpr size_t batch_msgs = 1024;
+
+/**
+ * @brief Bytes of leaf data collected before one multi-buffer call.
+ *
+ */
+inline constexpr size_t batch_bytes = 1 << 20;
+
+/**
+ * @brief Position of node in flat in-order array: leaves are at even
+ * indices, parent of two subtrees lies between them. Every complete
+ * subtree occupies a contiguous range and appending leaves only ever
+ * extends the array.
+ *
+ * @param depth Height of node above leaves
+ * @param offset Index of node within its level
+ * @return Index in node array
+ */
+constexpr size_t index(size_t depth, size_t offset)
+{
+    return offset << (depth + 1) | ((size_t(1) << depth) - 1);
+}
+
+/**
+ * @brief Hash prefix and up to two parts of message, either leaf data or
+ * pair of child digests.
+ *
+ */
+template<Sha2Type T>
+inline void hash(byte prefix, const void *a, size_t a_len, const void *b, size_t b_len, byte *out)
+{
+    Sha2<T> h;
+    h.init();
+    h.feed(&prefix, 1);
+    h.feed(a, a_len);
+    h.feed(b, b_len);
+    h.stop(out);
+}
+
+/**
+ * @brief Collects independent messages and hashes them together with
+ * sha256_multi(). Other hashes of the family have no multi-buffer path,
+ * so their messages are hashed right away.
+ *
+ */
+template<Sha2Type T>
+struct batch {
+    using digest = std::array<byte, Sha2<T>::SIZE>;
+
+    void add(byte prefix, const void *a, size_t a_len, const void *b, size_t b_len, digest &out)
+    {
+        if constexpr (T != SHA_256) {
+            hash<T>(prefix, a, a_len, b, b_len, out.data());
+        } else {
+            auto pa = static_cast<const byte*>(a);
+            auto pb = static_cast<const byte*>(b);
+            buf.push_back(prefix);
+            buf.insert(buf.end(), pa, pa + a_len);
+            buf.insert(buf.end(), pb, pb + b_len);
+            ends.push_back(buf.size());
+            outs.push_back(&out);
+            if (outs.size() == batch_msgs || buf.size() >= batch_bytes)
+                flush();
+        }
+    }
+    void flush()
+    {
+        if constexpr (T == SHA_256) {
+            if (outs.empty())
+                return;
+            span_i<> msgs[batch_msgs];
+            sha256_digest res[batch_msgs];
+            for (size_t i = 0, begin = 0; i < outs.size(); begin = ends[i++])
+                msgs[i] = { buf.data() + begin, ends[i] - begin };
+            sha256_multi({msgs, outs.size()}, {res, outs.size()});
+            for (size_t i = 0; i < outs.size(); ++i)
+                *outs[i] = res[i];
+            buf.clear();
+            ends.clear();
+            outs.clear();
+        }
+    }
+private:
+    std::vector<byte> buf;
+    std::vector<size_t> ends;
+    std::vector<digest*> outs;
+};
+
+}
+
+/**
+ * @brief Append-only Merkle tree over hash of SHA-2 family, as defined
+ * in RFC 6962: leaf is hashed as H(0x00 || data), interior node as
+ * H(0x01 || left || right), tree over n leaves is split into complete
+ * left subtree of largest power of 2 below n leaves and the rest.
+ *
+ * Nodes of all complete subtrees are kept in one flat array in in-order
+ * layout, so appending a leaf hashes at most log2(n) new nodes, while
+ * root and inclusion proofs for current or any earlier tree size need
+ * O(log n) hashes over stored nodes. Leaves appended in bulk are hashed
+ * level by level, for SHA-256 all sibling pairs of a level go through
+ * the multi-buffer path.
+ *
+ * @tparam T SHA-2 variant
+ */
+template<Sha2Type T = SHA_256>
+struct merkle_tree {
+    using digest = std::array<byte, Sha2<T>::SIZE>;
+public:
+    void init()                         { nodes.clear(); count = 0; }
+    void append(const void *in, size_t len);
+    void append(std::span<const span_i<>> leaves);
+
+    digest root() const                 { return root(count); }
+    digest root(size_t size) const;
+    std::vector<digest> prove(size_t leaf) const { return prove(leaf, count); }
+    std::vector<digest> prove(size_t leaf, size_t size) const;
+
+    const digest& leaf(size_t i) const  { return nodes[2 * i]; }
+    size_t size() const                 { return count; }
+
+    static digest hash_leaf(const void *in, size_t len);
+    static digest hash_node(const digest &l, const digest &r);
+    static bool verify(const digest &leaf, size_t idx, size_t size, std::span<const digest> proof, const digest &root);
+private:
+    digest subtree(size_t begin, size_t end) const;
+private:
+    std::vector<digest> nodes;
+    size_t count = 0;
+};
+
+/**
+ * @brief Append single leaf and hash every subtree it completes.
+ *
+ * @param in Leaf data
+ * @param len Length of leaf data
+ */
+template<Sha2Type T>
+inline void merkle_tree<T>::append(const void *in, size_t len)
+{
+    assert(in || !len);
+
+    size_t x = 2 * count++;
+
+    nodes.resize(x + 1);
+    nodes[x] = hash_leaf(in, len);
+
+    for (size_t d = 0; x >> (d + 1) & 1; ++d) {
+        size_t up = x - (size_t(1) << d);
+        nodes[up] = hash_node(nodes[x - (size_t(2) << d)], nodes[x]);
+        x = up;
+    }
+}
+
+/**
+ * @brief Append many leaves at once. Leaves and then new nodes of each
+ * level are hashed as independent messages in batches, which for SHA-256
+ * uses multi-buffer hashing. Result is same as appending one by one.
+ *
+ * @param leaves Leaf data
+ */
+template<Sha2Type T>
+inline void merkle_tree<T>::append(std::span<const span_i<>> leaves)
+{
+    if (leaves.empty())
+        return;
+
+    size_t first = count;
+    size_t last = count + leaves.size();
+    impl::merkle::batch<T> batch;
+
+    nodes.resize(2 * last - 1);
+
+    for (size_t i = first; i < last; ++i) {
+        auto l = leaves[i - first];
+        batch.add(impl::merkle::leaf_prefix, l.data(), l.size(), nullptr, 0, nodes[2 * i]);
+    }
+    batch.flush();
+
+    for (size_t d = 0; last >> (d + 1) > first >> (d + 1); ++d) {
+        for (size_t j = first >> (d + 1); j < last >> (d + 1); ++j) {
+            auto &l = nodes[impl::merkle::index(d, 2 * j)];
+            auto &r = nodes[impl::merkle::index(d, 2 * j + 1)];
+            batch.add(impl::merkle::node_prefix, l.data(), l.size(), r.data(), r.size(), nodes[impl::merkle::index(d + 1, j)]);
+        }
+        batch.flush();
+    }
+    count = last;
+}
+
+/**
+ * @brief Root of tree over first leaves, i.e. root the tree had when it
+ * was of given size. Root of empty tree is hash of empty string.
+ *
+ * @param size Number of leaves, at most size()
+ * @return Root
+ */
+template<Sha2Type T>
+inline auto merkle_tree<T>::root(size_t size) const -> digest
+{
+    assert(size <= count);
+
+    if (size)
+        return subtree(0, size);
+
+    digest out;
+    Sha2<T>{}(nullptr, 0, out.data());
+    return out;
+}
+
+/**
+ * @brief Inclusion proof (audit path) of a leaf: siblings on the path
+ * from leaf to root, bottom-up.
+ *
+ * @param leaf Leaf index, less than size
+ * @param size Tree size the proof is made for, at most size()
+ * @return Proof, empty if tree has single leaf
+ */
+template<Sha2Type T>
+inline auto merkle_tree<T>::prove(size_t leaf, size_t size) const -> std::vector<digest>
+{
+    assert(leaf < size && size <= count);
+
+    std::vector<digest> path;
+
+    for (size_t begin = 0, end = size; end - begin > 1;) {
+        size_t mid = begin + std::bit_floor(end - begin - 1);
+        if (leaf < mid) {
+            path.push_back(subtree(mid, end));
+            end = mid;
+        } else {
+            path.push_back(subtree(begin, mid));
+            begin = mid;
+        }
+    }
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+/**
+ * @brief Leaf digest.
+ *
+ * @param in Leaf data
+ * @param len Length of leaf data
+ * @return H(0x00 || data)
+ */
+template<Sha2Type T>
+inline auto merkle_tree<T>::hash_leaf(const void *in, size_t len) -> digest
+{
+    digest out;
+    impl::merkle::hash<T>(impl::merkle::leaf_prefix, in, len, nullptr, 0, out.data());
+    return out;
+}
+
+/**
+ * @brief Interior node digest.
+ *
+ * @param l Left child
+ * @param r Right child
+ * @return H(0x01 || l || r)
+ */
+template<Sha2Type T>
+inline auto merkle_tree<T>::hash_node(const digest &l, const digest &r) -> digest
+{
+    digest out;
+    impl::merkle::hash<T>(impl::merkle::node_prefix, l.data(), l.size(), r.data(), r.size(), out.data());
+    return out;
+}
+
+/**
+ * @brief Verify inclusion proof without the tree, as in RFC 9162 2.1.3.2.
+ *
+ * @param leaf Leaf digest, see hash_leaf()
+ * @param idx Leaf index
+ * @param size Tree size the proof was made for
+ * @param proof Proof from prove()
+ * @param root Root of tree of given size
+ * @return true if proof leads from leaf to root
+ */
+template<Sha2Type T>
+inline bool merkle_tree<T>::verify(const digest &leaf, size_t idx, size_t size, std::span<const digest> proof, const digest &root)
+{
+    if (idx >= size)
+        return false;
+
+    size_t fn = idx;
+    size_t sn = size - 1;
+    digest r = leaf;
+
+    for (auto &p : proof) {
+        if (!sn)
+            return false;
+        if (fn & 1 || fn == sn) {
+            r = hash_node(p, r);
+            while (!(fn & 1) && fn) {
+                fn >>= 1;
+                sn >>= 1;
+            }
+        } else {
+            r = hash_node(r, p);
+        }
+        fn >>= 1;
+        sn >>= 1;
+    }
+    return !sn && r == root;
+}
+
+/**
+ * @brief Root of subtree over leaves [begin, end). Complete subtrees are
+ * read from node array, others are split as in RFC 6962.
+ *
+ */
+template<Sha2Type T>
+inline auto merkle_tree<T>::subtree(size_t begin, size_t end) const -> digest
+{
+    size_t n = end - begin;
+
+    if (std::has_single_bit(n)) {
+        size_t d = std::countr_zero(n);
+        return nodes[impl::merkle::index(d, begin >> d)];
+    }
+    size_t mid = begin + std::bit_floor(n - 1);
+
+    return hash_node(subtree(begin, mid), subtree(mid, end));
+}
+
+}
+
+#endif
@@ -2,25 +2,166 @@
 #define SHOC_HASH_SHA1_H
 
 #include "shoc/util.h"
+#include "shoc/cpu.h"
+#include <utility>
 
 namespace shoc {
+namespace impl::sha1 {
+
+/**
+ * @brief All 80 rounds of a block, fully unrolled. Instead of shifting
+ * working variables, their roles rotate: variable "a" of round t lives in
+ * v[-t mod 5], so only "b" and "e" are written. Schedule is kept in a
+ * circular buffer of 16 words and expanded in place. With constant t all
+ * indices are known at compile time and v and w stay in registers.
+ *
+ * @param v Working variables
+ * @param w Message schedule, last 16 words
+ */
+template<size_t... t>
+SHOC_ALWAYS_INLINE void rounds(uint32_t *v, uint32_t *w, std::index_sequence<t...>)
+{
+    auto round = [&]<size_t i>(std::integral_constant<size_t, i>) SHOC_ALWAYS_INLINE_LAMBDA {
+        constexpr auto at = [](size_t n) { return (n + 80 - i) % 5; };
+
+        if constexpr (i >= 16)
+            w[i % 16] = rol(w[(i + 13) % 16] ^ w[(i + 8) % 16] ^ w[(i + 2) % 16] ^ w[i % 16], 1);
+
+        uint32_t &a = v[at(0)], &b = v[at(1)], &c = v[at(2)], &d = v[at(3)], &e = v[at(4)];
+
+        if constexpr (i < 20)
+            e += rol(a, 5) + ch(b, c, d) + 0x5a827999 + w[i % 16];
+        else if constexpr (i < 40)
+            e += rol(a, 5) + parity(b, c, d) + 0x6ed9eba1 + w[i % 16];
+        else if constexpr (i < 60)
+            e += rol(a, 5) + maj(b, c, d) + 0x8f1bbcdc + w[i % 16];
+        else
+            e += rol(a, 5) + parity(b, c, d) + 0xca62c1d6 + w[i % 16];
+        b = rol(b, 30);
+    };
+    (round(std::integral_constant<size_t, t>{}), ...);
+}
+
+/**
+ * @brief Portable SHA-1 compression, used when CPU has no SHA extensions.
+ *
+ * @param state Hash state, 5 words
+ * @param in Input blocks
+ * @param nblocks Number of blocks
+ */
+inline void compress_portable(uint32_t *state, const byte *in, size_t nblocks)
+{
+    uint32_t v[5];
+    uint32_t w[16];
+
+    for (; nblocks--; in += 64) {
+        for (size_t i = 0; i < 5; ++i)
+            v[i] = state[i];
+
+        for (size_t t = 0; t < 16; ++t)
+            w[t] = getbe<uint32_t>(in + t * 4);
+
+        rounds(v, w, std::make_index_sequence<80>{});
+
+        for (size_t i = 0; i < 5; ++i)
+            state[i] += v[i];
+    }
+}
+
+#ifdef SHOC_X86
+
+/**
+ * @brief Four rounds of SHA-1 with SHA extensions. Group G consumes message
+ * vector m[G & 3] and advances schedule of the next three groups with
+ * SHA1MSG1, XOR and SHA1MSG2, E alternates between e[0] and e[1].
+ *
+ * @tparam G Group index, 0..19
+ * @param abcd State ABCD
+ * @param e E values, 2 vectors
+ * @param m Message schedule, 4 vectors
+ */
+template<int G>
+SHOC_TARGET("sha,ssse3,sse4.1")
+inline void shani_rounds(__m128i &abcd, __m128i *e, __m128i *m)
+{
+    if constexpr (G == 0)
+        e[0] = _mm_add_epi32(e[0], m[0]);
+    else
+        e[G & 1] = _mm_sha1nexte_epu32(e[G & 1], m[G & 3]);
+    e[~G & 1] = abcd;
+
+    if constexpr (G >= 3 && G <= 18)
+        m[(G + 1) & 3] = _mm_sha1msg2_epu32(m[(G + 1) & 3], m[G & 3]);
+    abcd = _mm_sha1rnds4_epu32(abcd, e[G & 1], G / 5);
+    if constexpr (G >= 1 && G <= 16)
+        m[(G + 3) & 3] = _mm_sha1msg1_epu32(m[(G + 3) & 3], m[G & 3]);
+    if constexpr (G >= 2 && G <= 17)
+        m[(G + 2) & 3] = _mm_xor_si128(m[(G + 2) & 3], m[G & 3]);
+}
+
+template<int... G>
+SHOC_TARGET("sha,ssse3,sse4.1")
+inline void shani_block(__m128i &abcd, __m128i *e, __m128i *m, std::integer_sequence<int, G...>)
+{
+    (shani_rounds<G>(abcd, e, m), ...);
+}
+
+/**
+ * @brief SHA-1 compression with SHA extensions, 80 rounds per block
+ * as 20 SHA1RNDS4 steps.
+ *
+ * @param state Hash state, 5 words
+ * @param in Input blocks
+ * @param nblocks Number of blocks
+ */
+SHOC_TARGET("sha,ssse3,sse4.1")
+inline void compress_shani(uint32_t *state, const byte *in, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607ull, 0x08090a0b0c0d0e0full);
+
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0x1b);
+    __m128i e[2] = { _mm_set_epi32(state[4], 0, 0, 0) };
+    __m128i m[4];
+
+    for (; nblocks--; in += 64) {
+        __m128i abcd_save = abcd;
+        __m128i e_save = e[0];
+
+        for (int i = 0; i < 4; ++i)
+            m[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 16)), bswap);
+
+        shani_block(abcd, e, m, std::make_integer_sequence<int, 20>{});
+
+        e[0] = _mm_sha1nexte_epu32(e[0], e_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = _mm_extract_epi32(e[0], 3);
+}
+
+#endif
+
+}
 
 struct Sha1 : Eater<Sha1> {
     static constexpr size_t SIZE        = 20;
     static constexpr size_t STATE_SIZE  = 5;    // In words
     static constexpr size_t BLOCK_SIZE  = 64;   // In bytes
+    static constexpr size_t SAVE_SIZE   = impl::hash::md_state_size<uint32_t>(STATE_SIZE, BLOCK_SIZE);
 public:
     void init();
     void feed(const void *in, size_t len);
     void stop(byte *out);
-private:
-    void pad();
-    void step();
+    size_t save_state(byte *out) const;
+    bool load_state(const byte *in, size_t len);
+    Sha1 clone() const { return *this; }
 private:
     using word = uint32_t;
 private:
-    word length_low;
-    word length_high;
+    void pad();
+    static void compress(word *state, const byte *in, size_t nblocks);
+private:
+    uint64_t length;
     word state[STATE_SIZE];
     byte block[BLOCK_SIZE];
     byte block_idx;
@@ -34,7 +175,8 @@ inline void Sha1::init()
     state[3] = 0x10325476u;
     state[4] = 0xc3d2e1f0u;
 
-    block_idx = length_high = length_low = 0;
+    length = 0;
+    block_idx = 0;
 }
 
 inline void Sha1::feed(const void *in, size_t len)
@@ -43,15 +185,26 @@ inline void Sha1::feed(const void *in, size_t len)
 
     auto p = static_cast<const byte*>(in);
 
-    while (len--) {
+    length += len;
 
-        block[block_idx++] = *p++;
-
-        if ((length_low += 8) == 0)
-            length_high += 1;
-        if (block_idx == BLOCK_SIZE)
-            step();
+    if (block_idx) {
+        size_t n = BLOCK_SIZE - block_idx < len ? BLOCK_SIZE - block_idx : len;
+        copy(block + block_idx, p, n);
+        block_idx += n;
+        p   += n;
+        len -= n;
+        if (block_idx < BLOCK_SIZE)
+            return;
+        compress(state, block, 1);
+        block_idx = 0;
+    }
+    if (len >= BLOCK_SIZE) {
+        compress(state, p, len / BLOCK_SIZE);
+        p   += len & ~(BLOCK_SIZE - 1);
+        len &= BLOCK_SIZE - 1;
     }
+    copy(block, p, len);
+    block_idx = len;
 }
 
 inline void Sha1::stop(byte *out)
@@ -68,6 +221,35 @@ inline void Sha1::stop(byte *out)
     zero(this, sizeof(*this));
 }
 
+/**
+ * @brief Save intermediate state, so that hashing can be resumed later
+ * with load_state(), possibly by another instance. Context is unchanged.
+ *
+ * @param out Output, at least SAVE_SIZE bytes
+ * @return Number of bytes written
+ */
+inline size_t Sha1::save_state(byte *out) const
+{
+    assert(out);
+    return impl::hash::md_save(impl::hash::state_id::sha1, length, state, STATE_SIZE, block, BLOCK_SIZE, out);
+}
+
+/**
+ * @brief Restore state saved by save_state().
+ *
+ * @param in Saved state
+ * @param len Length of saved state
+ * @return true on success, false if state is malformed or belongs to
+ * different algorithm, in which case context is unchanged
+ */
+inline bool Sha1::load_state(const byte *in, size_t len)
+{
+    if (!impl::hash::md_load(impl::hash::state_id::sha1, in, len, length, state, STATE_SIZE, block, BLOCK_SIZE))
+        return false;
+    block_idx = length % BLOCK_SIZE;
+    return true;
+}
+
 inline void Sha1::pad()
 {
     static constexpr size_t pad_start = BLOCK_SIZE - 8;
@@ -76,54 +258,30 @@ inline void Sha1::pad()
 
     if (block_idx > pad_start) {
         fill(block + block_idx, 0, BLOCK_SIZE - block_idx);
-        step();
+        compress(state, block, 1);
+        block_idx = 0;
     }
     fill(block + block_idx, 0, pad_start - block_idx);
-
-    for (size_t i = 0, j = 0; i < 4; ++i, j += 8) {
-        block[BLOCK_SIZE - 1 - i] = length_low  >> j;
-        block[BLOCK_SIZE - 5 - i] = length_high >> j;
-    }
-    step();
+    putbe(length << 3, block + pad_start);
+    compress(state, block, 1);
 }
 
-inline void Sha1::step()
+/**
+ * @brief Process consecutive full blocks directly from input. Uses SHA 
+ * extensions when CPU supports them, otherwise
+ * impl::sha1::compress_portable().
+ * 
+ * @param state Hash state
+ * @param in Input blocks
+ * @param nblocks Number of blocks
+ */
+inline void Sha1::compress(word *state, const byte *in, size_t nblocks)
 {
-    enum { a, b, c, d, e };
-
-    word w[80];
-    word var[STATE_SIZE];
-    
-    copy(var, state, sizeof(state));
-
-    for (size_t t = 0; t < 16; ++t) {
-        w[t]  = block[t * 4]     << 24;
-        w[t] |= block[t * 4 + 1] << 16;
-        w[t] |= block[t * 4 + 2] << 8;
-        w[t] |= block[t * 4 + 3];
-    }
-    for (size_t t = 16; t < 80; ++t)
-        w[t] = rol(w[t-3] ^ w[t-8] ^ w[t-14] ^ w[t-16], 1);
-
-#define SHA_1_ROUND(start, end, K, ...)                                 \
-    for (size_t t = start; t < end; ++t) {                              \
-        word tmp = rol(var[a], 5) + var[e] + w[t] + K + (__VA_ARGS__);  \
-        var[e] = var[d];                                                \
-        var[d] = var[c];                                                \
-        var[c] = rol(var[b], 30);                                       \
-        var[b] = var[a];                                                \
-        var[a] = tmp;                                                   \
-    }
-    SHA_1_ROUND(0,  20, 0x5a827999, ch(var[b], var[c], var[d]))
-    SHA_1_ROUND(20, 40, 0x6ed9eba1, parity(var[b], var[c], var[d]))
-    SHA_1_ROUND(40, 60, 0x8f1bbcdc, maj(var[b], var[c], var[d]))
-    SHA_1_ROUND(60, 80, 0xca62c1d6, parity(var[b], var[c], var[d]))
-#undef SHA_1_ROUND
-
-    for (size_t i = 0; i < STATE_SIZE; ++i)
-        state[i] += var[i];
-
-    block_idx = 0;
+#ifdef SHOC_X86
+    if (cpu_sha())
+        return impl::sha1::compress_shani(state, in, nblocks);
+#endif
+    impl::sha1::compress_portable(state, in, nblocks);
 }
 
 }
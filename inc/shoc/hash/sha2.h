@@ -2,8 +2,284 @@
 #define SHOC_HASH_SHA2_H
 
 #include "shoc/util.h"
+#include "shoc/cpu.h"
+#include <utility>
 
 namespace shoc {
+namespace impl::sha2 {
+
+inline constexpr uint32_t k256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+inline constexpr uint64_t k512[80] = {
+    0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc,
+    0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
+    0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
+    0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235, 0xc19bf174cf692694,
+    0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+    0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
+    0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4,
+    0xc6e00bf33da88fc2, 0xd5a79147930aa725, 0x06ca6351e003826f, 0x142929670a0e6e70,
+    0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
+    0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+    0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30,
+    0xd192e819d6ef5218, 0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
+    0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8,
+    0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3,
+    0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+    0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b,
+    0xca273eceea26619c, 0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178,
+    0x06f067aa72176fba, 0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
+    0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c,
+    0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817
+};
+
+constexpr uint32_t sigma_0(uint32_t x)  { return ror(x, 7)  ^ ror(x, 18) ^ (x >> 3);  }
+constexpr uint32_t sigma_1(uint32_t x)  { return ror(x, 17) ^ ror(x, 19) ^ (x >> 10); }
+constexpr uint64_t sigma_0(uint64_t x)  { return ror(x, 1)  ^ ror(x, 8)  ^ (x >> 7);  }
+constexpr uint64_t sigma_1(uint64_t x)  { return ror(x, 19) ^ ror(x, 61) ^ (x >> 6);  }
+constexpr uint32_t sum_0(uint32_t x)    { return ror(x, 2)  ^ ror(x, 13) ^ ror(x, 22); }
+constexpr uint32_t sum_1(uint32_t x)    { return ror(x, 6)  ^ ror(x, 11) ^ ror(x, 25); }
+constexpr uint64_t sum_0(uint64_t x)    { return ror(x, 28) ^ ror(x, 34) ^ ror(x, 39); }
+constexpr uint64_t sum_1(uint64_t x)    { return ror(x, 14) ^ ror(x, 18) ^ ror(x, 41); }
+
+/**
+ * @brief 16 consecutive rounds, one full turn of the circular schedule.
+ * Instead of shifting working variables, their roles rotate: variable "a"
+ * of round j lives in v[-j mod 8], so only "d" and "h" are written. With
+ * constant j all indices are known at compile time and v and w stay in
+ * registers. Since 16 is a multiple of 8, roles are back in place after
+ * every call.
+ *
+ * @tparam expand Whether to expand schedule, false for the first 16 rounds
+ * @tparam W Word type, uint32_t for SHA-224/256, uint64_t for the rest
+ * @param v Working variables
+ * @param w Message schedule, last 16 words
+ * @param k Round constants of these 16 rounds
+ */
+template<bool expand, class W, size_t... j>
+SHOC_ALWAYS_INLINE void rounds(W *v, W *w, const W *k, std::index_sequence<j...>)
+{
+    auto round = [&]<size_t i>(std::integral_constant<size_t, i>) SHOC_ALWAYS_INLINE_LAMBDA {
+        constexpr auto at = [](size_t n) { return (n + 8 - i % 8) % 8; };
+
+        if constexpr (expand)
+            w[i] += sigma_1(w[(i + 14) % 16]) + w[(i + 9) % 16] + sigma_0(w[(i + 1) % 16]);
+
+        W &a = v[at(0)], &b = v[at(1)], &c = v[at(2)], &d = v[at(3)];
+        W &e = v[at(4)], &f = v[at(5)], &g = v[at(6)], &h = v[at(7)];
+
+        W tmp = h + sum_1(e) + ch(e, f, g) + k[i] + w[i];
+        d += tmp;
+        h = tmp + sum_0(a) + maj(a, b, c);
+    };
+    (round(std::integral_constant<size_t, j>{}), ...);
+}
+
+/**
+ * @brief Portable SHA-2 compression, used when CPU has no SHA extensions
+ * or AVX2.
+ *
+ * @tparam W Word type, uint32_t for SHA-224/256, uint64_t for the rest
+ * @param state Hash state, 8 words
+ * @param in Input blocks
+ * @param nblocks Number of blocks
+ */
+template<class W>
+inline void compress_portable(W *state, const byte *in, size_t nblocks)
+{
+    constexpr size_t N_WORDS = sizeof(W) == 4 ? 64 : 80;
+    constexpr auto seq = std::make_index_sequence<16>{};
+
+    const W *k;
+    W v[8];
+    W w[16];
+
+    if constexpr (sizeof(W) == 4)
+        k = k256;
+    else
+        k = k512;
+
+    for (; nblocks--; in += 16 * sizeof(W)) {
+        for (size_t i = 0; i < 8; ++i)
+            v[i] = state[i];
+
+        for (size_t t = 0; t < 16; ++t)
+            w[t] = getbe<W>(in + t * sizeof(W));
+
+        rounds<false>(v, w, k, seq);
+        for (size_t t = 16; t < N_WORDS; t += 16)
+            rounds<true>(v, w, k + t, seq);
+
+        for (size_t i = 0; i < 8; ++i)
+            state[i] += v[i];
+    }
+}
+
+#ifdef SHOC_X86
+
+template<int N>
+SHOC_TARGET("avx2")
+inline __m256i ror64x4(__m256i x)
+{
+    return _mm256_or_si256(_mm256_srli_epi64(x, N), _mm256_slli_epi64(x, 64 - N));
+}
+
+SHOC_TARGET("avx2")
+inline __m256i sigma_0_512x4(__m256i x)
+{
+    return _mm256_xor_si256(_mm256_xor_si256(ror64x4<1>(x), ror64x4<8>(x)), _mm256_srli_epi64(x, 7));
+}
+
+SHOC_TARGET("avx2")
+inline __m256i sigma_1_512x4(__m256i x)
+{
+    return _mm256_xor_si256(_mm256_xor_si256(ror64x4<19>(x), ror64x4<61>(x)), _mm256_srli_epi64(x, 6));
+}
+
+/**
+ * @brief Next 4 words of SHA-384/512 message schedule. Vectors x[0..3]
+ * hold words t-16..t-1 and are shifted by one vector. Words t+2 and t+3
+ * depend on t and t+1 through sigma_1, so sigma_1 is applied in two halves.
+ *
+ * @param x Last 16 schedule words, 4 vectors
+ * @return Words t..t+3
+ */
+SHOC_TARGET("avx2")
+inline __m256i schedule512x4(__m256i *x)
+{
+    __m256i w15 = _mm256_alignr_epi8(_mm256_permute2x128_si256(x[0], x[1], 0x21), x[0], 8);
+    __m256i w7  = _mm256_alignr_epi8(_mm256_permute2x128_si256(x[2], x[3], 0x21), x[2], 8);
+    __m256i w2  = _mm256_permute4x64_epi64(x[3], 0x0e);
+    __m256i sum = _mm256_add_epi64(_mm256_add_epi64(x[0], w7), sigma_0_512x4(w15));
+    __m256i lo  = _mm256_add_epi64(sum, sigma_1_512x4(w2));
+    __m256i hi  = _mm256_add_epi64(sum, sigma_1_512x4(_mm256_permute4x64_epi64(lo, 0x44)));
+
+    x[0] = x[1];
+    x[1] = x[2];
+    x[2] = x[3];
+    x[3] = _mm256_blend_epi32(lo, hi, 0xf0);
+
+    return x[3];
+}
+
+/**
+ * @brief SHA-384/512 compression with AVX2 message schedule. Last 16 words
+ * of schedule stay in 4 vectors, each step expands 4 words and adds round
+ * constants, 16 rounds ahead of their use, so vector and scalar work
+ * overlap. Rounds are unrolled by 8 with state kept in local variables,
+ * renamed instead of shifted.
+ *
+ * @param state Hash state, 8 words
+ * @param in Input blocks
+ * @param nblocks Number of blocks
+ */
+SHOC_TARGET("avx2")
+inline void compress512_avx2(uint64_t *state, const byte *in, size_t nblocks)
+{
+    const __m256i bswap = _mm256_set_epi64x(
+        0x08090a0b0c0d0e0full, 0x0001020304050607ull,
+        0x08090a0b0c0d0e0full, 0x0001020304050607ull);
+
+    alignas(32) uint64_t wk[80];
+    __m256i x[4];
+
+    for (; nblocks--; in += 128) {
+        for (int i = 0; i < 4; ++i) {
+            x[i] = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 32)), bswap);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(wk + i * 4),
+                _mm256_add_epi64(x[i], _mm256_loadu_si256(reinterpret_cast<const __m256i*>(k512 + i * 4))));
+        }
+        uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+#define SHA_512_ROUND(a, b, c, d, e, f, g, h, t) {                                      \
+    uint64_t tmp = h + (ror(e, 14) ^ ror(e, 18) ^ ror(e, 41)) + ch(e, f, g) + wk[t];   \
+    d += tmp;                                                                           \
+    h = tmp + (ror(a, 28) ^ ror(a, 34) ^ ror(a, 39)) + maj(a, b, c); }
+
+        for (int t = 0; t < 80; t += 8) {
+            for (int i = t + 16; i < t + 24 && i < 80; i += 4) {
+                _mm256_store_si256(reinterpret_cast<__m256i*>(wk + i),
+                    _mm256_add_epi64(schedule512x4(x), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(k512 + i))));
+            }
+            SHA_512_ROUND(a, b, c, d, e, f, g, h, t + 0)
+            SHA_512_ROUND(h, a, b, c, d, e, f, g, t + 1)
+            SHA_512_ROUND(g, h, a, b, c, d, e, f, t + 2)
+            SHA_512_ROUND(f, g, h, a, b, c, d, e, t + 3)
+            SHA_512_ROUND(e, f, g, h, a, b, c, d, t + 4)
+            SHA_512_ROUND(d, e, f, g, h, a, b, c, t + 5)
+            SHA_512_ROUND(c, d, e, f, g, h, a, b, t + 6)
+            SHA_512_ROUND(b, c, d, e, f, g, h, a, t + 7)
+        }
+#undef SHA_512_ROUND
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+/**
+ * @brief SHA-224/256 compression with SHA extensions. State is kept as
+ * ABEF and CDGH register pairs across blocks, each SHA256RNDS2 performs
+ * two rounds, message schedule is expanded 4 words at a time with
+ * SHA256MSG1/MSG2.
+ *
+ * @param state Hash state, 8 words
+ * @param in Input blocks
+ * @param nblocks Number of blocks
+ */
+SHOC_TARGET("sha,ssse3,sse4.1")
+inline void compress_shani(uint32_t *state, const byte *in, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xb1);
+    __m128i st1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1b);
+    __m128i st0 = _mm_alignr_epi8(tmp, st1, 8);
+    st1 = _mm_blend_epi16(st1, tmp, 0xf0);
+
+    for (; nblocks--; in += 64) {
+        __m128i abef = st0;
+        __m128i cdgh = st1;
+        __m128i m[4];
+
+        for (int i = 0; i < 4; ++i)
+            m[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 16)), bswap);
+
+        for (int r = 0; r < 16; ++r) {
+            if (r >= 4) {
+                tmp = _mm_sha256msg1_epu32(m[r & 3], m[(r + 1) & 3]);
+                tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(m[(r + 3) & 3], m[(r + 2) & 3], 4));
+                m[r & 3] = _mm_sha256msg2_epu32(tmp, m[(r + 3) & 3]);
+            }
+            tmp = _mm_add_epi32(m[r & 3], _mm_loadu_si128(reinterpret_cast<const __m128i*>(k256 + r * 4)));
+            st1 = _mm_sha256rnds2_epu32(st1, st0, tmp);
+            st0 = _mm_sha256rnds2_epu32(st0, st1, _mm_shuffle_epi32(tmp, 0x0e));
+        }
+        st0 = _mm_add_epi32(st0, abef);
+        st1 = _mm_add_epi32(st1, cdgh);
+    }
+    tmp = _mm_shuffle_epi32(st0, 0x1b);
+    st1 = _mm_shuffle_epi32(st1, 0xb1);
+    st0 = _mm_blend_epi16(tmp, st1, 0xf0);
+    st1 = _mm_alignr_epi8(st1, tmp, 8);
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), st0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), st1);
+}
+
+#endif
+
+}
 
 constexpr int SHA2_WORD64_FLAG = 0x1000;
 
@@ -29,25 +305,27 @@ public:
     static constexpr size_t SIZE        = (T & ~SHA2_WORD64_FLAG) / 8;
     static constexpr size_t BLOCK_SIZE  = 16 * sizeof(word);
     static constexpr size_t STATE_SIZE  = 8;
+    static constexpr size_t SAVE_SIZE   = impl::hash::md_state_size<word>(STATE_SIZE, BLOCK_SIZE);
 public:
     void init();
     void feed(const void *in, size_t len);
     void stop(byte *out);
+    size_t save_state(byte *out) const;
+    bool load_state(const byte *in, size_t len);
+    Sha2 clone() const { return *this; }
+    static void compress(word *state, const byte *in, size_t nblocks);
 private:
-    void pad();
-    void step();
+    static constexpr auto STATE_ID =
+        T == SHA_224     ? impl::hash::state_id::sha224 :
+        T == SHA_256     ? impl::hash::state_id::sha256 :
+        T == SHA_384     ? impl::hash::state_id::sha384 :
+        T == SHA_512     ? impl::hash::state_id::sha512 :
+        T == SHA_512_224 ? impl::hash::state_id::sha512_224 :
+                           impl::hash::state_id::sha512_256;
 private:
-    constexpr uint32_t sigma_0(uint32_t x)   { return ror(x, 7)  ^ ror(x, 18) ^ (x >> 3);  }
-    constexpr uint32_t sigma_1(uint32_t x)   { return ror(x, 17) ^ ror(x, 19) ^ (x >> 10); }
-    constexpr uint64_t sigma_0(uint64_t x)   { return ror(x, 1)  ^ ror(x, 8)  ^ (x >> 7);  }
-    constexpr uint64_t sigma_1(uint64_t x)   { return ror(x, 19) ^ ror(x, 61) ^ (x >> 6);  }
-    constexpr uint32_t sum_0(uint32_t x)     { return ror(x, 2)  ^ ror(x, 13) ^ ror(x, 22); }
-    constexpr uint32_t sum_1(uint32_t x)     { return ror(x, 6)  ^ ror(x, 11) ^ ror(x, 25); }
-    constexpr uint64_t sum_0(uint64_t x)     { return ror(x, 28) ^ ror(x, 34) ^ ror(x, 39); }
-    constexpr uint64_t sum_1(uint64_t x)     { return ror(x, 14) ^ ror(x, 18) ^ ror(x, 41); }
+    void pad();
 private:
-    word length_low;
-    word length_high;
+    uint64_t length;
     word state[STATE_SIZE];
     byte block[BLOCK_SIZE];
     byte block_idx;
@@ -75,7 +353,8 @@ void Sha2<T>::init()
         case SHA_512_256:   INIT_HASH(0x22312194FC2BF72Cu, 0x9F555FA3C84C64C2u, 0x2393B86B6F53B151u, 0x963877195940EABDu, 
                                       0x96283EE2A88EFFE3u, 0xBE5E1E2553863992u, 0x2B0199FC2C85B8AAu, 0x0EB72DDC81C52CA2u) break;
     }
-    block_idx = length_high = length_low = 0;
+    length = 0;
+    block_idx = 0;
 #undef INIT_HASH
 }
 
@@ -86,15 +365,26 @@ void Sha2<T>::feed(const void *in, size_t len)
 
     auto p = static_cast<const byte*>(in);
 
-    while (len--) {
+    length += len;
 
-        block[block_idx++] = *p++;
-
-        if ((length_low += 8) == 0)
-            length_high += 1;
-        if (block_idx == BLOCK_SIZE)
-            step();
+    if (block_idx) {
+        size_t n = BLOCK_SIZE - block_idx < len ? BLOCK_SIZE - block_idx : len;
+        copy(block + block_idx, p, n);
+        block_idx += n;
+        p   += n;
+        len -= n;
+        if (block_idx < BLOCK_SIZE)
+            return;
+        compress(state, block, 1);
+        block_idx = 0;
+    }
+    if (len >= BLOCK_SIZE) {
+        compress(state, p, len / BLOCK_SIZE);
+        p   += len & ~(BLOCK_SIZE - 1);
+        len &= BLOCK_SIZE - 1;
     }
+    copy(block, p, len);
+    block_idx = len;
 }
 
 template<Sha2Type T>
@@ -109,6 +399,37 @@ void Sha2<T>::stop(byte *out)
     zero(this, sizeof(*this));
 }
 
+/**
+ * @brief Save intermediate state, so that hashing can be resumed later
+ * with load_state(), possibly by another instance. Context is unchanged.
+ *
+ * @param out Output, at least SAVE_SIZE bytes
+ * @return Number of bytes written
+ */
+template<Sha2Type T>
+size_t Sha2<T>::save_state(byte *out) const
+{
+    assert(out);
+    return impl::hash::md_save(STATE_ID, length, state, STATE_SIZE, block, BLOCK_SIZE, out);
+}
+
+/**
+ * @brief Restore state saved by save_state().
+ *
+ * @param in Saved state
+ * @param len Length of saved state
+ * @return true on success, false if state is malformed or belongs to
+ * different algorithm, in which case context is unchanged
+ */
+template<Sha2Type T>
+bool Sha2<T>::load_state(const byte *in, size_t len)
+{
+    if (!impl::hash::md_load(STATE_ID, in, len, length, state, STATE_SIZE, block, BLOCK_SIZE))
+        return false;
+    block_idx = length % BLOCK_SIZE;
+    return true;
+}
+
 template<Sha2Type T>
 void Sha2<T>::pad()
 {
@@ -118,106 +439,39 @@ void Sha2<T>::pad()
 
     if (block_idx > pad_start) {
         fill(block + block_idx, 0, BLOCK_SIZE - block_idx);
-        step();
+        compress(state, block, 1);
+        block_idx = 0;
     }
     fill(block + block_idx, 0, pad_start - block_idx);
 
-    for (size_t i = 0, j = 0; i < sizeof(word); ++i, j += 8) {
-        block[BLOCK_SIZE - 1 - i]               = length_low  >> j;
-        block[BLOCK_SIZE - 1 - i - sizeof(word)]   = length_high >> j;
-    }
-    step();
+    if constexpr (sizeof(word) == 8)
+        putbe(length >> 61, block + pad_start);
+    putbe(length << 3, block + BLOCK_SIZE - 8);
+    compress(state, block, 1);
 }
 
+/**
+ * @brief Process consecutive full blocks directly from input. SHA-224/256
+ * use SHA extensions and 64-bit variants use AVX2 when CPU supports them,
+ * otherwise impl::sha2::compress_portable() is used.
+ * 
+ * @param state Hash state
+ * @param in Input blocks
+ * @param nblocks Number of blocks
+ */
 template<Sha2Type T>
-void Sha2<T>::step()
+void Sha2<T>::compress(word *state, const byte *in, size_t nblocks)
 {
-    enum { a, b, c, d, e, f, g, h };
-
-    constexpr size_t N_WORDS = (T == SHA_224 || T == SHA_256) ? 64 : 80;
-
-    word w[N_WORDS];
-    word var[STATE_SIZE];
-    
-    for (size_t i = 0; i < STATE_SIZE; ++i) 
-        var[i] = state[i];
-
+#ifdef SHOC_X86
     if constexpr (sizeof(word) == 4) {
-        for (size_t t = 0; t < 16; ++t) {
-            w[t]  = block[t * 4]     << 24;
-            w[t] |= block[t * 4 + 1] << 16;
-            w[t] |= block[t * 4 + 2] << 8;
-            w[t] |= block[t * 4 + 3];
-        }
-    } else {
-        for (size_t t = 0; t < 16; ++t) {
-            w[t]  = word(block[t * 8])     << 56;
-            w[t] |= word(block[t * 8 + 1]) << 48;
-            w[t] |= word(block[t * 8 + 2]) << 40;
-            w[t] |= word(block[t * 8 + 3]) << 32;
-            w[t] |= word(block[t * 8 + 4]) << 24;
-            w[t] |= word(block[t * 8 + 5]) << 16;
-            w[t] |= word(block[t * 8 + 6]) << 8;
-            w[t] |= word(block[t * 8 + 7]);
-        }
-    }
-
-#define SHA_2_ROUND(...) {                                                              \
-    static constexpr uint64_t K[] = {__VA_ARGS__};                                      \
-    for (size_t t = 16; t < N_WORDS; ++t)                                               \
-        w[t] = sigma_1(w[t-2]) + w[t-7] + sigma_0(w[t-15]) + w[t-16];                   \
-    for (size_t t = 0; t < N_WORDS; ++t) {                                              \
-        word tmp1 = var[h] + sum_1(var[e]) + ch(var[e], var[f], var[g]) + K[t] + w[t];  \
-        word tmp2 = sum_0(var[a]) + maj(var[a], var[b], var[c]);                        \
-        var[h] = var[g];                                                                \
-        var[g] = var[f];                                                                \
-        var[f] = var[e];                                                                \
-        var[e] = var[d] + tmp1;                                                         \
-        var[d] = var[c];                                                                \
-        var[c] = var[b];                                                                \
-        var[b] = var[a];                                                                \
-        var[a] = tmp1 + tmp2;                                                           \
-    }}
-
-    if constexpr (T == SHA_224 || T == SHA_256) {
-        SHA_2_ROUND(    
-        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 
-        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2)
+        if (cpu_sha())
+            return impl::sha2::compress_shani(state, in, nblocks);
     } else {
-        SHA_2_ROUND(
-        0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc, 
-        0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118, 
-        0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2, 
-        0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235, 0xc19bf174cf692694,
-        0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
-        0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
-        0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4,
-        0xc6e00bf33da88fc2, 0xd5a79147930aa725, 0x06ca6351e003826f, 0x142929670a0e6e70,
-        0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
-        0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
-        0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30,
-        0xd192e819d6ef5218, 0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
-        0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8,
-        0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3,
-        0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
-        0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b,
-        0xca273eceea26619c, 0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178,
-        0x06f067aa72176fba, 0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
-        0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c,
-        0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817)
+        if (cpu_avx2())
+            return impl::sha2::compress512_avx2(state, in, nblocks);
     }
-#undef SHA_2_ROUND
-
-    for (size_t i = 0; i < STATE_SIZE; ++i)
-        state[i] += var[i];
-
-    block_idx = 0;
+#endif
+    impl::sha2::compress_portable(state, in, nblocks);
 }
 
 }
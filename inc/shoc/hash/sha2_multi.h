@@ -0,0 +1,335 @@
+#ifndef SHOC_HASH_SHA2_MULTI_H
+#define SHOC_HASH_SHA2_MULTI_H
+
+#include "shoc/hash/sha2.h"
+#include <array>
+
+namespace shoc {
+
+/**
+ * @brief SHA-256 digest of a single message, used by multi-buffer API.
+ *
+ */
+using sha256_digest = std::array<byte, Sha2<SHA_256>::SIZE>;
+
+namespace impl::sha2 {
+
+/**
+ * @brief Initial SHA-256 state, same as in Sha2<SHA_256>::init().
+ *
+ */
+inline constexpr uint32_t h256[8] = {
+    0x6a09e667u, 0xbb67ae85u, 0x3c6ef372u, 0xa54ff53au,
+    0x510e527fu, 0x9b05688cu, 0x1f83d9abu, 0x5be0cd19u,
+};
+
+/**
+ * @brief Multi-buffer kernel: compress one block in each of L lanes.
+ * State is transposed, i.e. word j of lane i is state[j * L + i].
+ *
+ */
+using multi_kernel = void (*)(uint32_t *state, const byte *const *blocks);
+
+#ifdef SHOC_X86
+
+/**
+ * @brief Load 32 bytes from each of 8 lanes at given offset and transpose
+ * them, so that out[j] holds big endian word j of every lane.
+ *
+ * @param blocks Block pointers, 8 lanes
+ * @param off Offset in bytes
+ * @param out 8 vectors, output
+ */
+SHOC_TARGET("avx2")
+inline void load_transpose8(const byte *const *blocks, size_t off, __m256i *out)
+{
+    const __m256i bswap = _mm256_set_epi64x(
+        0x0c0d0e0f08090a0bull, 0x0405060700010203ull,
+        0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+    __m256i r[8];
+    __m256i t[8];
+
+    for (int i = 0; i < 8; ++i)
+        r[i] = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks[i] + off)), bswap);
+
+    for (int i = 0; i < 8; i += 2) {
+        t[i + 0] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4) {
+        r[i + 0] = _mm256_unpacklo_epi64(t[i + 0], t[i + 2]);
+        r[i + 1] = _mm256_unpackhi_epi64(t[i + 0], t[i + 2]);
+        r[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        r[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int i = 0; i < 4; ++i) {
+        out[i + 0] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x20);
+        out[i + 4] = _mm256_permute2x128_si256(r[i], r[i + 4], 0x31);
+    }
+}
+
+template<int N>
+SHOC_TARGET("avx2")
+inline __m256i ror8(__m256i x)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N));
+}
+
+/**
+ * @brief SHA-256 compression of one block in each of 8 lanes with AVX2.
+ *
+ * @param state Transposed state, 8 words by 8 lanes
+ * @param blocks Block pointers, 8 lanes
+ */
+SHOC_TARGET("avx2")
+inline void multi_avx2(uint32_t *state, const byte *const *blocks)
+{
+    __m256i w[16];
+    __m256i s[8];
+    __m256i v[8];
+
+    load_transpose8(blocks, 0, w);
+    load_transpose8(blocks, 32, w + 8);
+
+    for (int j = 0; j < 8; ++j)
+        v[j] = s[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + j * 8));
+
+#pragma GCC unroll 64
+    for (int t = 0; t < 64; ++t) {
+        if (t >= 16) {
+            __m256i w2  = w[(t - 2) & 15];
+            __m256i w15 = w[(t - 15) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ror8<7>(w15), ror8<18>(w15)), _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ror8<17>(w2), ror8<19>(w2)), _mm256_srli_epi32(w2, 10));
+            w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+        }
+        __m256i e = v[4];
+        __m256i a = v[0];
+        __m256i sum1 = _mm256_xor_si256(_mm256_xor_si256(ror8<6>(e), ror8<11>(e)), ror8<25>(e));
+        __m256i sum0 = _mm256_xor_si256(_mm256_xor_si256(ror8<2>(a), ror8<13>(a)), ror8<22>(a));
+        __m256i ch   = _mm256_xor_si256(_mm256_and_si256(e, v[5]), _mm256_andnot_si256(e, v[6]));
+        __m256i maj  = _mm256_or_si256(_mm256_and_si256(a, v[1]), _mm256_and_si256(v[2], _mm256_or_si256(a, v[1])));
+        __m256i kw   = _mm256_add_epi32(w[t & 15], _mm256_set1_epi32(k256[t]));
+        __m256i t1   = _mm256_add_epi32(_mm256_add_epi32(v[7], sum1), _mm256_add_epi32(ch, kw));
+        __m256i t2   = _mm256_add_epi32(sum0, maj);
+
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = _mm256_add_epi32(v[3], t1);
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = _mm256_add_epi32(t1, t2);
+    }
+    for (int j = 0; j < 8; ++j)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(state + j * 8), _mm256_add_epi32(s[j], v[j]));
+}
+
+// GCC 12 reports _mm512_undefined_epi32() inside unmasked AVX-512 intrinsics
+// as uninitialized use.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+/**
+ * @brief SHA-256 compression of one block in each of 16 lanes with
+ * AVX-512, rotations and Boolean functions map to single instructions.
+ *
+ * @param state Transposed state, 8 words by 16 lanes
+ * @param blocks Block pointers, 16 lanes
+ */
+SHOC_TARGET("avx2,avx512f")
+inline void multi_avx512(uint32_t *state, const byte *const *blocks)
+{
+    __m512i w[16];
+    __m512i s[8];
+    __m512i v[8];
+    __m256i lo[16];
+    __m256i hi[16];
+
+    load_transpose8(blocks, 0, lo);
+    load_transpose8(blocks, 32, lo + 8);
+    load_transpose8(blocks + 8, 0, hi);
+    load_transpose8(blocks + 8, 32, hi + 8);
+
+    for (int t = 0; t < 16; ++t)
+        w[t] = _mm512_inserti64x4(_mm512_castsi256_si512(lo[t]), hi[t], 1);
+
+    for (int j = 0; j < 8; ++j)
+        v[j] = s[j] = _mm512_loadu_si512(state + j * 16);
+
+#pragma GCC unroll 64
+    for (int t = 0; t < 64; ++t) {
+        if (t >= 16) {
+            __m512i w2  = w[(t - 2) & 15];
+            __m512i w15 = w[(t - 15) & 15];
+            __m512i s0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(w15, 7), _mm512_ror_epi32(w15, 18), _mm512_srli_epi32(w15, 3), 0x96);
+            __m512i s1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(w2, 17), _mm512_ror_epi32(w2, 19), _mm512_srli_epi32(w2, 10), 0x96);
+            w[t & 15] = _mm512_add_epi32(_mm512_add_epi32(w[t & 15], s0), _mm512_add_epi32(w[(t - 7) & 15], s1));
+        }
+        __m512i e = v[4];
+        __m512i a = v[0];
+        __m512i sum1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(e, 6), _mm512_ror_epi32(e, 11), _mm512_ror_epi32(e, 25), 0x96);
+        __m512i sum0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(a, 2), _mm512_ror_epi32(a, 13), _mm512_ror_epi32(a, 22), 0x96);
+        __m512i ch   = _mm512_ternarylogic_epi32(e, v[5], v[6], 0xca);
+        __m512i maj  = _mm512_ternarylogic_epi32(a, v[1], v[2], 0xe8);
+        __m512i kw   = _mm512_add_epi32(w[t & 15], _mm512_set1_epi32(k256[t]));
+        __m512i t1   = _mm512_add_epi32(_mm512_add_epi32(v[7], sum1), _mm512_add_epi32(ch, kw));
+        __m512i t2   = _mm512_add_epi32(sum0, maj);
+
+        v[7] = v[6];
+        v[6] = v[5];
+        v[5] = v[4];
+        v[4] = _mm512_add_epi32(v[3], t1);
+        v[3] = v[2];
+        v[2] = v[1];
+        v[1] = v[0];
+        v[0] = _mm512_add_epi32(t1, t2);
+    }
+    for (int j = 0; j < 8; ++j)
+        _mm512_storeu_si512(state + j * 16, _mm512_add_epi32(s[j], v[j]));
+}
+
+#pragma GCC diagnostic pop
+
+#endif
+
+/**
+ * @brief Job scheduler over L lanes. Each lane walks full blocks of its
+ * message directly from input and then 1 or 2 padded tail blocks. When a
+ * lane finishes, its digest is written out and the lane is refilled with
+ * the next message, so unequal lengths don't stall other lanes. Once the
+ * queue is empty and few lanes remain, they are finished with single-buffer
+ * compression instead of running mostly idle vectors.
+ *
+ * @tparam L Number of lanes
+ * @param msgs Messages
+ * @param out Digests, same count as messages
+ * @param kernel Multi-buffer compression kernel
+ */
+template<size_t L>
+inline void multi_run(std::span<const span_i<>> msgs, std::span<sha256_digest> out, multi_kernel kernel)
+{
+    struct job {
+        const byte *p;
+        size_t full;
+        size_t tails;
+        size_t tail_idx;
+        size_t msg;
+        byte tail[128];
+    };
+    static constexpr byte idle[64] = {};
+    static constexpr size_t drain = L / 4;
+
+    alignas(64) uint32_t state[8 * L];
+    const byte *blocks[L];
+    job jobs[L];
+    bool act[L] = {};
+    size_t active = 0;
+    size_t next = 0;
+
+    auto load = [&](size_t i) {
+        if (next == msgs.size())
+            return false;
+        auto &j = jobs[i];
+        auto m = msgs[next];
+        size_t rem = m.size() % 64;
+
+        j.p         = m.data();
+        j.full      = m.size() / 64;
+        j.tails     = rem + 9 > 64 ? 2 : 1;
+        j.tail_idx  = 0;
+        j.msg       = next++;
+
+        fill(j.tail, 0, sizeof(j.tail));
+        copy(j.tail, j.p + j.full * 64, rem);
+        j.tail[rem] = 0x80;
+        putbe(uint64_t(m.size()) << 3, j.tail + j.tails * 64 - 8);
+
+        for (size_t w = 0; w < 8; ++w)
+            state[w * L + i] = h256[w];
+        return true;
+    };
+    auto stop = [&](size_t i, const uint32_t *s, size_t stride) {
+        for (size_t w = 0; w < 8; ++w)
+            putbe(s[w * stride], out[jobs[i].msg].data() + w * 4);
+    };
+
+    for (size_t i = 0; i < L; ++i)
+        active += act[i] = load(i);
+
+    while (active > drain) {
+        for (size_t i = 0; i < L; ++i) {
+            if (!act[i])
+                blocks[i] = idle;
+            else if (jobs[i].full)
+                blocks[i] = jobs[i].p;
+            else
+                blocks[i] = jobs[i].tail + jobs[i].tail_idx * 64;
+        }
+        kernel(state, blocks);
+
+        for (size_t i = 0; i < L; ++i) {
+            if (!act[i])
+                continue;
+            auto &j = jobs[i];
+            if (j.full) {
+                j.p += 64;
+                j.full--;
+                continue;
+            }
+            if (++j.tail_idx < j.tails)
+                continue;
+            stop(i, state + i, L);
+            if (!load(i)) {
+                act[i] = false;
+                active--;
+            }
+        }
+    }
+    for (size_t i = 0; i < L; ++i) {
+        if (!act[i])
+            continue;
+        auto &j = jobs[i];
+        uint32_t s[8];
+        for (size_t w = 0; w < 8; ++w)
+            s[w] = state[w * L + i];
+        Sha2<SHA_256>::compress(s, j.p, j.full);
+        Sha2<SHA_256>::compress(s, j.tail + j.tail_idx * 64, j.tails - j.tail_idx);
+        stop(i, s, 1);
+    }
+    zero(state, sizeof(state));
+    zero(jobs, sizeof(jobs));
+}
+
+}
+
+/**
+ * @brief Compute SHA-256 of many independent messages at once. On CPUs
+ * with AVX-512 messages are hashed 16 at a time in SIMD lanes. With AVX2
+ * they are hashed 8 at a time unless SHA extensions are available, which
+ * are faster one by one than 8 AVX2 lanes.
+ *
+ * @param msgs Messages, may be of different lengths
+ * @param out Digests, at least as many as messages
+ */
+inline void sha256_multi(std::span<const span_i<>> msgs, std::span<sha256_digest> out)
+{
+    assert(out.size() >= msgs.size());
+
+#ifdef SHOC_X86
+    if (cpu_avx512())
+        return impl::sha2::multi_run<16>(msgs, out, impl::sha2::multi_avx512);
+    if (cpu_avx2() && !cpu_sha())
+        return impl::sha2::multi_run<8>(msgs, out, impl::sha2::multi_avx2);
+#endif
+    Sha2<SHA_256> hash;
+
+    for (size_t i = 0; i < msgs.size(); ++i)
+        hash(msgs[i].data(), msgs[i].size(), out[i].data());
+}
+
+}
+
+#endif
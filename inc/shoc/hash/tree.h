@@ -0,0 +1,323 @@
+#ifndef SHOC_HASH_TREE_H
+#define SHOC_HASH_TREE_H
+
+#include "shoc/hash/sha2_multi.h"
+#include "shoc/parallel.h"
+#include <vector>
+
+namespace shoc {
+
+/**
+ * @brief Default leaf size of SHA-256 tree hash, with it tree hash is
+ * the same as AWS Glacier tree hash.
+ *
+ */
+inline constexpr size_t TREE_LEAF_SIZE = 1 << 20;
+
+namespace impl::tree {
+
+/**
+ * @brief Leaves hashed per scheduling unit in parallel tree hashing.
+ *
+ */
+inline constexpr size_t leaf_grain = 4;
+
+/**
+ * @brief Interior nodes hashed per scheduling unit.
+ *
+ */
+inline constexpr size_t node_grain = 4096;
+
+/**
+ * @brief Interior node: SHA-256 of concatenated children.
+ *
+ * @param l Left child
+ * @param r Right child
+ * @param out Parent, may alias any of children
+ */
+inline void node(const sha256_digest &l, const sha256_digest &r, sha256_digest &out)
+{
+    Sha2<SHA_256> h;
+    h.init();
+    h.feed(l.data(), l.size());
+    h.feed(r.data(), r.size());
+    h.stop(out.data());
+}
+
+/**
+ * @brief Number of leaves for input of given length. Empty input still
+ * has one, empty leaf.
+ *
+ */
+constexpr size_t leaves(size_t len, size_t leaf_size)
+{
+    return len ? (len + leaf_size - 1) / leaf_size : 1;
+}
+
+/**
+ * @brief Hash leaves of contiguous input in parallel.
+ *
+ * @param in Input
+ * @param len Length of input
+ * @param leaf_size Leaf size
+ * @param out Leaf digests, leaves(len, leaf_size) of them
+ * @param threads Maximum number of threads, 0 means default_threads()
+ */
+inline void hash_leaves(const byte *in, size_t len, size_t leaf_size, sha256_digest *out, size_t threads)
+{
+    parallel_for_steal(leaves(len, leaf_size), threads, leaf_grain, [&](size_t begin, size_t end) {
+        Sha2<SHA_256> h;
+        for (size_t i = begin; i < end; ++i) {
+            size_t off = i * leaf_size;
+            h(in + off, std::min(leaf_size, len - off), out[i].data());
+        }
+    });
+}
+
+/**
+ * @brief Fold one tree level into the next one: pairs are combined, odd
+ * last node is carried up unchanged.
+ *
+ * @param lvl Nodes
+ * @param up Parents, (n + 1) / 2 of them, must not overlap nodes
+ * @param n Number of nodes
+ * @param threads Maximum number of threads, 0 means default_threads()
+ * @return Number of parents
+ */
+inline size_t fold(const sha256_digest *lvl, sha256_digest *up, size_t n, size_t threads)
+{
+    parallel_for(n / 2, threads, node_grain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            node(lvl[2 * i], lvl[2 * i + 1], up[i]);
+    });
+    if (n & 1)
+        up[n / 2] = lvl[n - 1];
+    return (n + 1) / 2;
+}
+
+}
+
+/**
+ * @brief SHA-256 tree with stored levels. Input is split into leaves of
+ * fixed size, the last one may be shorter, each leaf is hashed with
+ * SHA-256 and pairs of nodes are hashed together level by level, odd
+ * last node of a level is carried up as is. With 1 MiB leaves root
+ * equals AWS Glacier tree hash.
+ *
+ * Tree can be built in parallel from input in memory, or streamed with
+ * init/feed/stop, hashing every leaf as soon as its data arrives. Stored
+ * levels allow checking or replacing a single leaf with O(log n) node
+ * hashes, without rehashing the rest of input.
+ *
+ */
+struct sha256_tree {
+    void init(size_t leaf_size = TREE_LEAF_SIZE);
+    void feed(const void *in, size_t len);
+    void stop(byte *out);
+    void build(const void *in, size_t len, byte *out, size_t leaf_size = TREE_LEAF_SIZE, size_t threads = 0);
+
+    bool verify(size_t leaf, const void *in, size_t len) const;
+    bool update(size_t leaf, const void *in, size_t len);
+
+    const sha256_digest& root() const               { return levels.back().front(); }
+    const std::vector<sha256_digest>& leaves() const { return levels.front(); }
+    size_t leaf_size() const                        { return leaf_len; }
+    size_t size() const                             { return total; }
+private:
+    void grow();
+    size_t expected(size_t leaf) const;
+private:
+    std::vector<std::vector<sha256_digest>> levels;
+    Sha2<SHA_256> hash;
+    size_t leaf_len;
+    size_t leaf_idx;
+    size_t total;
+};
+
+/**
+ * @brief Start streaming tree over new input.
+ *
+ * @param leaf_size Leaf size, non-zero
+ */
+inline void sha256_tree::init(size_t leaf_size)
+{
+    assert(leaf_size);
+
+    levels.assign(1, {});
+    hash.init();
+    leaf_len = leaf_size;
+    leaf_idx = 0;
+    total = 0;
+}
+
+/**
+ * @brief Feed data, digest of every completed leaf is appended to leaves()
+ * right away.
+ *
+ * @param in Data
+ * @param len Length of data
+ */
+inline void sha256_tree::feed(const void *in, size_t len)
+{
+    assert(in || !len);
+
+    auto p = static_cast<const byte*>(in);
+
+    total += len;
+
+    while (len) {
+        size_t n = std::min(len, leaf_len - leaf_idx);
+
+        hash.feed(p, n);
+        leaf_idx += n;
+        p   += n;
+        len -= n;
+
+        if (leaf_idx == leaf_len) {
+            hash.stop(levels[0].emplace_back().data());
+            hash.init();
+            leaf_idx = 0;
+        }
+    }
+}
+
+/**
+ * @brief Finish last leaf, build interior levels and output root. Tree
+ * stays valid for verify() and update().
+ *
+ * @param out Root, 32 bytes
+ */
+inline void sha256_tree::stop(byte *out)
+{
+    assert(out);
+
+    if (leaf_idx || levels[0].empty())
+        hash.stop(levels[0].emplace_back().data());
+
+    grow();
+    copy(out, root().data(), root().size());
+}
+
+/**
+ * @brief Build whole tree from input in memory, leaves are hashed in
+ * parallel with work stealing.
+ *
+ * @param in Input
+ * @param len Length of input
+ * @param out Root, 32 bytes
+ * @param leaf_size Leaf size, non-zero
+ * @param threads Maximum number of threads, 0 means default_threads()
+ */
+inline void sha256_tree::build(const void *in, size_t len, byte *out, size_t leaf_size, size_t threads)
+{
+    assert(in || !len);
+    assert(out);
+
+    init(leaf_size);
+    levels[0].resize(impl::tree::leaves(len, leaf_size));
+    impl::tree::hash_leaves(static_cast<const byte*>(in), len, leaf_size, levels[0].data(), threads);
+    total = len;
+
+    grow();
+    copy(out, root().data(), root().size());
+}
+
+/**
+ * @brief Check data of a single leaf against the tree.
+ *
+ * @param leaf Leaf index
+ * @param in Leaf data, i.e. bytes [leaf * leaf_size(), ...) of input
+ * @param len Length of leaf data, must match original length
+ * @return true if data hashes to stored leaf digest
+ */
+inline bool sha256_tree::verify(size_t leaf, const void *in, size_t len) const
+{
+    if (leaf >= leaves().size() || len != expected(leaf))
+        return false;
+
+    sha256_digest d;
+    Sha2<SHA_256>{}(in, len, d.data());
+
+    return d == leaves()[leaf];
+}
+
+/**
+ * @brief Replace data of a single leaf and recompute path from it to root,
+ * other leaves are not touched.
+ *
+ * @param leaf Leaf index
+ * @param in New leaf data
+ * @param len Length of new leaf data, must match original length
+ * @return true on success, false if leaf or length is out of range
+ */
+inline bool sha256_tree::update(size_t leaf, const void *in, size_t len)
+{
+    if (leaf >= leaves().size() || len != expected(leaf))
+        return false;
+
+    Sha2<SHA_256>{}(in, len, levels[0][leaf].data());
+
+    for (size_t l = 1, i = leaf / 2; l < levels.size(); ++l, i /= 2) {
+        auto &lvl = levels[l - 1];
+        if (2 * i + 1 < lvl.size())
+            impl::tree::node(lvl[2 * i], lvl[2 * i + 1], levels[l][i]);
+        else
+            levels[l][i] = lvl[2 * i];
+    }
+    return true;
+}
+
+/**
+ * @brief Build interior levels from leaves.
+ *
+ */
+inline void sha256_tree::grow()
+{
+    levels.resize(1);
+
+    while (levels.back().size() > 1) {
+        auto &lvl = levels.back();
+        std::vector<sha256_digest> up((lvl.size() + 1) / 2);
+        impl::tree::fold(lvl.data(), up.data(), lvl.size(), 0);
+        levels.push_back(std::move(up));
+    }
+}
+
+/**
+ * @brief Original length of given leaf.
+ *
+ */
+inline size_t sha256_tree::expected(size_t leaf) const
+{
+    return leaf + 1 < leaves().size() ? leaf_len : total - leaf * leaf_len;
+}
+
+/**
+ * @brief Compute SHA-256 tree hash of input in memory without keeping the
+ * tree: leaves are hashed in parallel with work stealing, then levels are
+ * folded between two buffers.
+ *
+ * @param in Input
+ * @param len Length of input
+ * @param out Root, 32 bytes
+ * @param leaf_size Leaf size, non-zero
+ * @param threads Maximum number of threads, 0 means default_threads()
+ */
+inline void sha256_tree_hash(const void *in, size_t len, byte *out, size_t leaf_size = TREE_LEAF_SIZE, size_t threads = 0)
+{
+    assert(in || !len);
+    assert(out && leaf_size);
+
+    std::vector<sha256_digest> lvl(impl::tree::leaves(len, leaf_size));
+    std::vector<sha256_digest> up((lvl.size() + 1) / 2);
+    impl::tree::hash_leaves(static_cast<const byte*>(in), len, leaf_size, lvl.data(), threads);
+
+    for (size_t n = lvl.size(); n > 1; std::swap(lvl, up))
+        n = impl::tree::fold(lvl.data(), up.data(), n, threads);
+
+    copy(out, lvl[0].data(), lvl[0].size());
+}
+
+}
+
+#endif
@@ -5,17 +5,37 @@
 
 namespace shoc {
 
+/**
+ * @brief Raw CBC-MAC update, which carries position within block between calls, 
+ * so data may be fed in fragments of any size. Block is encrypted as soon as 
+ * it's complete. Full blocks are XOR-ed in words.
+ * 
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param buf CBC-MAC state
+ * @param aad Input data
+ * @param aad_len Input length
+ * @param pos Position within block
+ * @return New position within block
+ */
 template<class E>
 inline size_t cbc_mac(E &ciph, byte *buf, const byte *aad, size_t aad_len, size_t pos)
 {
     auto end = aad + aad_len;
 
-    while (aad != end) {
+    while (aad != end && pos) {
         buf[pos] ^= *aad++;
         if (pos == 15)
-            ciph.encrypt(buf, buf);
+            ciph.encrypt(span_i<16>{buf, 16}, span_o<16>{buf, 16});
         pos = (pos + 1) & 0xf;
     }
+    for (; end - aad >= 16; aad += 16) {
+        xorb(buf, aad);
+        ciph.encrypt(span_i<16>{buf, 16}, span_o<16>{buf, 16});
+    }
+    while (aad != end)
+        buf[pos++] ^= *aad++;
+
     return pos;
 }
 
@@ -25,10 +45,10 @@ inline void cbc_mac_padded(E &ciph, byte *buf, const byte *aad, size_t aad_len,
     if (size_t i = cbc_mac(ciph, buf, aad, aad_len, start)) {
         for (; i < 16; ++i)
             buf[i] ^= 0;
-        ciph.encrypt(buf, buf);
+        ciph.encrypt(span_i<16>{buf, 16}, span_o<16>{buf, 16});
     }
 }
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,202 @@
+#ifndef SHOC_MAC_CMAC_H
+#define SHOC_MAC_CMAC_H
+
+#include "shoc/mac/cbc_mac.h"
+#include "shoc/mode/ecb.h"
+
+namespace shoc {
+
+/**
+ * @brief Cipher-based MAC (RFC 4493) context. Subkeys K1 and K2 are derived 
+ * once in init(...), so any number of messages can be authenticated under 
+ * the same key without key setup. Message is fed with update(...) in chunks 
+ * of any size on top of cbc_mac(...), the last block is held back until 
+ * finish(...) to apply the subkey.
+ * 
+ * @tparam E Block cipher
+ */
+template<class E>
+class cmac_context {
+    static constexpr size_t B = 8; // Messages per batch
+public:
+    static constexpr size_t tag_size = 16;
+public:
+    cmac_context() = default;
+    cmac_context(span_i<E::key_size> key) { init(key); }
+    ~cmac_context() { deinit(); }
+public:
+    void init(span_i<E::key_size> key);
+    void deinit();
+    void reset();
+    void update(const void *msg, size_t len);
+    void finish(byte *out);
+    void batch(std::span<const span_i<>> msgs, span_o<> out);
+private:
+    E ciph;
+    byte k1[16] = {};
+    byte k2[16] = {};
+    byte mac[16] = {};
+    size_t pos = 0;
+};
+
+template<class E>
+void cmac_context<E>::init(span_i<E::key_size> key)
+{
+    ciph.init(key);
+
+    zero(k1, 16);
+    ciph.encrypt(k1, k1);
+    dbl(k1);
+    copy(k2, k1, 16);
+    dbl(k2);
+
+    reset();
+}
+
+template<class E>
+void cmac_context<E>::deinit()
+{
+    ciph.deinit();
+    zero(k1, sizeof(k1));
+    zero(k2, sizeof(k2));
+    reset();
+}
+
+/**
+ * @brief Start new message under the same key.
+ * 
+ */
+template<class E>
+void cmac_context<E>::reset()
+{
+    zero(mac, sizeof(mac));
+    pos = 0;
+}
+
+/**
+ * @brief Feed next chunk of message.
+ * 
+ * @param msg Message chunk
+ * @param len Chunk length
+ */
+template<class E>
+void cmac_context<E>::update(const void *msg, size_t len)
+{
+    if (!len)
+        return;
+
+    auto p = static_cast<const byte*>(msg);
+
+    if (pos == 16) {
+        ciph.encrypt(mac, mac);
+        pos = 0;
+    }
+    // Keep at least one byte, so that complete last block isn't encrypted yet
+
+    pos = cbc_mac(ciph, mac, p, len - 1, pos);
+    mac[pos++] ^= p[len - 1];
+}
+
+/**
+ * @brief Output tag and start new message under the same key.
+ * 
+ * @param out Output tag, 16 bytes
+ */
+template<class E>
+void cmac_context<E>::finish(byte *out)
+{
+    if (pos == 16) {
+        xorb(mac, k1);
+    } else {
+        mac[pos] ^= 0x80;
+        xorb(mac, k2);
+    }
+    ciph.encrypt(span_i<16>{mac, 16}, span_o<16>{out, 16});
+    reset();
+}
+
+/**
+ * @brief Compute tags of many independent messages at once. Up to 8 messages 
+ * are processed in lockstep, so their block cipher chains are interleaved and 
+ * passed to ecb_process(...) as a single batch. A lane is refilled with the 
+ * next message as soon as the previous one finishes, so messages of unequal 
+ * lengths don't stall each other. Doesn't affect message fed with update(...).
+ * 
+ * @param msgs Messages
+ * @param out Output tags, 16 bytes per message
+ */
+template<class E>
+void cmac_context<E>::batch(std::span<const span_i<>> msgs, span_o<> out)
+{
+    assert(out.size() >= msgs.size() * 16);
+
+    byte st[B * 16];
+    size_t idx[B];
+    size_t off[B];
+    bool fin[B];
+    size_t next = 0;
+    size_t n = 0;
+
+    for (;;) {
+        for (; n < B && next < msgs.size(); ++n, ++next) {
+            idx[n] = next;
+            off[n] = 0;
+            zero(st + n * 16, 16);
+        }
+        if (!n)
+            break;
+
+        for (size_t k = 0; k < n; ++k) {
+            auto s = st + k * 16;
+            auto m = msgs[idx[k]];
+            auto rem = m.size() - off[k];
+
+            if ((fin[k] = rem <= 16)) {
+                xorb(s, m.data() + off[k], rem);
+                if (rem == 16) {
+                    xorb(s, k1);
+                } else {
+                    s[rem] ^= 0x80;
+                    xorb(s, k2);
+                }
+            } else {
+                xorb(s, m.data() + off[k]);
+                off[k] += 16;
+            }
+        }
+        ecb_process<direction::encrypt>(ciph, span_i<>{st, n * 16}, span_o<>{st, n * 16});
+
+        for (size_t k = n; k--;) {
+            if (!fin[k])
+                continue;
+            copy(out.data() + idx[k] * 16, st + k * 16, 16);
+            if (k != --n) {
+                copy(st + k * 16, st + n * 16, 16);
+                idx[k] = idx[n];
+                off[k] = off[n];
+            }
+        }
+    }
+    zero(st, sizeof(st));
+}
+
+/**
+ * @brief Compute cipher-based MAC (RFC 4493) of a message.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param msg Message
+ * @param len Message length
+ * @param out Output tag, 16 bytes
+ */
+template<class E>
+inline void cmac(span_i<E::key_size> key, const void *msg, size_t len, byte *out)
+{
+    cmac_context<E> ctx {key};
+    ctx.update(msg, len);
+    ctx.finish(out);
+}
+
+}
+
+#endif
@@ -21,7 +21,7 @@ namespace shoc {
  */
 template<class E>
 inline bool gmac(
-    const byte *key,
+    span_i<E::key_size> key,
     const byte *iv,  size_t iv_len,
     const byte *aad, size_t aad_len,
           byte *tag, size_t tag_len)
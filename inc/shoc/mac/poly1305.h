@@ -0,0 +1,213 @@
+#ifndef SHOC_MAC_POLY1305_H
+#define SHOC_MAC_POLY1305_H
+
+#include "shoc/util.h"
+
+namespace shoc {
+namespace impl::poly1305 {
+
+__extension__ using u128 = unsigned __int128;
+
+inline constexpr uint64_t mask44 = 0xfffffffffff;
+inline constexpr uint64_t mask42 = 0x3ffffffffff;
+
+constexpr uint64_t getle64(const byte *in)
+{
+    uint64_t x = 0;
+    for (int i = 7; i >= 0; --i)
+        x = x << 8 | in[i];
+    return x;
+}
+
+}
+
+/**
+ * @brief Poly1305 one-time authenticator (RFC 8439). Accumulator and key
+ * are held in three 44/44/42-bit limbs in 64-bit words, products are
+ * accumulated in unsigned __int128. Key MUST NOT be reused for another message.
+ *
+ */
+class poly1305_context {
+public:
+    static constexpr size_t key_size    = 32;
+    static constexpr size_t block_size  = 16;
+    static constexpr size_t tag_size    = 16;
+public:
+    poly1305_context() = default;
+    poly1305_context(span_i<key_size> key) { init(key); }
+    ~poly1305_context() { deinit(); }
+public:
+    void init(span_i<key_size> key);
+    void deinit();
+    void update(const void *msg, size_t len);
+    void finish(byte *out);
+private:
+    void blocks(const byte *in, size_t len, uint64_t hibit);
+private:
+    uint64_t r[3] = {};
+    uint64_t h[3] = {};
+    uint64_t pad[2] = {};
+    byte block[block_size] = {};
+    size_t block_idx = 0;
+};
+
+inline void poly1305_context::init(span_i<key_size> key)
+{
+    using namespace impl::poly1305;
+
+    auto t0 = getle64(key.data());
+    auto t1 = getle64(key.data() + 8);
+
+    r[0] = t0 & 0xffc0fffffff;
+    r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+    r[2] = (t1 >> 24) & 0x00ffffffc0f;
+    h[0] = h[1] = h[2] = 0;
+    pad[0] = getle64(key.data() + 16);
+    pad[1] = getle64(key.data() + 24);
+    block_idx = 0;
+}
+
+inline void poly1305_context::deinit()
+{
+    zero(r, sizeof(r));
+    zero(h, sizeof(h));
+    zero(pad, sizeof(pad));
+    zero(block, sizeof(block));
+    block_idx = 0;
+}
+
+/**
+ * @brief Feed next chunk of message. Full blocks are processed directly
+ * from input, only the tail is buffered.
+ *
+ * @param msg Message chunk
+ * @param len Chunk length
+ */
+inline void poly1305_context::update(const void *msg, size_t len)
+{
+    auto p = static_cast<const byte*>(msg);
+
+    if (block_idx) {
+        size_t n = block_size - block_idx < len ? block_size - block_idx : len;
+        copy(block + block_idx, p, n);
+        block_idx += n;
+        p   += n;
+        len -= n;
+        if (block_idx < block_size)
+            return;
+        blocks(block, block_size, uint64_t(1) << 40);
+        block_idx = 0;
+    }
+    size_t full = len & ~size_t(block_size - 1);
+
+    blocks(p, full, uint64_t(1) << 40);
+
+    if (len -= full) {
+        copy(block, p + full, len);
+        block_idx = len;
+    }
+}
+
+/**
+ * @brief Output tag. Context MUST be initialized again before next message.
+ *
+ * @param out Output tag, 16 bytes
+ */
+inline void poly1305_context::finish(byte *out)
+{
+    using namespace impl::poly1305;
+
+    if (block_idx) {
+        block[block_idx++] = 1;
+        zero(block + block_idx, block_size - block_idx);
+        blocks(block, block_size, 0);
+    }
+    auto h0 = h[0];
+    auto h1 = h[1];
+    auto h2 = h[2];
+    uint64_t c;
+
+    // Fully carry h
+    c = h1 >> 44; h1 &= mask44; h2 += c;
+    c = h2 >> 42; h2 &= mask42; h0 += c * 5;
+    c = h0 >> 44; h0 &= mask44; h1 += c;
+    c = h1 >> 44; h1 &= mask44; h2 += c;
+    c = h2 >> 42; h2 &= mask42; h0 += c * 5;
+    c = h0 >> 44; h0 &= mask44; h1 += c;
+
+    // Compute h - p and select it in constant time if h >= p
+    auto g0 = h0 + 5; c = g0 >> 44; g0 &= mask44;
+    auto g1 = h1 + c; c = g1 >> 44; g1 &= mask44;
+    auto g2 = h2 + c - (uint64_t(1) << 42);
+
+    c = (g2 >> 63) - 1;
+    h0 = (h0 & ~c) | (g0 & c);
+    h1 = (h1 & ~c) | (g1 & c);
+    h2 = (h2 & ~c) | (g2 & c);
+
+    // h = (h + pad) mod 2^128
+    h0 += pad[0] & mask44; c = h0 >> 44; h0 &= mask44;
+    h1 += (((pad[0] >> 44) | (pad[1] << 20)) & mask44) + c; c = h1 >> 44; h1 &= mask44;
+    h2 += ((pad[1] >> 24) & mask42) + c; h2 &= mask42;
+
+    putle(h0 | (h1 << 44), out);
+    putle((h1 >> 20) | (h2 << 24), out + 8);
+
+    deinit();
+}
+
+inline void poly1305_context::blocks(const byte *in, size_t len, uint64_t hibit)
+{
+    using namespace impl::poly1305;
+
+    const auto r0 = r[0];
+    const auto r1 = r[1];
+    const auto r2 = r[2];
+    const auto s1 = r1 * (5 << 2);
+    const auto s2 = r2 * (5 << 2);
+    auto h0 = h[0];
+    auto h1 = h[1];
+    auto h2 = h[2];
+
+    for (; len >= block_size; in += block_size, len -= block_size) {
+        auto t0 = getle64(in);
+        auto t1 = getle64(in + 8);
+
+        h0 += t0 & mask44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & mask44;
+        h2 += (((t1 >> 24)) & mask42) | hibit;
+
+        u128 d0 = u128(h0) * r0 + u128(h1) * s2 + u128(h2) * s1;
+        u128 d1 = u128(h0) * r1 + u128(h1) * r0 + u128(h2) * s2;
+        u128 d2 = u128(h0) * r2 + u128(h1) * r1 + u128(h2) * r0;
+        uint64_t c;
+
+        c = uint64_t(d0 >> 44); h0 = uint64_t(d0) & mask44; d1 += c;
+        c = uint64_t(d1 >> 44); h1 = uint64_t(d1) & mask44; d2 += c;
+        c = uint64_t(d2 >> 42); h2 = uint64_t(d2) & mask42;
+        h0 += c * 5; c = h0 >> 44; h0 &= mask44;
+        h1 += c;
+    }
+    h[0] = h0;
+    h[1] = h1;
+    h[2] = h2;
+}
+
+/**
+ * @brief Compute Poly1305 (RFC 8439) tag of a message with one-time key.
+ *
+ * @param key One-time key
+ * @param msg Message
+ * @param len Message length
+ * @param out Output tag, 16 bytes
+ */
+inline void poly1305(span_i<32> key, const void *msg, size_t len, byte *out)
+{
+    poly1305_context ctx {key};
+    ctx.update(msg, len);
+    ctx.finish(out);
+}
+
+}
+
+#endif
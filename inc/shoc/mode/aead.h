@@ -0,0 +1,67 @@
+#ifndef SHOC_MODE_AEAD_H
+#define SHOC_MODE_AEAD_H
+
+#include "shoc/mode/gcm.h"
+#include "shoc/mode/ccm.h"
+#include "shoc/mode/chacha20_poly1305.h"
+
+namespace shoc {
+namespace impl::aead {
+
+/**
+ * @brief Uniform start/finish/verify over AEAD contexts with 12-byte nonce
+ * and 16-byte tag, used by record layer and segmented stream. Start returns
+ * false if the context rejects the message, e.g. text is longer than
+ * max_msg_len of the context.
+ *
+ */
+template<class E>
+inline bool start(gcm_context<E> &ctx, const byte *nonce, size_t, size_t len, direction dir)
+{
+    if (len > ctx.max_msg_len)
+        return false;
+    ctx.start(nonce, 12, dir);
+    return true;
+}
+
+template<class E, size_t L>
+inline bool start(ccm_context<E, L> &ctx, const byte *nonce, size_t aad_len, size_t len, direction dir)
+{
+    static_assert(L == 3, "Nonce is 12 bytes, so CCM counter MUST be 3 bytes");
+    return ctx.start(nonce, aad_len, len, 16, dir);
+}
+
+inline bool start(chacha20_poly1305_context &ctx, const byte *nonce, size_t, size_t len, direction dir)
+{
+    if (len > ctx.max_msg_len)
+        return false;
+    ctx.start(nonce, dir);
+    return true;
+}
+
+template<class E>
+inline void finish(gcm_context<E> &ctx, byte *tag)                  { ctx.finish(tag, 16); }
+template<class E, size_t L>
+inline void finish(ccm_context<E, L> &ctx, byte *tag)               { ctx.finish(tag); }
+inline void finish(chacha20_poly1305_context &ctx, byte *tag)       { ctx.finish(tag); }
+
+template<class E>
+inline bool verify(gcm_context<E> &ctx, const byte *tag)            { return ctx.verify(tag, 16); }
+template<class E, size_t L>
+inline bool verify(ccm_context<E, L> &ctx, const byte *tag)         { return ctx.verify(tag); }
+inline bool verify(chacha20_poly1305_context &ctx, const byte *tag) { return ctx.verify(tag); }
+
+/**
+ * @brief Identifier of AEAD construction, stored in serialized headers.
+ *
+ */
+template<class A>   inline constexpr byte kind = 0;
+template<class E>   inline constexpr byte kind<gcm_context<E>> = 1;
+template<class E, size_t L>
+                    inline constexpr byte kind<ccm_context<E, L>> = 2;
+template<>          inline constexpr byte kind<chacha20_poly1305_context> = 3;
+
+}
+}
+
+#endif
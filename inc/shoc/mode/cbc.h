@@ -5,6 +5,51 @@
 
 namespace shoc {
 
+/**
+ * @brief Encrypt full blocks in cipher block chaining mode. Input and 
+ * output may be the same array. All pointers MUST be valid.
+ * 
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param reg Chaining register, initially IV, receives last ciphertext block
+ * @param in Plain text
+ * @param out Cipher text
+ * @param blocks Number of 16-byte blocks
+ */
+template<class E>
+inline void cbc_encrypt_blocks(E &ciph, byte *reg, const byte *in, byte *out, size_t blocks)
+{
+    for (; blocks; --blocks, in += 16, out += 16) {
+        xorb(reg, in);
+        ciph.encrypt(span_i<16>{reg, 16}, span_o<16>{reg, 16});
+        copy(out, reg, 16);
+    }
+}
+
+/**
+ * @brief Decrypt full blocks in cipher block chaining mode. Input and 
+ * output may be the same array. All pointers MUST be valid.
+ * 
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param reg Chaining register, initially IV, receives last ciphertext block
+ * @param in Cipher text
+ * @param out Plain text
+ * @param blocks Number of 16-byte blocks
+ */
+template<class E>
+inline void cbc_decrypt_blocks(E &ciph, byte *reg, const byte *in, byte *out, size_t blocks)
+{
+    byte tmp[16];
+
+    for (; blocks; --blocks, in += 16, out += 16) {
+        copy(tmp, in, 16);
+        ciph.decrypt(tmp, span_o<16>{out, 16});
+        xorb(out, reg);
+        copy(reg, tmp, 16);
+    }
+}
+
 /**
  * @brief Encrypt with block cipher in cipher block chaining mode.
  * All pointers MUST be valid and length is multiple of 16.
@@ -17,19 +62,14 @@ namespace shoc {
  * @param len Text length, multiple of 16
  */
 template<class E>
-inline void cbc_encrypt(const byte *key, const byte *iv, const byte *in, byte *out, size_t len)
+inline void cbc_encrypt(span_i<E::key_size> key, const byte *iv, const byte *in, byte *out, size_t len)
 {
     E ciph {key};
 
-    auto end = out + len;
     byte buf[16];
-	copy(buf, iv, 16);
-    
-    for (; out < end; out += 16, in += 16) {
-        xorb(buf, in);
-        ciph.encrypt(buf, buf);
-        copy(out, buf, 16);
-    }
+    copy(buf, iv, 16);
+
+    cbc_encrypt_blocks(ciph, buf, in, out, len >> 4);
 }
 
 /**
@@ -44,23 +84,176 @@ inline void cbc_encrypt(const byte *key, const byte *iv, const byte *in, byte *o
  * @param len Text length, multiple of 16
  */
 template<class E>
-inline void cbc_decrypt(const byte *key, const byte *iv, const byte *in, byte *out, size_t len)
+inline void cbc_decrypt(span_i<E::key_size> key, const byte *iv, const byte *in, byte *out, size_t len)
+{
+    E ciph {key};
+
+    byte buf[16];
+    copy(buf, iv, 16);
+
+    cbc_decrypt_blocks(ciph, buf, in, out, len >> 4);
+}
+
+/**
+ * @brief Encrypt chain of segments in-place with block cipher in cipher block 
+ * chaining mode. Blocks may straddle segment boundaries, such block is gathered 
+ * into a temporary one and scattered back, the rest is processed directly.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param iv Initial vector
+ * @param data Segments of text, total length multiple of 16
+ * @return true on success, false if total length is invalid
+ */
+template<class E>
+inline bool cbc_encrypt(span_i<E::key_size> key, const byte *iv, std::span<const span_o<>> data)
+{
+    if (iov_size(data) & 0xf)
+        return false;
+
+    E ciph {key};
+
+    byte buf[16];
+    copy(buf, iv, 16);
+
+    return iov_blocks<16>(data, [&](byte *p, size_t n) {
+        cbc_encrypt_blocks(ciph, buf, p, p, n);
+    });
+}
+
+/**
+ * @brief Decrypt chain of segments in-place with block cipher in cipher block 
+ * chaining mode. Blocks may straddle segment boundaries, such block is gathered 
+ * into a temporary one and scattered back, the rest is processed directly.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param iv Initial vector
+ * @param data Segments of text, total length multiple of 16
+ * @return true on success, false if total length is invalid
+ */
+template<class E>
+inline bool cbc_decrypt(span_i<E::key_size> key, const byte *iv, std::span<const span_o<>> data)
 {
+    if (iov_size(data) & 0xf)
+        return false;
+
     E ciph {key};
 
-    auto end = out + len;
-    byte xor_buf[16];
-    byte tmp_buf[16];
-	copy(xor_buf, iv, 16);
+    byte buf[16];
+    copy(buf, iv, 16);
+
+    return iov_blocks<16>(data, [&](byte *p, size_t n) {
+        cbc_decrypt_blocks(ciph, buf, p, p, n);
+    });
+}
+
+/**
+ * @brief Streaming cipher block chaining mode. Holds expanded key, chaining 
+ * register and a partial block, so data may be fed in chunks of any size. 
+ * Output is produced only for complete blocks, thus it lags behind input by 
+ * up to 15 bytes. Result is identical to cbc_encrypt(...) and cbc_decrypt(...) 
+ * for any chunking.
+ * 
+ * @tparam E Block cipher
+ */
+template<class E>
+class cbc_context {
+public:
+    cbc_context() = default;
+    cbc_context(span_i<E::key_size> key, const byte *iv, direction dir = direction::encrypt) { init(key, iv, dir); }
+    ~cbc_context() { deinit(); }
+public:
+    void init(span_i<E::key_size> key, const byte *iv, direction dir = direction::encrypt);
+    void deinit();
+    size_t update(const byte *in, byte *out, size_t len);
+    bool finish();
+private:
+    void process(const byte *in, byte *out, size_t blocks);
+private:
+    E ciph;
+    byte reg[16] = {};
+    byte buf[16] = {};
+    size_t idx = 0;
+    direction dir = direction::encrypt;
+};
+
+template<class E>
+void cbc_context<E>::init(span_i<E::key_size> key, const byte *iv, direction dir)
+{
+    ciph.init(key);
+    copy(reg, iv, 16);
+    this->idx = 0;
+    this->dir = dir;
+}
+
+template<class E>
+void cbc_context<E>::deinit()
+{
+    ciph.deinit();
+    zero(reg, sizeof(reg));
+    zero(buf, sizeof(buf));
+    idx = 0;
+}
+
+/**
+ * @brief Process next chunk of data. Output MUST have room for len + 15 bytes. 
+ * Input and output may be the same array only when no partial block is 
+ * pending, i.e. when all previous chunks were multiple of 16.
+ * 
+ * @param in Input data
+ * @param out Output data
+ * @param len Input length
+ * @return Number of bytes written to output, multiple of 16
+ */
+template<class E>
+size_t cbc_context<E>::update(const byte *in, byte *out, size_t len)
+{
+    size_t done = 0;
 
-    for (; out < end; out += 16, in += 16) {
-        copy(tmp_buf, in, 16);
-        ciph.decrypt(in, out);
-        xorb(out, xor_buf);
-        copy(xor_buf, tmp_buf, 16);
+    if (idx) {
+        size_t n = 16 - idx < len ? 16 - idx : len;
+        copy(buf + idx, in, n);
+        idx += n;
+        in  += n;
+        len -= n;
+        if (idx < 16)
+            return 0;
+        process(buf, out, 1);
+        idx = 0;
+        done = 16;
     }
+    process(in, out + done, len >> 4);
+    done += len & ~size_t(0xf);
+
+    if ((idx = len & 0xf))
+        copy(buf, in + len - idx, idx);
+
+    return done;
+}
+
+/**
+ * @brief Finish processing and wipe the context.
+ * 
+ * @return true on success, false if total length wasn't multiple of 16
+ */
+template<class E>
+bool cbc_context<E>::finish()
+{
+    bool ok = idx == 0;
+    deinit();
+    return ok;
+}
+
+template<class E>
+void cbc_context<E>::process(const byte *in, byte *out, size_t blocks)
+{
+    if (dir == direction::encrypt)
+        cbc_encrypt_blocks(ciph, reg, in, out, blocks);
+    else
+        cbc_decrypt_blocks(ciph, reg, in, out, blocks);
 }
 
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -2,125 +2,177 @@
 #define SHOC_MODE_CCM_H
 
 #include "shoc/mac/cbc_mac.h"
-#include "shoc/mode/ctr.h"
+#include "shoc/mode/ecb.h"
 
 namespace shoc {
 
 /**
- * @brief Basic counter mode function, has small differences from ctrf(...) 
- * and used specifically in CCM.
+ * @brief Maximum text length for counter size L. Length field of B0 is L
+ * bytes, so text MUST be shorter than 2^(8L), which also keeps the block
+ * counter from carrying into the nonce.
+ * 
+ * @tparam L Counter size
+ */
+template<size_t L>
+inline constexpr uint64_t ccm_max_len = L < 8 ? (uint64_t(1) << 8 * L) - 1 : UINT64_MAX;
+
+/**
+ * @brief Prepare CCM state: format initial block B0 and counter block A0, then 
+ * encrypt both together to get first CBC-MAC value and tag keystream S0. Used 
+ * internally in CCM encrypt/decrypt process.
  * 
  * @tparam E Block cipher
  * @tparam L Counter size
  * @param ciph Cipher object, must be already initialized
- * @param a_0 Initial block
- * @param nonce Nonce
- * @param in Data input
- * @param out Data output
- * @param len Data length
+ * @param nonce Nonce, MUST be of length 15 - L
+ * @param aad_len Additional authenticated data length
+ * @param len Text length
+ * @param tag_len Tag length
+ * @param mac Output CBC-MAC state
+ * @param ctr Output counter block A0
+ * @param s0 Output tag keystream
  */
 template<class E, size_t L>
-inline void ccm_ctr(E &ciph, byte *a_0, const byte *nonce, const byte *in, byte *out, size_t len)
+inline void ccm_init(E &ciph, const byte *nonce, size_t aad_len, size_t len, size_t tag_len, byte *mac, byte *ctr, byte *s0)
 {
     static_assert(L > 1 && L < 9, "invalid length field size");
 
     constexpr size_t N = 15 - L;    // Nonce length
-    constexpr size_t L_IDX = N + 1; // Start of length field 
+    constexpr size_t L_IDX = N + 1; // Start of length field
 
-    a_0[0] = L - 1;
-    copy(&a_0[1], nonce, N);
-    fill(&a_0[L_IDX], 0, L);
+    byte buf[32]; // [B0 | A0]
 
-    byte buf[16];
-    byte a_i[16];
-    copy(a_i, a_0, 16);
+    buf[0] =    (aad_len ? 0x40 : 0x00)     | 
+                (((tag_len - 2) / 2) << 3)  |
+                (L - 1);
+    copy(&buf[1], nonce, N);
 
-    for (size_t i = 0; i < len; ++i) {
-        size_t idx = i & 0xf;
-        if (idx == 0) {
-            incc<L>(a_i);
-            ciph.encrypt(a_i, buf);
-        }
-        *out++ = buf[idx] ^ *in++;
+    for (size_t i = L_IDX, j = L - 1; i < 16; ++i)
+        buf[i] = uint64_t(len) >> (8 * j--);
+
+    buf[16] = L - 1;
+    copy(&buf[17], nonce, N);
+    fill(&buf[16 + L_IDX], 0, L);
+    copy(ctr, &buf[16], 16);
+
+    ecb_encrypt(ciph, span_i<>{buf}, span_o<>{buf});
+
+    copy(mac, buf, 16);
+    copy(s0, buf + 16, 16);
+    zero(buf, sizeof(buf));
+}
+
+/**
+ * @brief Apply encoded length of additional authenticated data to CBC-MAC 
+ * state. Used internally in CCM encrypt/decrypt process.
+ * 
+ * @param mac CBC-MAC state
+ * @param aad_len Additional authenticated data length, MUST NOT be 0
+ * @return Position in block, where additional authenticated data starts
+ */
+inline size_t ccm_aad_header(byte *mac, size_t aad_len)
+{
+    uint64_t a = aad_len;
+
+    if (a < 65536 - 256) {
+        mac[0] ^= a >> 8;
+        mac[1] ^= a;
+        return 2;
+    } 
+    if (a < 4294967296) {
+        mac[0] ^= 0xff;
+        mac[1] ^= 0xfe;
+        mac[2] ^= a >> 24;
+        mac[3] ^= a >> 16;
+        mac[4] ^= a >> 8;
+        mac[5] ^= a;
+        return 6;
     }
-    fill(a_0 + L_IDX, 0, L);
-    ciph.encrypt(a_0, a_0);
+    mac[0] ^= 0xff;
+    mac[1] ^= 0xff;
+    mac[2] ^= a >> 56;
+    mac[3] ^= a >> 48;
+    mac[4] ^= a >> 40;
+    mac[5] ^= a >> 32;
+    mac[6] ^= a >> 24;
+    mac[7] ^= a >> 16;
+    mac[8] ^= a >> 8;
+    mac[9] ^= a;
+    return 10;
 }
 
 /**
- * @brief CCM authentication function. Used internally in CCM encrypt/decrypt process.
+ * @brief Fused CCM engine, encrypts or decrypts text and authenticates plain 
+ * text in one pass over memory. On every 16-byte step CBC-MAC block and CTR 
+ * keystream block are independent, so both are issued together as a 2-block 
+ * batch to ecb_encrypt(...). When decrypting, plain text isn't known before 
+ * keystream, so MAC of the previous block is paired with keystream of the 
+ * current one. Only the last block may be partial, it's zero-padded for MAC. 
+ * Input and output may be the same array.
  * 
- * @tparam E Block cipher 
+ * @tparam D Direction
+ * @tparam E Block cipher
  * @tparam L Counter size
- * @param ciph  Cipher object, must be already initialized
- * @param block Initial block
- * @param nonce Nonce
+ * @param ciph Cipher object, must be already initialized
+ * @param mac CBC-MAC state
+ * @param ctr Counter block, incremented before every block
  * @param in Input data
- * @param len Input length
- * @param aad Additional authenticated data
- * @param aad_len Additional authenticated data length
- * @param tag_len Tag length, used to construct initial block
+ * @param out Output data
+ * @param len Data length
  */
-template<class E, size_t L>
-inline void ccm_auth(E &ciph, byte *block, const byte *nonce, const byte *in, size_t len, const byte *aad, size_t aad_len, size_t tag_len)
+template<direction D, class E, size_t L>
+inline void ccm_crypt(E &ciph, byte *mac, byte *ctr, const byte *in, byte *out, size_t len)
 {
-    static_assert(L > 1 && L < 9, "invalid length field size");
-
-    constexpr size_t N = 15 - L; // Nonce length
-
-    block[0] =  (aad_len ? 0x40 : 0x00)     | 
-                (((tag_len - 2) / 2) << 3)  |
-                (L - 1);
+    byte buf[32]; // [CBC-MAC block | keystream block]
 
-    copy(&block[1], nonce, N);
+    if constexpr (D == direction::encrypt) {
+        while (len) {
+            size_t n = len < 16 ? len : 16;
+            copy(buf, mac, 16);
+            xorb(buf, in, n);
+            incc<L>(ctr);
+            copy(buf + 16, ctr, 16);
+            ecb_encrypt(ciph, span_i<>{buf}, span_o<>{buf});
+            copy(mac, buf, 16);
+            xorb(out, in, buf + 16, n);
+            in  += n;
+            out += n;
+            len -= n;
+        }
+    } else {
+        size_t prev = 0; // Length of plain text block, which is not yet authenticated
 
-    for (size_t 
-            i = N + 1, // Start of length field
-            j = L - 1; 
-        i < 16; ++i) 
-    {
-        block[i] = len >> (8 * j--);
-    }
-    ciph.encrypt(block, block);
-
-    if (aad_len) {
-        size_t start;
-        if (aad_len < 65536 - 256) {
-            block[0] ^= aad_len >> 8;
-            block[1] ^= aad_len;
-            start = 2;
-        } else if (aad_len < 4294967296) {
-            block[0] ^= 0xff;
-            block[1] ^= 0xfe;
-            block[2] ^= aad_len >> 24;
-            block[3] ^= aad_len >> 16;
-            block[4] ^= aad_len >> 8;
-            block[5] ^= aad_len;
-            start = 6;
-        } else {
-            block[0] ^= 0xff;
-            block[1] ^= 0xff;
-            block[2] ^= aad_len >> 56;
-            block[3] ^= aad_len >> 48;
-            block[4] ^= aad_len >> 40;
-            block[5] ^= aad_len >> 32;
-            block[6] ^= aad_len >> 24;
-            block[7] ^= aad_len >> 16;
-            block[8] ^= aad_len >> 8;
-            block[9] ^= aad_len;
-            start = 10;
+        while (len) {
+            size_t n = len < 16 ? len : 16;
+            incc<L>(ctr);
+            copy(buf + 16, ctr, 16);
+            if (prev) {
+                copy(buf, mac, 16);
+                xorb(buf, out - prev, prev);
+                ecb_encrypt(ciph, span_i<>{buf}, span_o<>{buf});
+                copy(mac, buf, 16);
+            } else {
+                ecb_encrypt(ciph, span_i<>{buf + 16, 16}, span_o<>{buf + 16, 16});
+            }
+            xorb(out, in, buf + 16, n);
+            prev = n;
+            in  += n;
+            out += n;
+            len -= n;
+        }
+        if (prev) {
+            xorb(mac, out - prev, prev);
+            ciph.encrypt(span_i<16>{mac, 16}, span_o<16>{mac, 16});
         }
-        cbc_mac_padded(ciph, block, aad, aad_len, start);
     }
-
-    if (len) 
-        cbc_mac_padded(ciph, block, in, len, 0);
+    zero(buf, sizeof(buf));
 }
 
 /**
  * @brief Encrypt with block cipher in counter with CBC-MAC mode. 
- * Number of counter-bytes is configurable. All pointers MUST be valid, 
- * except when relevant length is 0.
+ * Number of counter-bytes is configurable. Text is processed in a single 
+ * pass by ccm_crypt(...). All pointers MUST be valid, except when relevant 
+ * length is 0.
  * 
  * @tparam E Block cipher
  * @tparam L Counter size, default is 2
@@ -133,11 +185,11 @@ inline void ccm_auth(E &ciph, byte *block, const byte *nonce, const byte *in, si
  * @param in Plain text
  * @param out Cipher txt
  * @param len Text length
- * @return true on success, false if tag length is invalid
+ * @return true on success, false if tag length is invalid or text is too long
  */
 template<class E, size_t L = 2>
 inline bool ccm_encrypt(
-    const byte *key, 
+    span_i<E::key_size> key,
     const byte *nonce,
     const byte *aad, size_t aad_len,
           byte *tag, size_t tag_len,
@@ -146,25 +198,30 @@ inline bool ccm_encrypt(
 {
     if (tag_len > 16 || 
         tag_len < 4  || 
-        tag_len & 1)
+        tag_len & 1  ||
+        len > ccm_max_len<L>)
         return false;
 
     E ciph {key};
 
-    byte block[16];
+    byte mac[16];
+    byte ctr[16];
+    byte s0[16];
 
-    ccm_auth<E, L>(ciph, block, nonce, in, len, aad, aad_len, tag_len);
-    copy(tag, block, tag_len);
-    ccm_ctr<E, L>(ciph, block, nonce, in, out, len);
-    xorb(tag, block, tag_len);
+    ccm_init<E, L>(ciph, nonce, aad_len, len, tag_len, mac, ctr, s0);
+    if (aad_len)
+        cbc_mac_padded(ciph, mac, aad, aad_len, ccm_aad_header(mac, aad_len));
+    ccm_crypt<direction::encrypt, E, L>(ciph, mac, ctr, in, out, len);
+    xorb(tag, mac, s0, tag_len);
 
     return true;
 }
 
 /**
  * @brief Decrypt with block cipher in counter with CBC-MAC mode. 
- * Number of counter-bytes is configurable. All pointers MUST be valid, 
- * except when relevant length is 0.
+ * Number of counter-bytes is configurable. Text is processed in a single 
+ * pass by ccm_crypt(...). All pointers MUST be valid, except when relevant 
+ * length is 0.
  * 
  * @tparam E Block cipher
  * @tparam L Counter size, default is 2
@@ -177,11 +234,11 @@ inline bool ccm_encrypt(
  * @param in Cipher text
  * @param out Plain txt
  * @param len Text length
- * @return true on success, false if tag length is invalid or authentication failed
+ * @return true on success, false if tag length is invalid, text is too long or authentication failed
  */
 template<class E, size_t L = 2>
 inline bool ccm_decrypt(
-    const byte *key, 
+    span_i<E::key_size> key,
     const byte *nonce,
     const byte *aad, size_t aad_len,
     const byte *tag, size_t tag_len,
@@ -190,23 +247,316 @@ inline bool ccm_decrypt(
 {
     if (tag_len > 16 || 
         tag_len < 4  || 
-        tag_len & 1)
+        tag_len & 1  ||
+        len > ccm_max_len<L>)
         return false;
 
     E ciph {key};
 
-    byte block[16];
     byte mac[16];
+    byte ctr[16];
+    byte s0[16];
 
-    ccm_ctr<E, L>(ciph, block, nonce, in, out, len);
+    ccm_init<E, L>(ciph, nonce, aad_len, len, tag_len, mac, ctr, s0);
+    if (aad_len)
+        cbc_mac_padded(ciph, mac, aad, aad_len, ccm_aad_header(mac, aad_len));
+    ccm_crypt<direction::decrypt, E, L>(ciph, mac, ctr, in, out, len);
+    xorb(mac, s0, tag_len);
 
-    for (size_t i = 0; i < tag_len; ++i)
-        mac[i] = block[i] ^ tag[i];
+    if (memcmp(mac, tag, tag_len)) {
+        zero(out, len);
+        return false;
+    }
+    return true;
+}
 
-    ccm_auth<E, L>(ciph, block, nonce, out, len, aad, aad_len, tag_len);
+/**
+ * @brief Streaming counter with CBC-MAC mode. Lengths of additional authenticated 
+ * data and text are declared up front in start(...), as required by B0, after 
+ * which both may be fed in fragments of any size without reassembly. CBC-MAC 
+ * position within block is carried between calls the same way cbc_mac(...) 
+ * does. Result is identical to ccm_encrypt(...) and ccm_decrypt(...) for any 
+ * fragmentation. NOTE: when decrypting, plain text is released before it's 
+ * authenticated, so it MUST be discarded if verify(...) fails.
+ * 
+ * @tparam E Block cipher
+ * @tparam L Counter size, default is 2
+ */
+template<class E, size_t L = 2>
+class ccm_context {
+public:
+    static constexpr size_t key_size = E::key_size;
+    static constexpr uint64_t max_msg_len = ccm_max_len<L>;
+public:
+    ccm_context() = default;
+    ccm_context(span_i<E::key_size> key) { init(key); }
+    ~ccm_context() { deinit(); }
+public:
+    void init(span_i<E::key_size> key);
+    void deinit();
+    bool start(const byte *nonce, size_t aad_len, size_t msg_len, size_t tag_len, direction dir = direction::encrypt);
+    void aad(const byte *in, size_t len);
+    void update(const byte *in, byte *out, size_t len);
+    bool finish(byte *tag);
+    bool verify(const byte *tag);
+private:
+    void aad_done();
+    void partial(const byte *in, byte *out, size_t len);
+    bool done(byte *tag);
+private:
+    E ciph;
+    byte mac[16] = {};
+    byte ctr[16] = {};
+    byte s0[16] = {};
+    byte ks[16] = {};
+    size_t aad_left = 0;
+    size_t msg_left = 0;
+    size_t aad_pos = 0;
+    size_t tag_len = 0;
+    size_t idx = 0;
+    direction dir = direction::encrypt;
+};
 
-    if (memcmp(mac, block, tag_len)) {
-        zero(out, len);
+template<class E, size_t L>
+void ccm_context<E, L>::init(span_i<E::key_size> key)
+{
+    ciph.init(key);
+}
+
+template<class E, size_t L>
+void ccm_context<E, L>::deinit()
+{
+    ciph.deinit();
+    zero(mac, sizeof(mac));
+    zero(ctr, sizeof(ctr));
+    zero(s0, sizeof(s0));
+    zero(ks, sizeof(ks));
+    aad_left = msg_left = aad_pos = tag_len = idx = 0;
+}
+
+/**
+ * @brief Start new message under the same key.
+ * 
+ * @param nonce Nonce, MUST be of length 15 - L
+ * @param aad_len Total additional authenticated data length
+ * @param msg_len Total text length
+ * @param tag_len Tag length
+ * @param dir Direction
+ * @return true on success, false if tag length is invalid or text is longer than max_msg_len
+ */
+template<class E, size_t L>
+bool ccm_context<E, L>::start(const byte *nonce, size_t aad_len, size_t msg_len, size_t tag_len, direction dir)
+{
+    if (tag_len > 16 || 
+        tag_len < 4  || 
+        tag_len & 1  ||
+        msg_len > max_msg_len)
+        return false;
+
+    ccm_init<E, L>(ciph, nonce, aad_len, msg_len, tag_len, mac, ctr, s0);
+
+    this->aad_left  = aad_len;
+    this->msg_left  = msg_len;
+    this->aad_pos   = aad_len ? ccm_aad_header(mac, aad_len) : 0;
+    this->tag_len   = tag_len;
+    this->idx       = 0;
+    this->dir       = dir;
+
+    return true;
+}
+
+/**
+ * @brief Feed next fragment of additional authenticated data. All of it 
+ * MUST be fed before any text.
+ * 
+ * @param in Additional authenticated data
+ * @param len Fragment length
+ */
+template<class E, size_t L>
+void ccm_context<E, L>::aad(const byte *in, size_t len)
+{
+    assert(len <= aad_left);
+
+    aad_pos = cbc_mac(ciph, mac, in, len, aad_pos);
+    aad_left -= len;
+}
+
+/**
+ * @brief Encrypt or decrypt next fragment of text. Full blocks go through 
+ * fused ccm_crypt(...). Input and output may be the same array.
+ * 
+ * @param in Input data
+ * @param out Output data
+ * @param len Fragment length
+ */
+template<class E, size_t L>
+void ccm_context<E, L>::update(const byte *in, byte *out, size_t len)
+{
+    assert(len <= msg_left);
+
+    aad_done();
+    msg_left -= len;
+
+    if (idx) {
+        size_t n = 16 - idx < len ? 16 - idx : len;
+        partial(in, out, n);
+        in  += n;
+        out += n;
+        len -= n;
+    }
+    auto full = len & ~size_t(0xf);
+
+    if (dir == direction::encrypt)
+        ccm_crypt<direction::encrypt, E, L>(ciph, mac, ctr, in, out, full);
+    else
+        ccm_crypt<direction::decrypt, E, L>(ciph, mac, ctr, in, out, full);
+
+    if (len -= full)
+        partial(in + full, out + full, len);
+}
+
+/**
+ * @brief Finish encryption and output the tag.
+ * 
+ * @param tag Output tag of length given in start(...)
+ * @return true on success, false if fed lengths don't match declared ones
+ */
+template<class E, size_t L>
+bool ccm_context<E, L>::finish(byte *tag)
+{
+    byte t[16];
+    bool ok = done(t);
+    copy(tag, t, tag_len);
+    zero(t, sizeof(t));
+    return ok;
+}
+
+/**
+ * @brief Finish decryption and compare the tag.
+ * 
+ * @param tag Input tag of length given in start(...)
+ * @return true on success, false if fed lengths don't match declared ones or authentication failed
+ */
+template<class E, size_t L>
+bool ccm_context<E, L>::verify(const byte *tag)
+{
+    byte t[16];
+    bool ok = done(t) && !memcmp(t, tag, tag_len);
+    zero(t, sizeof(t));
+    return ok;
+}
+
+template<class E, size_t L>
+void ccm_context<E, L>::aad_done()
+{
+    if (aad_pos && !aad_left) {
+        ciph.encrypt(mac, mac);
+        aad_pos = 0;
+    }
+}
+
+template<class E, size_t L>
+void ccm_context<E, L>::partial(const byte *in, byte *out, size_t len)
+{
+    if (idx == 0) {
+        incc<L>(ctr);
+        ciph.encrypt(ctr, ks);
+    }
+    for (size_t i = 0; i < len; ++i, ++idx) {
+        byte p = dir == direction::encrypt ? in[i] : in[i] ^ ks[idx];
+        out[i] = in[i] ^ ks[idx];
+        mac[idx] ^= p;
+    }
+    if (idx == 16) {
+        ciph.encrypt(mac, mac);
+        idx = 0;
+    }
+}
+
+template<class E, size_t L>
+bool ccm_context<E, L>::done(byte *tag)
+{
+    aad_done();
+
+    if (idx) {
+        ciph.encrypt(mac, mac);
+        idx = 0;
+    }
+    xorb(tag, mac, s0, 16);
+
+    return !aad_left && !msg_left && !aad_pos;
+}
+
+/**
+ * @brief Encrypt chain of segments in-place with block cipher in counter with 
+ * CBC-MAC mode. Additional authenticated data is also a chain of segments. 
+ * Partial blocks are carried across segment boundaries by ccm_context.
+ * 
+ * @tparam E Block cipher
+ * @tparam L Counter size, default is 2
+ * @param key Key
+ * @param nonce Nonce, MUST be of length 15 - L
+ * @param aad Segments of additional authenticated data
+ * @param tag Output tag
+ * @param tag_len Output tag desired length
+ * @param data Segments of text
+ * @return true on success, false if tag length is invalid or text is too long
+ */
+template<class E, size_t L = 2>
+inline bool ccm_encrypt(
+    span_i<E::key_size> key,
+    const byte *nonce,
+    std::span<const span_i<>> aad,
+    byte *tag, size_t tag_len,
+    std::span<const span_o<>> data)
+{
+    ccm_context<E, L> ctx {key};
+
+    if (!ctx.start(nonce, iov_size(aad), iov_size(data), tag_len, direction::encrypt))
+        return false;
+    for (auto s : aad)
+        ctx.aad(s.data(), s.size());
+    for (auto s : data)
+        ctx.update(s.data(), s.data(), s.size());
+
+    return ctx.finish(tag);
+}
+
+/**
+ * @brief Decrypt chain of segments in-place with block cipher in counter with 
+ * CBC-MAC mode. Additional authenticated data is also a chain of segments. 
+ * On failure all segments are zeroed.
+ * 
+ * @tparam E Block cipher
+ * @tparam L Counter size, default is 2
+ * @param key Key
+ * @param nonce Nonce, MUST be of length 15 - L
+ * @param aad Segments of additional authenticated data
+ * @param tag Input tag
+ * @param tag_len Input tag length
+ * @param data Segments of text
+ * @return true on success, false if tag length is invalid, text is too long or authentication failed
+ */
+template<class E, size_t L = 2>
+inline bool ccm_decrypt(
+    span_i<E::key_size> key,
+    const byte *nonce,
+    std::span<const span_i<>> aad,
+    const byte *tag, size_t tag_len,
+    std::span<const span_o<>> data)
+{
+    ccm_context<E, L> ctx {key};
+
+    if (!ctx.start(nonce, iov_size(aad), iov_size(data), tag_len, direction::decrypt))
+        return false;
+    for (auto s : aad)
+        ctx.aad(s.data(), s.size());
+    for (auto s : data)
+        ctx.update(s.data(), s.data(), s.size());
+
+    if (!ctx.verify(tag)) {
+        for (auto s : data)
+            zero(s.data(), s.size());
         return false;
     }
     return true;
@@ -214,4 +564,4 @@ inline bool ccm_decrypt(
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -5,6 +5,65 @@
 
 namespace shoc {
 
+/**
+ * @brief Encrypt full blocks in cipher feedback mode. Input and output 
+ * may be the same array. All pointers MUST be valid.
+ * 
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param reg Feedback register, initially IV, receives last ciphertext block
+ * @param in Plain text
+ * @param out Cipher text
+ * @param blocks Number of 16-byte blocks
+ */
+template<class E>
+inline void cfb_encrypt_blocks(E &ciph, byte *reg, const byte *in, byte *out, size_t blocks)
+{
+    for (; blocks; --blocks, in += 16, out += 16) {
+        ciph.encrypt(span_i<16>{reg, 16}, span_o<16>{reg, 16});
+        xorb(reg, in);
+        copy(out, reg, 16);
+    }
+}
+
+/**
+ * @brief Decrypt full blocks in cipher feedback mode. Every cipher input is 
+ * a known ciphertext block, so keystream for a batch of B blocks is generated 
+ * first and then XOR-ed with input in words. Input and output may be the 
+ * same array. All pointers MUST be valid.
+ * 
+ * @tparam E Block cipher
+ * @tparam B Number of blocks per batch, default is 8
+ * @param ciph Cipher object, must be already initialized
+ * @param reg Feedback register, initially IV, receives last ciphertext block
+ * @param in Cipher text
+ * @param out Plain text
+ * @param blocks Number of 16-byte blocks
+ */
+template<class E, size_t B = 8>
+inline void cfb_decrypt_blocks(E &ciph, byte *reg, const byte *in, byte *out, size_t blocks)
+{
+    static_assert(B > 0, "invalid batch size");
+
+    byte buf[B * 16];
+
+    while (blocks) {
+        size_t n = blocks < B ? blocks : B;
+
+        ciph.encrypt(span_i<16>{reg, 16}, span_o<16>{buf, 16});
+        for (size_t i = 1; i < n; ++i)
+            ciph.encrypt(span_i<16>{in + i * 16 - 16, 16}, span_o<16>{buf + i * 16, 16});
+
+        copy(reg, in + n * 16 - 16, 16);
+        xorb(out, in, buf, n * 16);
+
+        in  += n * 16;
+        out += n * 16;
+        blocks -= n;
+    }
+    zero(buf, sizeof(buf));
+}
+
 /**
  * @brief Encrypt with block cipher in cipher feedback mode.
  * All pointers MUST be valid.
@@ -17,24 +76,27 @@ namespace shoc {
  * @param len Text length
  */
 template<class E>
-inline void cfb_encrypt(const byte *key, const byte *iv, const byte *in, byte *out, size_t len)
+inline void cfb_encrypt(span_i<E::key_size> key, const byte *iv, const byte *in, byte *out, size_t len)
 {
     E ciph {key};
 
-    byte buf[16] = {};
+    byte buf[16];
     copy(buf, iv, 16);
 
-    for (size_t i = 0; i < len; ++i) {
-        size_t idx = i & 0xf;
-        if (idx == 0) 
-            ciph.encrypt(buf, buf);
-        *out++ = buf[idx] ^= *in++;
+    auto blocks = len >> 4;
+    auto remain = len & 0xf;
+
+    cfb_encrypt_blocks(ciph, buf, in, out, blocks);
+
+    if (remain) {
+        ciph.encrypt(buf, buf);
+        xorb(out + len - remain, in + len - remain, buf, remain);
     }
 }
 
 /**
- * @brief Decrypt with block cipher in cipher feedback mode.
- * All pointers MUST be valid.
+ * @brief Decrypt with block cipher in cipher feedback mode. Full blocks 
+ * are processed in batches by cfb_decrypt_blocks(...). All pointers MUST be valid.
  * 
  * @tparam E Block cipher
  * @param key Key
@@ -44,24 +106,151 @@ inline void cfb_encrypt(const byte *key, const byte *iv, const byte *in, byte *o
  * @param len Text length
  */
 template<class E>
-inline void cfb_decrypt(const byte *key, const byte *iv, const byte *in, byte *out, size_t len)
+inline void cfb_decrypt(span_i<E::key_size> key, const byte *iv, const byte *in, byte *out, size_t len)
 {
     E ciph {key};
 
-    byte tmp = 0;
     byte buf[16];
     copy(buf, iv, 16);
 
-    for (size_t i = 0; i < len; ++i) {
-        size_t idx = i & 0xf;
-        if (idx == 0) 
-            ciph.encrypt(buf, buf);
-        tmp = *in++;
-        *out++ = buf[idx] ^ tmp;
-        buf[idx] = tmp;
+    auto blocks = len >> 4;
+    auto remain = len & 0xf;
+
+    cfb_decrypt_blocks(ciph, buf, in, out, blocks);
+
+    if (remain) {
+        ciph.encrypt(buf, buf);
+        xorb(out + len - remain, in + len - remain, buf, remain);
+    }
+}
+
+/**
+ * @brief Streaming cipher feedback mode. Holds expanded key, feedback 
+ * register and position within current block, so data may be fed in 
+ * chunks of any size. Result is identical to cfb_encrypt(...) and 
+ * cfb_decrypt(...) for any chunking.
+ * 
+ * @tparam E Block cipher
+ */
+template<class E>
+class cfb_context {
+public:
+    cfb_context() = default;
+    cfb_context(span_i<E::key_size> key, const byte *iv, direction dir = direction::encrypt) { init(key, iv, dir); }
+    ~cfb_context() { deinit(); }
+public:
+    void init(span_i<E::key_size> key, const byte *iv, direction dir = direction::encrypt);
+    void deinit();
+    void update(const byte *in, byte *out, size_t len);
+    void finish();
+private:
+    E ciph;
+    byte reg[16] = {};
+    size_t idx = 0;
+    direction dir = direction::encrypt;
+};
+
+template<class E>
+void cfb_context<E>::init(span_i<E::key_size> key, const byte *iv, direction dir)
+{
+    ciph.init(key);
+    copy(reg, iv, 16);
+    this->idx = 0;
+    this->dir = dir;
+}
+
+template<class E>
+void cfb_context<E>::deinit()
+{
+    ciph.deinit();
+    zero(reg, sizeof(reg));
+    idx = 0;
+}
+
+/**
+ * @brief Process next chunk of data. Input and output may be the same array.
+ * 
+ * @param in Input data
+ * @param out Output data
+ * @param len Data length
+ */
+template<class E>
+void cfb_context<E>::update(const byte *in, byte *out, size_t len)
+{
+    // NOTE: When idx is not 0, register holds keystream whose first idx bytes
+    // are already replaced with ciphertext. When idx is 0, it holds feedback.
+
+    for (; idx && len; --len) {
+        byte c = dir == direction::encrypt ? reg[idx] ^ *in : *in;
+        *out++ = reg[idx] ^ *in++;
+        reg[idx] = c;
+        idx = (idx + 1) & 0xf;
+    }
+    auto blocks = len >> 4;
+    auto remain = len & 0xf;
+
+    if (dir == direction::encrypt)
+        cfb_encrypt_blocks(ciph, reg, in, out, blocks);
+    else
+        cfb_decrypt_blocks(ciph, reg, in, out, blocks);
+
+    in  += len - remain;
+    out += len - remain;
+
+    if (remain) {
+        ciph.encrypt(reg, reg);
+        for (; idx < remain; ++idx) {
+            byte c = dir == direction::encrypt ? reg[idx] ^ *in : *in;
+            *out++ = reg[idx] ^ *in++;
+            reg[idx] = c;
+        }
     }
 }
 
+/**
+ * @brief Finish processing and wipe the context.
+ * 
+ */
+template<class E>
+void cfb_context<E>::finish()
+{
+    deinit();
+}
+
+/**
+ * @brief Encrypt chain of segments in-place with block cipher in cipher 
+ * feedback mode. Position within block is carried across segment boundaries.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param iv Initial vector
+ * @param data Segments of text
+ */
+template<class E>
+inline void cfb_encrypt(span_i<E::key_size> key, const byte *iv, std::span<const span_o<>> data)
+{
+    cfb_context<E> ctx {key, iv, direction::encrypt};
+    for (auto s : data)
+        ctx.update(s.data(), s.data(), s.size());
+}
+
+/**
+ * @brief Decrypt chain of segments in-place with block cipher in cipher 
+ * feedback mode. Position within block is carried across segment boundaries.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param iv Initial vector
+ * @param data Segments of text
+ */
+template<class E>
+inline void cfb_decrypt(span_i<E::key_size> key, const byte *iv, std::span<const span_o<>> data)
+{
+    cfb_context<E> ctx {key, iv, direction::decrypt};
+    for (auto s : data)
+        ctx.update(s.data(), s.data(), s.size());
+}
+
 }
 
-#endif
\ No newline at end of file
+#endif
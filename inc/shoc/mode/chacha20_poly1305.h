@@ -0,0 +1,303 @@
+#ifndef SHOC_MODE_CHACHA20_POLY1305_H
+#define SHOC_MODE_CHACHA20_POLY1305_H
+
+#include "shoc/cipher/chacha.h"
+#include "shoc/mac/poly1305.h"
+#include <cstring>
+
+namespace shoc {
+
+/**
+ * @brief Streaming ChaCha20-Poly1305 AEAD (RFC 8439). Holds ChaCha20 key,
+ * so many messages can be processed with start(...). Additional authenticated
+ * data and text may be fed in chunks of any size, lengths are not declared
+ * in advance.
+ *
+ */
+class chacha20_poly1305_context {
+    static constexpr size_t chunk = 4096; // Bytes encrypted and authenticated per pass, to stay in cache
+public:
+    static constexpr size_t key_size    = 32;
+    static constexpr size_t nonce_size  = 12;
+    static constexpr size_t tag_size    = 16;
+    static constexpr uint64_t max_msg_len = (uint64_t(1) << 38) - 64; // 2^32 - 1 blocks, as counter is 32-bit and starts at 1
+public:
+    chacha20_poly1305_context() = default;
+    chacha20_poly1305_context(span_i<key_size> key) { init(key); }
+    ~chacha20_poly1305_context() { deinit(); }
+public:
+    void init(span_i<key_size> key);
+    void deinit();
+    void start(const byte *nonce, direction dir = direction::encrypt);
+    void aad(const byte *in, size_t len);
+    void update(const byte *in, byte *out, size_t len);
+    void finish(byte *tag);
+    bool verify(const byte *tag);
+private:
+    void pad(size_t len);
+    void done(byte *tag);
+private:
+    chacha20 ciph;
+    poly1305_context mac;
+    uint64_t aad_len = 0;
+    uint64_t msg_len = 0;
+    bool aad_done = false;
+    direction dir = direction::encrypt;
+};
+
+inline void chacha20_poly1305_context::init(span_i<key_size> key)
+{
+    ciph.init(key);
+}
+
+inline void chacha20_poly1305_context::deinit()
+{
+    ciph.deinit();
+    mac.deinit();
+    aad_len = msg_len = 0;
+    aad_done = false;
+}
+
+/**
+ * @brief Start new message under the same key. Nonce MUST be unique per key.
+ *
+ * @param nonce Nonce, 12 bytes
+ * @param dir Direction
+ */
+inline void chacha20_poly1305_context::start(const byte *nonce, direction dir)
+{
+    byte otk[64];
+
+    ciph.start(span_i<nonce_size>{nonce, nonce_size}, 0);
+    ciph.keystream(otk, sizeof(otk));
+    mac.init(span_i<32>{otk, 32});
+    zero(otk, sizeof(otk));
+
+    this->aad_len   = 0;
+    this->msg_len   = 0;
+    this->aad_done  = false;
+    this->dir       = dir;
+}
+
+/**
+ * @brief Feed next fragment of additional authenticated data. All of it
+ * MUST be fed before any text.
+ *
+ * @param in Additional authenticated data
+ * @param len Fragment length
+ */
+inline void chacha20_poly1305_context::aad(const byte *in, size_t len)
+{
+    assert(!aad_done);
+
+    mac.update(in, len);
+    aad_len += len;
+}
+
+/**
+ * @brief Encrypt or decrypt next fragment of text. Text is processed in
+ * cache-sized chunks, each one encrypted and authenticated back to back.
+ * Input and output may be the same array.
+ *
+ * @param in Input data
+ * @param out Output data
+ * @param len Fragment length
+ */
+inline void chacha20_poly1305_context::update(const byte *in, byte *out, size_t len)
+{
+    if (!aad_done) {
+        pad(aad_len);
+        aad_done = true;
+    }
+    msg_len += len;
+
+    while (len) {
+        size_t n = len < chunk ? len : chunk;
+        if (dir == direction::encrypt) {
+            ciph.crypt(in, out, n);
+            mac.update(out, n);
+        } else {
+            mac.update(in, n);
+            ciph.crypt(in, out, n);
+        }
+        in  += n;
+        out += n;
+        len -= n;
+    }
+}
+
+/**
+ * @brief Finish encryption and output the tag.
+ *
+ * @param tag Output tag, 16 bytes
+ */
+inline void chacha20_poly1305_context::finish(byte *tag)
+{
+    done(tag);
+}
+
+/**
+ * @brief Finish decryption and compare the tag.
+ *
+ * @param tag Input tag, 16 bytes
+ * @return true on success, false if authentication failed
+ */
+inline bool chacha20_poly1305_context::verify(const byte *tag)
+{
+    byte t[16];
+    done(t);
+    bool ok = !memcmp(t, tag, sizeof(t));
+    zero(t, sizeof(t));
+    return ok;
+}
+
+inline void chacha20_poly1305_context::pad(size_t len)
+{
+    static constexpr byte zeros[16] = {};
+
+    if (len % 16)
+        mac.update(zeros, 16 - len % 16);
+}
+
+inline void chacha20_poly1305_context::done(byte *tag)
+{
+    byte lens[16];
+
+    if (!aad_done) {
+        pad(aad_len);
+        aad_done = true;
+    }
+    pad(msg_len);
+    putle(aad_len, lens);
+    putle(msg_len, lens + 8);
+    mac.update(lens, sizeof(lens));
+    mac.finish(tag);
+}
+
+/**
+ * @brief Encrypt with ChaCha20-Poly1305 AEAD (RFC 8439). All pointers MUST be
+ * valid when relevant length is not 0. Input and output may be the same array.
+ *
+ * @param key Key
+ * @param nonce Nonce, 12 bytes
+ * @param aad Additional authenticated data
+ * @param aad_len Additional authenticated data length
+ * @param tag Output tag, 16 bytes
+ * @param in Plain text
+ * @param out Cipher text
+ * @param len Text length
+ */
+inline void chacha20_poly1305_encrypt(
+    span_i<32> key,
+    const byte *nonce,
+    const byte *aad, size_t aad_len,
+          byte *tag,
+    const byte *in,
+          byte *out, size_t len)
+{
+    chacha20_poly1305_context ctx {key};
+    ctx.start(nonce, direction::encrypt);
+    ctx.aad(aad, aad_len);
+    ctx.update(in, out, len);
+    ctx.finish(tag);
+}
+
+/**
+ * @brief Decrypt with ChaCha20-Poly1305 AEAD (RFC 8439). All pointers MUST be
+ * valid when relevant length is not 0. Input and output may be the same array.
+ * On failure output is zeroed.
+ *
+ * @param key Key
+ * @param nonce Nonce, 12 bytes
+ * @param aad Additional authenticated data
+ * @param aad_len Additional authenticated data length
+ * @param tag Input tag, 16 bytes
+ * @param in Cipher text
+ * @param out Plain text
+ * @param len Text length
+ * @return true on success, false if authentication failed
+ */
+inline bool chacha20_poly1305_decrypt(
+    span_i<32> key,
+    const byte *nonce,
+    const byte *aad, size_t aad_len,
+    const byte *tag,
+    const byte *in,
+          byte *out, size_t len)
+{
+    chacha20_poly1305_context ctx {key};
+    ctx.start(nonce, direction::decrypt);
+    ctx.aad(aad, aad_len);
+    ctx.update(in, out, len);
+
+    if (!ctx.verify(tag)) {
+        zero(out, len);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Encrypt chain of segments in-place with ChaCha20-Poly1305 AEAD. 
+ * Additional authenticated data is also a chain of segments. Partial blocks 
+ * are carried across segment boundaries by the context.
+ *
+ * @param key Key
+ * @param nonce Nonce, 12 bytes
+ * @param aad Segments of additional authenticated data
+ * @param tag Output tag, 16 bytes
+ * @param data Segments of text
+ */
+inline void chacha20_poly1305_encrypt(
+    span_i<32> key,
+    const byte *nonce,
+    std::span<const span_i<>> aad,
+    byte *tag,
+    std::span<const span_o<>> data)
+{
+    chacha20_poly1305_context ctx {key};
+    ctx.start(nonce, direction::encrypt);
+    for (auto s : aad)
+        ctx.aad(s.data(), s.size());
+    for (auto s : data)
+        ctx.update(s.data(), s.data(), s.size());
+    ctx.finish(tag);
+}
+
+/**
+ * @brief Decrypt chain of segments in-place with ChaCha20-Poly1305 AEAD. 
+ * Additional authenticated data is also a chain of segments. On failure 
+ * all segments are zeroed.
+ *
+ * @param key Key
+ * @param nonce Nonce, 12 bytes
+ * @param aad Segments of additional authenticated data
+ * @param tag Input tag, 16 bytes
+ * @param data Segments of text
+ * @return true on success, false if authentication failed
+ */
+inline bool chacha20_poly1305_decrypt(
+    span_i<32> key,
+    const byte *nonce,
+    std::span<const span_i<>> aad,
+    const byte *tag,
+    std::span<const span_o<>> data)
+{
+    chacha20_poly1305_context ctx {key};
+    ctx.start(nonce, direction::decrypt);
+    for (auto s : aad)
+        ctx.aad(s.data(), s.size());
+    for (auto s : data)
+        ctx.update(s.data(), s.data(), s.size());
+
+    if (!ctx.verify(tag)) {
+        for (auto s : data)
+            zero(s.data(), s.size());
+        return false;
+    }
+    return true;
+}
+
+}
+
+#endif
@@ -1,13 +1,48 @@
 #ifndef SHOC_MODE_CTR_H
 #define SHOC_MODE_CTR_H
 
-#include "shoc/util.h"
+#include "shoc/mode/ecb.h"
 
 namespace shoc {
 
+/**
+ * @brief Generate keystream in counter mode. Counter blocks are written to
+ * output first and then encrypted in-place with one ecb_encrypt(...) call,
+ * so multi-block cipher paths are used. Consecutive calls continue the
+ * same keystream as long as every length, except the last one, is multiple 
+ * of 16. All pointers MUST be valid.
+ * 
+ * @tparam E Block cipher
+ * @tparam L Counter size, default is 4
+ * @param ciph Cipher object, must be already initialized
+ * @param ctr Counter block, incremented once per generated block
+ * @param out Keystream output
+ * @param len Keystream length
+ */
+template<class E, size_t L = 4>
+inline void ctr_keystream(E &ciph, byte *ctr, byte *out, size_t len)
+{
+    auto full = len & ~size_t(0xf);
+
+    for (size_t i = 0; i < full; i += 16) {
+        copy(out + i, ctr, 16);
+        incc<L>(ctr);
+    }
+    ecb_encrypt(ciph, span_i<>{out, full}, span_o<>{out, full});
+
+    if (len -= full) {
+        byte buf[16];
+        ciph.encrypt(span_i<16>{ctr, 16}, buf);
+        incc<L>(ctr);
+        copy(out + full, buf, len);
+        zero(buf, sizeof(buf));
+    }
+}
+
 /**
  * @brief Basic counter mode function, used as a component in CTR and GCM modes. 
- * Counter size is configurable. All pointers MUST be valid.
+ * Counter size is configurable. Keystream is generated in batches of 8 blocks 
+ * and XOR-ed in words. All pointers MUST be valid.
  * 
  * @tparam E Block cipher
  * @tparam L Counter size, default is 4
@@ -20,18 +55,19 @@ namespace shoc {
 template<class E, size_t L = 4>
 inline void ctrf(const byte *iv, const byte *in, byte *out, size_t len, E &ciph)
 {
-    byte buf[16];
+    byte buf[8 * 16];
     byte ctr[16];
     copy(ctr, iv, 16);
 
-    for (size_t i = 0; i < len; ++i) {
-        size_t idx = i & 0xf;
-        if (idx == 0) {
-            ciph.encrypt(ctr, buf);
-            incc<L>(ctr);
-        }
-        *out++ = buf[idx] ^ *in++;
+    while (len) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        ctr_keystream<E, L>(ciph, ctr, buf, n);
+        xorb(out, in, buf, n);
+        in  += n;
+        out += n;
+        len -= n;
     }
+    zero(buf, sizeof(buf));
 }
 
 /**
@@ -47,7 +83,7 @@ inline void ctrf(const byte *iv, const byte *in, byte *out, size_t len, E &ciph)
  * @param len Text length
  */
 template<class E, size_t L = 4>
-inline void ctr_encrypt(const byte *key, const byte *iv, const byte *in, byte *out, size_t len)
+inline void ctr_encrypt(span_i<E::key_size> key, const byte *iv, const byte *in, byte *out, size_t len)
 {
     E ciph {key};
     ctrf<E, L>(iv, in, out, len, ciph);   
@@ -66,11 +102,135 @@ inline void ctr_encrypt(const byte *key, const byte *iv, const byte *in, byte *o
  * @param len Text length
  */
 template<class E, size_t L = 4>
-inline void ctr_decrypt(const byte *key, const byte *iv, const byte *in, byte *out, size_t len)
+inline void ctr_decrypt(span_i<E::key_size> key, const byte *iv, const byte *in, byte *out, size_t len)
 {
     ctr_encrypt<E, L>(key, iv, in, out, len);
 }
 
+/**
+ * @brief Streaming counter mode. Holds expanded key, counter block and unused 
+ * part of the last keystream block, so data may be fed in chunks of any size. 
+ * Result is identical to ctr_encrypt(...) for any chunking.
+ * 
+ * @tparam E Block cipher
+ * @tparam L Counter size, default is 4
+ */
+template<class E, size_t L = 4>
+class ctr_context {
+public:
+    ctr_context() = default;
+    ctr_context(span_i<E::key_size> key, const byte *iv) { init(key, iv); }
+    ~ctr_context() { deinit(); }
+public:
+    void init(span_i<E::key_size> key, const byte *iv);
+    void deinit();
+    void update(const byte *in, byte *out, size_t len);
+    void finish();
+private:
+    E ciph;
+    byte ctr[16] = {};
+    byte ks[16] = {};
+    size_t idx = 0;
+};
+
+template<class E, size_t L>
+void ctr_context<E, L>::init(span_i<E::key_size> key, const byte *iv)
+{
+    ciph.init(key);
+    copy(ctr, iv, 16);
+    idx = 0;
+}
+
+template<class E, size_t L>
+void ctr_context<E, L>::deinit()
+{
+    ciph.deinit();
+    zero(ctr, sizeof(ctr));
+    zero(ks, sizeof(ks));
+    idx = 0;
+}
+
+/**
+ * @brief Process next chunk of data. Input and output may be the same array.
+ * 
+ * @param in Input data
+ * @param out Output data
+ * @param len Data length
+ */
+template<class E, size_t L>
+void ctr_context<E, L>::update(const byte *in, byte *out, size_t len)
+{
+    if (idx) {
+        size_t n = 16 - idx < len ? 16 - idx : len;
+        xorb(out, in, ks + idx, n);
+        idx = (idx + n) & 0xf;
+        in  += n;
+        out += n;
+        len -= n;
+    }
+    byte buf[8 * 16];
+
+    while (len >= 16) {
+        size_t n = len < sizeof(buf) ? len & ~size_t(0xf) : sizeof(buf);
+        ctr_keystream<E, L>(ciph, ctr, buf, n);
+        xorb(out, in, buf, n);
+        in  += n;
+        out += n;
+        len -= n;
+    }
+    zero(buf, sizeof(buf));
+
+    if (len) {
+        ctr_keystream<E, L>(ciph, ctr, ks, 16);
+        xorb(out, in, ks, len);
+        idx = len;
+    }
+}
+
+/**
+ * @brief Finish processing and wipe the context.
+ * 
+ */
+template<class E, size_t L>
+void ctr_context<E, L>::finish()
+{
+    deinit();
+}
+
+/**
+ * @brief Encrypt chain of segments in-place with block cipher in counter 
+ * mode. Unused keystream is carried across segment boundaries.
+ * 
+ * @tparam E Block cipher
+ * @tparam L Counter size, default is 4
+ * @param key Key
+ * @param iv Initial vector
+ * @param data Segments of text
+ */
+template<class E, size_t L = 4>
+inline void ctr_encrypt(span_i<E::key_size> key, const byte *iv, std::span<const span_o<>> data)
+{
+    ctr_context<E, L> ctx {key, iv};
+    for (auto s : data)
+        ctx.update(s.data(), s.data(), s.size());
+}
+
+/**
+ * @brief Decrypt chain of segments in-place with block cipher in counter 
+ * mode. Unused keystream is carried across segment boundaries.
+ * 
+ * @tparam E Block cipher
+ * @tparam L Counter size, default is 4
+ * @param key Key
+ * @param iv Initial vector
+ * @param data Segments of text
+ */
+template<class E, size_t L = 4>
+inline void ctr_decrypt(span_i<E::key_size> key, const byte *iv, std::span<const span_o<>> data)
+{
+    ctr_encrypt<E, L>(key, iv, data);
+}
+
 }
 
-#endif
\ No newline at end of file
+#endif
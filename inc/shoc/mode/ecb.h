@@ -1,54 +1,248 @@
 #ifndef SHOC_MODE_ECB_H
 #define SHOC_MODE_ECB_H
 
-#include "shoc/util.h"
+#include "shoc/parallel.h"
 
 namespace shoc {
 
 /**
- * @brief Encrypt with block cipher in electronic codebook mode. All 
- * pointers MUST be valid and length be multiple of E::block_size.
+ * @brief Electronic codebook engine, applies block cipher to every block 
+ * of input. If cipher provides multi-block encrypt_blocks(...) and 
+ * decrypt_blocks(...) members, as AES does, whole batch is passed to them
+ * at once.
+ * Input and output may be the same span. Lengths MUST be equal and 
+ * multiple of E::block_size.
  * 
+ * @tparam D Direction
  * @tparam E Block cipher
- * @param key Key
+ * @param ciph Cipher object, must be already initialized
+ * @param in Input blocks
+ * @param out Output blocks
+ */
+template<direction D, class E>
+constexpr void ecb_process(E &ciph, span_i<> in, span_o<> out)
+{
+    constexpr auto N = E::block_size;
+
+    assert(in.size() == out.size());
+    assert(in.size() % N == 0);
+
+    if constexpr (D == direction::encrypt && requires { ciph.encrypt_blocks(in, out); }) {
+        ciph.encrypt_blocks(in, out);
+    } else if constexpr (D == direction::decrypt && requires { ciph.decrypt_blocks(in, out); }) {
+        ciph.decrypt_blocks(in, out);
+    } else {
+        for (size_t i = 0; i < in.size(); i += N) {
+            if constexpr (D == direction::encrypt)
+                ciph.encrypt(in.subspan(i).template first<N>(), out.subspan(i).template first<N>());
+            else
+                ciph.decrypt(in.subspan(i).template first<N>(), out.subspan(i).template first<N>());
+        }
+    }
+}
+
+/**
+ * @brief Thread-parallel electronic codebook engine for large buffers. Blocks 
+ * are split into contiguous parts, each one processed with its own copy of 
+ * the cipher object. Small inputs are processed on the calling thread. 
+ * Lengths MUST be equal and multiple of E::block_size.
+ * 
+ * @tparam D Direction
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param in Input blocks
+ * @param out Output blocks
+ * @param threads Maximum number of threads, 0 means default_threads()
+ */
+template<direction D, class E>
+inline void ecb_process_parallel(const E &ciph, span_i<> in, span_o<> out, size_t threads = 0)
+{
+    constexpr auto N = E::block_size;
+    constexpr size_t grain = 4096; // Blocks per thread at least
+
+    assert(in.size() == out.size());
+    assert(in.size() % N == 0);
+
+    parallel_for(in.size() / N, threads, grain, [&](size_t begin, size_t end) {
+        E local = ciph;
+        ecb_process<D>(local, 
+            in.subspan(begin * N, (end - begin) * N), 
+            out.subspan(begin * N, (end - begin) * N));
+    });
+}
+
+/**
+ * @brief Encrypt with block cipher in electronic codebook mode. Lengths 
+ * MUST be equal and multiple of E::block_size.
+ * 
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
  * @param in Plain text
  * @param out Cipher text 
- * @param len Text length, multiple of E::block_size
  */
 template<class E>
-constexpr void ecb_encrypt(span_i<E::block_size> key, const byte* in, byte* out, size_t len)
+constexpr void ecb_encrypt(E &ciph, span_i<> in, span_o<> out)
+{
+    ecb_process<direction::encrypt>(ciph, in, out);
+}
+
+/**
+ * @brief Decrypt with block cipher in electronic codebook mode. Lengths 
+ * MUST be equal and multiple of E::block_size.
+ * 
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param in Cipher text
+ * @param out Plain text 
+ */
+template<class E>
+constexpr void ecb_decrypt(E &ciph, span_i<> in, span_o<> out)
 {
-    assert((len % E::block_size) == 0);
+    ecb_process<direction::decrypt>(ciph, in, out);
+}
 
+/**
+ * @brief Encrypt with block cipher in electronic codebook mode. Lengths 
+ * MUST be equal and multiple of E::block_size.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param in Plain text
+ * @param out Cipher text 
+ */
+template<class E>
+constexpr void ecb_encrypt(span_i<E::key_size> key, span_i<> in, span_o<> out)
+{
     E ciph {key};
-    
-    for (size_t i = 0; i < len; i += E::block_size)
-        ciph.encrypt(
-            span_i<E::block_size>{in + i}, 
-            span_o<E::block_size>{out + i});
+    ecb_process<direction::encrypt>(ciph, in, out);
 }
 
 /**
- * @brief Decrypt with block cipher in electronic codebook mode. All 
- * pointers MUST be valid and length is multiple of E::block_size.
+ * @brief Decrypt with block cipher in electronic codebook mode. Lengths 
+ * MUST be equal and multiple of E::block_size.
  * 
  * @tparam E Block cipher
  * @param key Key
  * @param in Cipher text
- * @param out Plain text
- * @param len Text length, multiple of E::block_size
+ * @param out Plain text 
+ */
+template<class E>
+constexpr void ecb_decrypt(span_i<E::key_size> key, span_i<> in, span_o<> out)
+{
+    E ciph {key};
+    ecb_process<direction::decrypt>(ciph, in, out);
+}
+
+/**
+ * @brief Encrypt chain of segments in-place with block cipher in electronic 
+ * codebook mode. Blocks may straddle segment boundaries.
+ * 
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param data Segments of text, total length multiple of E::block_size
+ * @return true on success, false if total length is invalid
+ */
+template<class E>
+inline bool ecb_encrypt(E &ciph, std::span<const span_o<>> data)
+{
+    constexpr auto N = E::block_size;
+
+    if (iov_size(data) % N)
+        return false;
+
+    return iov_blocks<N>(data, [&](byte *p, size_t n) {
+        ecb_process<direction::encrypt>(ciph, span_i<>{p, n * N}, span_o<>{p, n * N});
+    });
+}
+
+/**
+ * @brief Decrypt chain of segments in-place with block cipher in electronic 
+ * codebook mode. Blocks may straddle segment boundaries.
+ * 
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param data Segments of text, total length multiple of E::block_size
+ * @return true on success, false if total length is invalid
+ */
+template<class E>
+inline bool ecb_decrypt(E &ciph, std::span<const span_o<>> data)
+{
+    constexpr auto N = E::block_size;
+
+    if (iov_size(data) % N)
+        return false;
+
+    return iov_blocks<N>(data, [&](byte *p, size_t n) {
+        ecb_process<direction::decrypt>(ciph, span_i<>{p, n * N}, span_o<>{p, n * N});
+    });
+}
+
+/**
+ * @brief Encrypt chain of segments in-place with block cipher in electronic 
+ * codebook mode.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param data Segments of text, total length multiple of E::block_size
+ * @return true on success, false if total length is invalid
+ */
+template<class E>
+inline bool ecb_encrypt(span_i<E::key_size> key, std::span<const span_o<>> data)
+{
+    E ciph {key};
+    return ecb_encrypt(ciph, data);
+}
+
+/**
+ * @brief Decrypt chain of segments in-place with block cipher in electronic 
+ * codebook mode.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param data Segments of text, total length multiple of E::block_size
+ * @return true on success, false if total length is invalid
  */
 template<class E>
-inline void ecb_decrypt(const byte *key, const byte *in, byte *out, size_t len)
+inline bool ecb_decrypt(span_i<E::key_size> key, std::span<const span_o<>> data)
 {
-    assert((len % E::block_size) == 0);
+    E ciph {key};
+    return ecb_decrypt(ciph, data);
+}
 
+/**
+ * @brief Encrypt large buffer with block cipher in electronic codebook mode 
+ * using multiple threads. Lengths MUST be equal and multiple of E::block_size.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param in Plain text
+ * @param out Cipher text
+ * @param threads Maximum number of threads, 0 means default_threads()
+ */
+template<class E>
+inline void ecb_encrypt_parallel(span_i<E::key_size> key, span_i<> in, span_o<> out, size_t threads = 0)
+{
     E ciph {key};
+    ecb_process_parallel<direction::encrypt>(ciph, in, out, threads);
+}
 
-    for (size_t i = 0; i < len; i += E::block_size())
-        ciph.decrypt(in + i, out + i);
+/**
+ * @brief Decrypt large buffer with block cipher in electronic codebook mode 
+ * using multiple threads. Lengths MUST be equal and multiple of E::block_size.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param in Cipher text
+ * @param out Plain text
+ * @param threads Maximum number of threads, 0 means default_threads()
+ */
+template<class E>
+inline void ecb_decrypt_parallel(span_i<E::key_size> key, span_i<> in, span_o<> out, size_t threads = 0)
+{
+    E ciph {key};
+    ecb_process_parallel<direction::decrypt>(ciph, in, out, threads);
 }
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -96,15 +96,14 @@ inline void gcm_ghash(
 }
 
 template<class E>
-inline void gcm_init(const byte *iv, size_t iv_len, byte *h, byte *j0, E &ciph)
+inline void gcm_subkey(byte *h, E &ciph)
 {
-    // Init hash subkey
-
     zero(h, 16);
-    ciph.encrypt(h, h);
-
-    // Prepare J0
+    ciph.encrypt(span_i<16>{h, 16}, span_o<16>{h, 16});
+}
 
+inline void gcm_j0(const byte *iv, size_t iv_len, const byte *h, byte *j0)
+{
     zero(j0, 16);
 
     if (iv_len == 12) {
@@ -138,6 +137,13 @@ inline void gcm_init(const byte *iv, size_t iv_len, byte *h, byte *j0, E &ciph)
     }
 }
 
+template<class E>
+inline void gcm_init(const byte *iv, size_t iv_len, byte *h, byte *j0, E &ciph)
+{
+    gcm_subkey(h, ciph);
+    gcm_j0(iv, iv_len, h, j0);
+}
+
 template<class E>
 inline void gcm_gctr(const byte *j0, const byte *in, byte *out, size_t len, E &ciph)
 {
@@ -170,7 +176,7 @@ inline void gcm_gctr(const byte *j0, const byte *in, byte *out, size_t len, E &c
  */
 template<class E>
 inline bool gcm_encrypt(
-    const byte *key,
+    span_i<E::key_size> key,
     const byte *iv,  size_t iv_len,
     const byte *aad, size_t aad_len,
           byte *tag, size_t tag_len,
@@ -217,7 +223,7 @@ inline bool gcm_encrypt(
  */
 template<class E>
 inline bool gcm_decrypt(
-    const byte *key,
+    span_i<E::key_size> key,
     const byte *iv,  size_t iv_len,
     const byte *aad, size_t aad_len,
     const byte *tag, size_t tag_len,
@@ -247,6 +253,383 @@ inline bool gcm_decrypt(
     return true;
 }
 
+/**
+ * @brief Streaming Galois counter mode. Holds expanded key and hash subkey, 
+ * so many messages can be processed with start(...). Additional authenticated 
+ * data and text may be fed in fragments of any size, partial blocks of both 
+ * GHASH input and keystream are carried between calls. Result is identical 
+ * to gcm_encrypt(...) and gcm_decrypt(...) for any fragmentation. NOTE: when 
+ * decrypting, plain text is released before it's authenticated, so it MUST 
+ * be discarded if verify(...) fails.
+ * 
+ * @tparam E Block cipher
+ */
+template<class E>
+class gcm_context {
+public:
+    static constexpr size_t key_size = E::key_size;
+    static constexpr uint64_t max_msg_len = (uint64_t(1) << 36) - 32; // 2^32 - 2 blocks, as counter is 32-bit
+public:
+    gcm_context() = default;
+    gcm_context(span_i<E::key_size> key) { init(key); }
+    ~gcm_context() { deinit(); }
+public:
+    void init(span_i<E::key_size> key);
+    void deinit();
+    void start(const byte *iv, size_t iv_len, direction dir = direction::encrypt);
+    void aad(const byte *in, size_t len);
+    void update(const byte *in, byte *out, size_t len);
+    bool finish(byte *tag, size_t tag_len);
+    bool verify(const byte *tag, size_t tag_len);
+private:
+    void hash(const byte *in, size_t len);
+    void hash_pad();
+    void crypt(const byte *in, byte *out, size_t len);
+    void done(byte *tag);
+private:
+    E ciph;
+    byte h[16] = {};
+    byte j[16] = {};
+    byte ctr[16] = {};
+    byte ks[16] = {};
+    byte y[16] = {};
+    byte buf[16] = {};
+    size_t buf_idx = 0;
+    size_t ks_idx = 16;
+    uint64_t aad_len = 0;
+    uint64_t msg_len = 0;
+    bool aad_done = false;
+    direction dir = direction::encrypt;
+};
+
+template<class E>
+void gcm_context<E>::init(span_i<E::key_size> key)
+{
+    ciph.init(key);
+    gcm_subkey(h, ciph);
+}
+
+template<class E>
+void gcm_context<E>::deinit()
+{
+    ciph.deinit();
+    zero(h, sizeof(h));
+    zero(j, sizeof(j));
+    zero(ctr, sizeof(ctr));
+    zero(ks, sizeof(ks));
+    zero(y, sizeof(y));
+    zero(buf, sizeof(buf));
+    buf_idx = 0;
+    ks_idx = 16;
+    aad_len = msg_len = 0;
+    aad_done = false;
+}
+
+/**
+ * @brief Start new message under the same key.
+ * 
+ * @param iv Initial vector
+ * @param iv_len Initial vector length
+ * @param dir Direction
+ */
+template<class E>
+void gcm_context<E>::start(const byte *iv, size_t iv_len, direction dir)
+{
+    gcm_j0(iv, iv_len, h, j);
+    copy(ctr, j, 16);
+    incc(ctr);
+    zero(y, sizeof(y));
+
+    this->buf_idx   = 0;
+    this->ks_idx    = 16;
+    this->aad_len   = 0;
+    this->msg_len   = 0;
+    this->aad_done  = false;
+    this->dir       = dir;
+}
+
+/**
+ * @brief Feed next fragment of additional authenticated data. All of it 
+ * MUST be fed before any text.
+ * 
+ * @param in Additional authenticated data
+ * @param len Fragment length
+ */
+template<class E>
+void gcm_context<E>::aad(const byte *in, size_t len)
+{
+    assert(!aad_done);
+
+    hash(in, len);
+    aad_len += len;
+}
+
+/**
+ * @brief Encrypt or decrypt next fragment of text. Input and output may be 
+ * the same array.
+ * 
+ * @param in Input data
+ * @param out Output data
+ * @param len Fragment length
+ */
+template<class E>
+void gcm_context<E>::update(const byte *in, byte *out, size_t len)
+{
+    if (!aad_done) {
+        hash_pad();
+        aad_done = true;
+    }
+    msg_len += len;
+
+    if (dir == direction::encrypt) {
+        crypt(in, out, len);
+        hash(out, len);
+    } else {
+        hash(in, len);
+        crypt(in, out, len);
+    }
+}
+
+/**
+ * @brief Finish encryption and output the tag.
+ * 
+ * @param tag Output tag
+ * @param tag_len Output tag desired length
+ * @return true on success, false if tag length is invalid
+ */
+template<class E>
+bool gcm_context<E>::finish(byte *tag, size_t tag_len)
+{
+    if (tag_len > 16 || 
+        tag_len < 4  || (tag_len < 12 && tag_len & 3))
+        return false;
+
+    byte t[16];
+    done(t);
+    copy(tag, t, tag_len);
+    zero(t, sizeof(t));
+
+    return true;
+}
+
+/**
+ * @brief Finish decryption and compare the tag.
+ * 
+ * @param tag Input tag
+ * @param tag_len Input tag length
+ * @return true on success, false if tag length is invalid or authentication failed
+ */
+template<class E>
+bool gcm_context<E>::verify(const byte *tag, size_t tag_len)
+{
+    if (tag_len > 16 || 
+        tag_len < 4  || (tag_len < 12 && tag_len & 3))
+        return false;
+
+    byte t[16];
+    done(t);
+    bool ok = !memcmp(t, tag, tag_len);
+    zero(t, sizeof(t));
+
+    return ok;
+}
+
+template<class E>
+void gcm_context<E>::hash(const byte *in, size_t len)
+{
+    if (buf_idx) {
+        size_t n = 16 - buf_idx < len ? 16 - buf_idx : len;
+        copy(buf + buf_idx, in, n);
+        buf_idx += n;
+        in  += n;
+        len -= n;
+        if (buf_idx < 16)
+            return;
+        ghash(h, buf, 16, y);
+        buf_idx = 0;
+    }
+    size_t full = len & ~size_t(0xf);
+
+    ghash(h, in, full, y);
+
+    if ((buf_idx = len - full))
+        copy(buf, in + full, buf_idx);
+}
+
+template<class E>
+void gcm_context<E>::hash_pad()
+{
+    if (buf_idx)
+        ghash(h, buf, buf_idx, y);
+    buf_idx = 0;
+}
+
+template<class E>
+void gcm_context<E>::crypt(const byte *in, byte *out, size_t len)
+{
+    byte tmp[8 * 16];
+
+    if (ks_idx < 16 && len) {
+        size_t n = 16 - ks_idx < len ? 16 - ks_idx : len;
+        xorb(out, in, ks + ks_idx, n);
+        ks_idx += n;
+        in  += n;
+        out += n;
+        len -= n;
+    }
+    for (; len >= 16; ) {
+        size_t n = len < sizeof(tmp) ? len & ~size_t(0xf) : sizeof(tmp);
+        ctr_keystream<E>(ciph, ctr, tmp, n);
+        xorb(out, in, tmp, n);
+        in  += n;
+        out += n;
+        len -= n;
+    }
+    if (len) {
+        ctr_keystream<E>(ciph, ctr, ks, 16);
+        xorb(out, in, ks, len);
+        ks_idx = len;
+    }
+    zero(tmp, sizeof(tmp));
+}
+
+template<class E>
+void gcm_context<E>::done(byte *tag)
+{
+    byte len[16];
+
+    if (!aad_done) {
+        hash_pad();
+        aad_done = true;
+    }
+    hash_pad();
+    putbe(uint64_t(aad_len * 8), len);
+    putbe(uint64_t(msg_len * 8), len + 8);
+    ghash(h, len, 16, y);
+    ctrf(j, y, tag, 16, ciph);
+}
+
+/**
+ * @brief Same as gcm_encrypt(...) over chains of segments, but with already 
+ * keyed context, so no key setup is done per message.
+ * 
+ * @tparam E Block cipher
+ * @param ctx Keyed context
+ * @param iv Initial vector
+ * @param iv_len Initial vector length
+ * @param aad Segments of additional authenticated data
+ * @param tag Output tag
+ * @param tag_len Output tag desired length
+ * @param data Segments of text
+ * @return true on success, false if tag length is invalid
+ */
+template<class E>
+inline bool gcm_encrypt(
+    gcm_context<E> &ctx,
+    const byte *iv, size_t iv_len,
+    std::span<const span_i<>> aad,
+    byte *tag, size_t tag_len,
+    std::span<const span_o<>> data)
+{
+    ctx.start(iv, iv_len, direction::encrypt);
+    for (auto s : aad)
+        ctx.aad(s.data(), s.size());
+    for (auto s : data)
+        ctx.update(s.data(), s.data(), s.size());
+
+    return ctx.finish(tag, tag_len);
+}
+
+/**
+ * @brief Same as gcm_decrypt(...) over chains of segments, but with already 
+ * keyed context, so no key setup is done per message.
+ * 
+ * @tparam E Block cipher
+ * @param ctx Keyed context
+ * @param iv Initial vector
+ * @param iv_len Initial vector length
+ * @param aad Segments of additional authenticated data
+ * @param tag Input tag
+ * @param tag_len Input tag length
+ * @param data Segments of text
+ * @return true on success, false if tag length is invalid or authentication failed
+ */
+template<class E>
+inline bool gcm_decrypt(
+    gcm_context<E> &ctx,
+    const byte *iv, size_t iv_len,
+    std::span<const span_i<>> aad,
+    const byte *tag, size_t tag_len,
+    std::span<const span_o<>> data)
+{
+    ctx.start(iv, iv_len, direction::decrypt);
+    for (auto s : aad)
+        ctx.aad(s.data(), s.size());
+    for (auto s : data)
+        ctx.update(s.data(), s.data(), s.size());
+
+    if (!ctx.verify(tag, tag_len)) {
+        for (auto s : data)
+            zero(s.data(), s.size());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Encrypt chain of segments in-place with block cipher in Galois counter 
+ * mode. Additional authenticated data is also a chain of segments. Partial blocks 
+ * are carried across segment boundaries by gcm_context, nothing is coalesced.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param iv Initial vector
+ * @param iv_len Initial vector length
+ * @param aad Segments of additional authenticated data
+ * @param tag Output tag
+ * @param tag_len Output tag desired length
+ * @param data Segments of text
+ * @return true on success, false if tag length is invalid
+ */
+template<class E>
+inline bool gcm_encrypt(
+    span_i<E::key_size> key,
+    const byte *iv, size_t iv_len,
+    std::span<const span_i<>> aad,
+    byte *tag, size_t tag_len,
+    std::span<const span_o<>> data)
+{
+    gcm_context<E> ctx {key};
+    return gcm_encrypt(ctx, iv, iv_len, aad, tag, tag_len, data);
+}
+
+/**
+ * @brief Decrypt chain of segments in-place with block cipher in Galois counter 
+ * mode. Additional authenticated data is also a chain of segments. On failure 
+ * all segments are zeroed.
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param iv Initial vector
+ * @param iv_len Initial vector length
+ * @param aad Segments of additional authenticated data
+ * @param tag Input tag
+ * @param tag_len Input tag length
+ * @param data Segments of text
+ * @return true on success, false if tag length is invalid or authentication failed
+ */
+template<class E>
+inline bool gcm_decrypt(
+    span_i<E::key_size> key,
+    const byte *iv, size_t iv_len,
+    std::span<const span_i<>> aad,
+    const byte *tag, size_t tag_len,
+    std::span<const span_o<>> data)
+{
+    gcm_context<E> ctx {key};
+    return gcm_decrypt(ctx, iv, iv_len, aad, tag, tag_len, data);
+}
+
 }
 
 #endif
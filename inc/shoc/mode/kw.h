@@ -0,0 +1,383 @@
+#ifndef SHOC_MODE_KW_H
+#define SHOC_MODE_KW_H
+
+#include "shoc/mode/ecb.h"
+#include <cstring>
+
+namespace shoc {
+
+constexpr byte kw_iv[8]     = { 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6, 0xa6 };
+constexpr byte kwp_aiv[4]   = { 0xa6, 0x59, 0x59, 0xa6 };
+
+/**
+ * @brief XOR step counter into integrity register as 64-bit big endian integer.
+ *
+ * @param a Integrity register, 8 bytes
+ * @param t Step counter
+ */
+constexpr void kw_xor_t(byte *a, uint64_t t)
+{
+    for (int i = 7; t; --i, t >>= 8)
+        a[i] ^= t;
+}
+
+/**
+ * @brief Wrapping function W from RFC 3394, index based variant.
+ *
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param a Integrity register, 8 bytes
+ * @param r Semiblocks to wrap in-place, n * 8 bytes
+ * @param n Number of semiblocks, at least 2
+ */
+template<class E>
+constexpr void kw_wrap_blocks(E &ciph, byte *a, byte *r, size_t n)
+{
+    byte b[16];
+
+    copy(b, a, 8);
+
+    for (uint64_t j = 0, t = 1; j < 6; ++j) {
+        for (size_t i = 0; i < n; ++i, ++t) {
+            copy(b + 8, r + i * 8, 8);
+            ciph.encrypt(b, b);
+            kw_xor_t(b, t);
+            copy(r + i * 8, b + 8, 8);
+        }
+    }
+    copy(a, b, 8);
+    zero(b, sizeof(b));
+}
+
+/**
+ * @brief Unwrapping function W^-1 from RFC 3394, index based variant.
+ *
+ * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param a Integrity register, 8 bytes
+ * @param r Semiblocks to unwrap in-place, n * 8 bytes
+ * @param n Number of semiblocks, at least 2
+ */
+template<class E>
+constexpr void kw_unwrap_blocks(E &ciph, byte *a, byte *r, size_t n)
+{
+    byte b[16];
+
+    copy(b, a, 8);
+
+    for (uint64_t t = 6 * n; t; --t) {
+        auto ri = r + (t - 1) % n * 8;
+        kw_xor_t(b, t);
+        copy(b + 8, ri, 8);
+        ciph.decrypt(b, b);
+        copy(ri, b + 8, 8);
+    }
+    copy(a, b, 8);
+    zero(b, sizeof(b));
+}
+
+/**
+ * @brief AES Key Wrap (RFC 3394) and Key Wrap with Padding (RFC 5649) with
+ * reusable key-encryption key, so that wrapping and unwrapping of each key
+ * involves no key expansion.
+ *
+ * @tparam E Block cipher
+ */
+template<class E>
+class kw_context {
+    static constexpr size_t B = 8; // Keys per batch
+public:
+    kw_context() = default;
+    kw_context(span_i<E::key_size> kek) { init(kek); }
+    ~kw_context() { deinit(); }
+public:
+    void init(span_i<E::key_size> kek);
+    void deinit();
+    bool wrap(const byte *in, size_t len, byte *out);
+    bool unwrap(const byte *in, size_t len, byte *out);
+    bool wrap_pad(const byte *in, size_t len, byte *out);
+    bool unwrap_pad(const byte *in, size_t len, byte *out, size_t *out_len);
+    bool unwrap_batch(std::span<const span_i<>> in, std::span<const span_o<>> out, bool *ok = nullptr);
+private:
+    E ciph;
+};
+
+template<class E>
+void kw_context<E>::init(span_i<E::key_size> kek)
+{
+    ciph.init(kek);
+}
+
+template<class E>
+void kw_context<E>::deinit()
+{
+    ciph.deinit();
+}
+
+/**
+ * @brief Wrap key. Output may be the same array as input.
+ *
+ * @param in Key data
+ * @param len Key length, multiple of 8 and at least 16
+ * @param out Wrapped key, len + 8 bytes
+ * @return true on success, false if length is invalid
+ */
+template<class E>
+bool kw_context<E>::wrap(const byte *in, size_t len, byte *out)
+{
+    if (len < 16 || len % 8)
+        return false;
+
+    std::memmove(out + 8, in, len);
+    copy(out, kw_iv, 8);
+    kw_wrap_blocks(ciph, out, out + 8, len / 8);
+
+    return true;
+}
+
+/**
+ * @brief Unwrap key and check its integrity. Output may be the same array
+ * as input. On failure output is zeroed.
+ *
+ * @param in Wrapped key
+ * @param len Wrapped key length, multiple of 8 and at least 24
+ * @param out Key data, len - 8 bytes
+ * @return true on success, false if length is invalid or integrity check failed
+ */
+template<class E>
+bool kw_context<E>::unwrap(const byte *in, size_t len, byte *out)
+{
+    if (len < 24 || len % 8)
+        return false;
+
+    byte a[8];
+
+    copy(a, in, 8);
+    std::memmove(out, in + 8, len - 8);
+    kw_unwrap_blocks(ciph, a, out, len / 8 - 1);
+
+    if (memcmp(a, kw_iv, 8)) {
+        zero(out, len - 8);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Wrap key of arbitrary length with padding. Output may be the same
+ * array as input, if it has room for padded output.
+ *
+ * @param in Key data
+ * @param len Key length, from 1 to 2^32 - 1
+ * @param out Wrapped key, padded length rounded up to multiple of 8 plus 8 bytes
+ * @return true on success, false if length is invalid
+ */
+template<class E>
+bool kw_context<E>::wrap_pad(const byte *in, size_t len, byte *out)
+{
+    if (!len || len > 0xffffffff)
+        return false;
+
+    size_t padded = (len + 7) & ~size_t(7);
+
+    std::memmove(out + 8, in, len);
+    zero(out + 8 + len, padded - len);
+    copy(out, kwp_aiv, 4);
+    putbe(uint32_t(len), out + 4);
+
+    if (padded == 8)
+        ciph.encrypt(span_i<16>{out, 16}, span_o<16>{out, 16});
+    else
+        kw_wrap_blocks(ciph, out, out + 8, padded / 8);
+
+    return true;
+}
+
+/**
+ * @brief Unwrap key with padding and check its integrity. Output may be the
+ * same array as input. On failure output is zeroed.
+ *
+ * @param in Wrapped key
+ * @param len Wrapped key length, multiple of 8 and at least 16
+ * @param out Key data, room for len - 8 bytes
+ * @param out_len Actual key length
+ * @return true on success, false if length is invalid or integrity check failed
+ */
+template<class E>
+bool kw_context<E>::unwrap_pad(const byte *in, size_t len, byte *out, size_t *out_len)
+{
+    if (len < 16 || len % 8)
+        return false;
+
+    byte a[16];
+    size_t n = len / 8 - 1;
+
+    if (n == 1) {
+        ciph.decrypt(span_i<16>{in, 16}, a);
+        copy(out, a + 8, 8);
+    } else {
+        copy(a, in, 8);
+        std::memmove(out, in + 8, len - 8);
+        kw_unwrap_blocks(ciph, a, out, n);
+    }
+    size_t mli = size_t(a[4]) << 24 | size_t(a[5]) << 16 | size_t(a[6]) << 8 | a[7];
+    bool valid = !memcmp(a, kwp_aiv, 4) && mli > 8 * (n - 1) && mli <= 8 * n;
+
+    for (size_t i = mli; valid && i < 8 * n; ++i)
+        valid = !out[i];
+
+    zero(a, sizeof(a));
+
+    if (!valid) {
+        zero(out, len - 8);
+        return false;
+    }
+    *out_len = mli;
+    return true;
+}
+
+/**
+ * @brief Unwrap many keys under the same key-encryption key. Up to 8 keys
+ * are unwrapped in lockstep, so that their steps are passed to ecb_process(...)
+ * as a single batch. A lane is refilled with the next key as soon as the
+ * previous one finishes, so keys may have different lengths. Each output may
+ * be the same array as corresponding input, failed outputs are zeroed.
+ *
+ * @param in Wrapped keys, each multiple of 8 and at least 24 bytes
+ * @param out Key data, each at least input length - 8 bytes
+ * @param ok Optional per key result, in.size() entries
+ * @return true if all keys are unwrapped successfully, false otherwise
+ */
+template<class E>
+bool kw_context<E>::unwrap_batch(std::span<const span_i<>> in, std::span<const span_o<>> out, bool *ok)
+{
+    assert(in.size() == out.size());
+
+    byte b[B * 16];
+    size_t idx[B];
+    size_t num[B];
+    uint64_t t[B];
+    size_t next = 0;
+    size_t n = 0;
+    bool all = true;
+
+    for (;;) {
+        for (; n < B && next < in.size(); ++next) {
+            auto c = in[next];
+            auto p = out[next];
+            if (c.size() < 24 || c.size() % 8 || p.size() < c.size() - 8) {
+                if (ok)
+                    ok[next] = false;
+                all = false;
+                continue;
+            }
+            idx[n] = next;
+            num[n] = c.size() / 8 - 1;
+            t[n] = 6 * num[n];
+            copy(b + n * 16, c.data(), 8);
+            std::memmove(p.data(), c.data() + 8, c.size() - 8);
+            ++n;
+        }
+        if (!n)
+            break;
+
+        for (size_t k = 0; k < n; ++k) {
+            kw_xor_t(b + k * 16, t[k]);
+            copy(b + k * 16 + 8, out[idx[k]].data() + (t[k] - 1) % num[k] * 8, 8);
+        }
+        ecb_process<direction::decrypt>(ciph, span_i<>{b, n * 16}, span_o<>{b, n * 16});
+
+        for (size_t k = n; k--;) {
+            auto r = out[idx[k]].data();
+            copy(r + (t[k] - 1) % num[k] * 8, b + k * 16 + 8, 8);
+            if (--t[k])
+                continue;
+
+            bool valid = !memcmp(b + k * 16, kw_iv, 8);
+            if (!valid)
+                zero(r, num[k] * 8);
+            if (ok)
+                ok[idx[k]] = valid;
+            all &= valid;
+
+            if (k != --n) {
+                copy(b + k * 16, b + n * 16, 8);
+                idx[k] = idx[n];
+                num[k] = num[n];
+                t[k] = t[n];
+            }
+        }
+    }
+    zero(b, sizeof(b));
+
+    return all;
+}
+
+/**
+ * @brief Wrap key with AES Key Wrap (RFC 3394).
+ *
+ * @tparam E Block cipher
+ * @param kek Key-encryption key
+ * @param in Key data
+ * @param len Key length, multiple of 8 and at least 16
+ * @param out Wrapped key, len + 8 bytes
+ * @return true on success, false if length is invalid
+ */
+template<class E>
+inline bool kw_wrap(span_i<E::key_size> kek, const byte *in, size_t len, byte *out)
+{
+    return kw_context<E>{kek}.wrap(in, len, out);
+}
+
+/**
+ * @brief Unwrap key with AES Key Wrap (RFC 3394).
+ *
+ * @tparam E Block cipher
+ * @param kek Key-encryption key
+ * @param in Wrapped key
+ * @param len Wrapped key length, multiple of 8 and at least 24
+ * @param out Key data, len - 8 bytes
+ * @return true on success, false if length is invalid or integrity check failed
+ */
+template<class E>
+inline bool kw_unwrap(span_i<E::key_size> kek, const byte *in, size_t len, byte *out)
+{
+    return kw_context<E>{kek}.unwrap(in, len, out);
+}
+
+/**
+ * @brief Wrap key with AES Key Wrap with Padding (RFC 5649).
+ *
+ * @tparam E Block cipher
+ * @param kek Key-encryption key
+ * @param in Key data
+ * @param len Key length, from 1 to 2^32 - 1
+ * @param out Wrapped key, len rounded up to multiple of 8 plus 8 bytes
+ * @return true on success, false if length is invalid
+ */
+template<class E>
+inline bool kwp_wrap(span_i<E::key_size> kek, const byte *in, size_t len, byte *out)
+{
+    return kw_context<E>{kek}.wrap_pad(in, len, out);
+}
+
+/**
+ * @brief Unwrap key with AES Key Wrap with Padding (RFC 5649).
+ *
+ * @tparam E Block cipher
+ * @param kek Key-encryption key
+ * @param in Wrapped key
+ * @param len Wrapped key length, multiple of 8 and at least 16
+ * @param out Key data, room for len - 8 bytes
+ * @param out_len Actual key length
+ * @return true on success, false if length is invalid or integrity check failed
+ */
+template<class E>
+inline bool kwp_unwrap(span_i<E::key_size> kek, const byte *in, size_t len, byte *out, size_t *out_len)
+{
+    return kw_context<E>{kek}.unwrap_pad(in, len, out, out_len);
+}
+
+}
+
+#endif
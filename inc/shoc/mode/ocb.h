@@ -0,0 +1,353 @@
+#ifndef SHOC_MODE_OCB_H
+#define SHOC_MODE_OCB_H
+
+#include "shoc/mode/ecb.h"
+
+namespace shoc {
+
+/**
+ * @brief OCB3 mode context (RFC 7253), holds expanded key and table of 
+ * L_i offsets, which are computed once per key. Every block is processed 
+ * with a single block cipher call and blocks are independent, so main 
+ * loops pass 8 blocks at a time to ecb_process(...).
+ * 
+ * @tparam E Block cipher
+ */
+template<class E>
+class ocb_context {
+    static constexpr size_t B = 8;  // Blocks per batch
+    static constexpr size_t N = 64; // Number of L_i, enough for any block index
+public:
+    ocb_context() = default;
+    ocb_context(span_i<E::key_size> key) { init(key); }
+    ~ocb_context() { deinit(); }
+public:
+    void init(span_i<E::key_size> key);
+    void deinit();
+    bool encrypt(
+        const byte *nonce,  size_t nonce_len,
+        const byte *aad,    size_t aad_len,
+              byte *tag,    size_t tag_len,
+        const byte *in,
+              byte *out,    size_t len);
+    bool decrypt(
+        const byte *nonce,  size_t nonce_len,
+        const byte *aad,    size_t aad_len,
+        const byte *tag,    size_t tag_len,
+        const byte *in,
+              byte *out,    size_t len);
+private:
+    void hash(const byte *aad, size_t len, byte *sum);
+    void offset(const byte *nonce, size_t nonce_len, size_t tag_len, byte *off);
+    template<direction D>
+    void crypt(byte *off, byte *sum, const byte *in, byte *out, size_t len);
+    void offsets(byte *off, size_t idx, byte *out, size_t n) const;
+private:
+    E ciph;
+    byte l_star[16] = {};
+    byte l_dollar[16] = {};
+    byte l[N][16] = {};
+};
+
+template<class E>
+void ocb_context<E>::init(span_i<E::key_size> key)
+{
+    ciph.init(key);
+
+    zero(l_star, 16);
+    ciph.encrypt(l_star, l_star);
+
+    copy(l_dollar, l_star, 16);
+    dbl(l_dollar);
+
+    copy(l[0], l_dollar, 16);
+    dbl(l[0]);
+
+    for (size_t i = 1; i < N; ++i) {
+        copy(l[i], l[i - 1], 16);
+        dbl(l[i]);
+    }
+}
+
+template<class E>
+void ocb_context<E>::deinit()
+{
+    ciph.deinit();
+    zero(l_star, sizeof(l_star));
+    zero(l_dollar, sizeof(l_dollar));
+    zero(l, sizeof(l));
+}
+
+/**
+ * @brief Encrypt with block cipher in OCB3 mode. All pointers MUST be valid when 
+ * relevant length is not 0. Input and output may be the same array.
+ * 
+ * @param nonce Nonce
+ * @param nonce_len Nonce length, from 1 to 15
+ * @param aad Additional authenticated data
+ * @param aad_len Additional authenticated data length
+ * @param tag Output tag
+ * @param tag_len Output tag desired length, from 1 to 16
+ * @param in Plain text
+ * @param out Cipher text
+ * @param len Text length
+ * @return true on success, false if nonce or tag length is invalid
+ */
+template<class E>
+bool ocb_context<E>::encrypt(
+    const byte *nonce,  size_t nonce_len,
+    const byte *aad,    size_t aad_len,
+          byte *tag,    size_t tag_len,
+    const byte *in,
+          byte *out,    size_t len)
+{
+    if (nonce_len < 1 || nonce_len > 15 || 
+        tag_len < 1   || tag_len > 16)
+        return false;
+
+    byte off[16];
+    byte sum[16] = {};
+    byte hsh[16] = {};
+
+    offset(nonce, nonce_len, tag_len, off);
+    crypt<direction::encrypt>(off, sum, in, out, len);
+    hash(aad, aad_len, hsh);
+    xorb(sum, off);
+    xorb(sum, l_dollar);
+    ciph.encrypt(sum, sum);
+    xorb(sum, hsh);
+    copy(tag, sum, tag_len);
+
+    zero(off, sizeof(off));
+    zero(sum, sizeof(sum));
+
+    return true;
+}
+
+/**
+ * @brief Decrypt with block cipher in OCB3 mode. All pointers MUST be valid when 
+ * relevant length is not 0. Input and output may be the same array.
+ * 
+ * @param nonce Nonce
+ * @param nonce_len Nonce length, from 1 to 15
+ * @param aad Additional authenticated data
+ * @param aad_len Additional authenticated data length
+ * @param tag Input tag
+ * @param tag_len Input tag length, from 1 to 16
+ * @param in Cipher text
+ * @param out Plain text
+ * @param len Text length
+ * @return true on success, false if nonce or tag length is invalid or authentication failed
+ */
+template<class E>
+bool ocb_context<E>::decrypt(
+    const byte *nonce,  size_t nonce_len,
+    const byte *aad,    size_t aad_len,
+    const byte *tag,    size_t tag_len,
+    const byte *in,
+          byte *out,    size_t len)
+{
+    if (nonce_len < 1 || nonce_len > 15 || 
+        tag_len < 1   || tag_len > 16)
+        return false;
+
+    byte off[16];
+    byte sum[16] = {};
+    byte hsh[16] = {};
+
+    offset(nonce, nonce_len, tag_len, off);
+    crypt<direction::decrypt>(off, sum, in, out, len);
+    hash(aad, aad_len, hsh);
+    xorb(sum, off);
+    xorb(sum, l_dollar);
+    ciph.encrypt(sum, sum);
+    xorb(sum, hsh);
+
+    bool ok = !memcmp(sum, tag, tag_len);
+
+    zero(off, sizeof(off));
+    zero(sum, sizeof(sum));
+
+    if (!ok)
+        zero(out, len);
+    return ok;
+}
+
+/**
+ * @brief Compute n consecutive offsets for blocks starting from index idx + 1, 
+ * i.e. Offset_i = Offset_{i-1} xor L_{ntz(i)}.
+ * 
+ * @param off Current offset, advanced by n blocks
+ * @param idx Index of the last processed block
+ * @param out Output offsets, n * 16 bytes
+ * @param n Number of offsets
+ */
+template<class E>
+void ocb_context<E>::offsets(byte *off, size_t idx, byte *out, size_t n) const
+{
+    for (size_t i = 0; i < n; ++i, out += 16) {
+        xorb(off, l[std::countr_zero(uint64_t(idx + i + 1))]);
+        copy(out, off, 16);
+    }
+}
+
+template<class E>
+void ocb_context<E>::hash(const byte *aad, size_t len, byte *sum)
+{
+    byte off[16] = {};
+    byte buf[B * 16];
+    byte tmp[B * 16];
+    size_t idx = 0;
+
+    while (len >= 16) {
+        size_t n = len / 16 < B ? len / 16 : B;
+        offsets(off, idx, tmp, n);
+        xorb(buf, aad, tmp, n * 16);
+        ecb_process<direction::encrypt>(ciph, span_i<>{buf, n * 16}, span_o<>{buf, n * 16});
+        for (size_t i = 0; i < n; ++i)
+            xorb(sum, buf + i * 16);
+        idx += n;
+        aad += n * 16;
+        len -= n * 16;
+    }
+    if (len) {
+        xorb(off, l_star);
+        zero(buf, 16);
+        copy(buf, aad, len);
+        buf[len] = 0x80;
+        xorb(buf, off);
+        ciph.encrypt(span_i<16>{buf, 16}, span_o<16>{buf, 16});
+        xorb(sum, buf);
+    }
+    zero(buf, sizeof(buf));
+    zero(tmp, sizeof(tmp));
+}
+
+template<class E>
+void ocb_context<E>::offset(const byte *nonce, size_t nonce_len, size_t tag_len, byte *off)
+{
+    byte blk[16] = {};
+    byte stretch[24];
+
+    blk[0] = ((tag_len * 8) % 128) << 1;
+    blk[15 - nonce_len] |= 1;
+    copy(blk + 16 - nonce_len, nonce, nonce_len);
+
+    size_t bottom = blk[15] & 0x3f;
+    blk[15] &= 0xc0;
+
+    ciph.encrypt(blk, span_o<16>{stretch, 16});
+    for (size_t i = 0; i < 8; ++i)
+        stretch[16 + i] = stretch[i] ^ stretch[i + 1];
+
+    size_t shift = bottom & 7;
+    for (size_t i = 0, j = bottom / 8; i < 16; ++i, ++j)
+        off[i] = shift ? (stretch[j] << shift) | (stretch[j + 1] >> (8 - shift)) : stretch[j];
+
+    zero(stretch, sizeof(stretch));
+}
+
+template<class E>
+template<direction D>
+void ocb_context<E>::crypt(byte *off, byte *sum, const byte *in, byte *out, size_t len)
+{
+    byte buf[B * 16];
+    byte tmp[B * 16];
+    size_t idx = 0;
+
+    while (len >= 16) {
+        size_t n = len / 16 < B ? len / 16 : B;
+        offsets(off, idx, tmp, n);
+        xorb(buf, in, tmp, n * 16);
+        if constexpr (D == direction::encrypt)
+            for (size_t i = 0; i < n; ++i)
+                xorb(sum, in + i * 16);
+        ecb_process<D>(ciph, span_i<>{buf, n * 16}, span_o<>{buf, n * 16});
+        xorb(out, buf, tmp, n * 16);
+        if constexpr (D == direction::decrypt)
+            for (size_t i = 0; i < n; ++i)
+                xorb(sum, out + i * 16);
+        idx += n;
+        in  += n * 16;
+        out += n * 16;
+        len -= n * 16;
+    }
+    if (len) {
+        xorb(off, l_star);
+        ciph.encrypt(span_i<16>{off, 16}, span_o<16>{buf, 16});
+        if constexpr (D == direction::encrypt) 
+            xorb(sum, in, len);
+        xorb(out, in, buf, len);
+        if constexpr (D == direction::decrypt) 
+            xorb(sum, out, len);
+        sum[len] ^= 0x80;
+    }
+    zero(buf, sizeof(buf));
+    zero(tmp, sizeof(tmp));
+}
+
+/**
+ * @brief Encrypt with block cipher in OCB3 mode. All pointers MUST be valid when 
+ * relevant length is not 0. Nonce length MUST be from 1 to 15 and tag length 
+ * from 1 to 16: https://www.rfc-editor.org/rfc/rfc7253
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param nonce Nonce
+ * @param nonce_len Nonce length
+ * @param aad Additional authenticated data
+ * @param aad_len Additional authenticated data length
+ * @param tag Output tag
+ * @param tag_len Output tag desired length
+ * @param in Plain text
+ * @param out Cipher text
+ * @param len Text length
+ * @return true on success, false if nonce or tag length is invalid
+ */
+template<class E>
+inline bool ocb_encrypt(
+    span_i<E::key_size> key,
+    const byte *nonce,  size_t nonce_len,
+    const byte *aad,    size_t aad_len,
+          byte *tag,    size_t tag_len,
+    const byte *in,
+          byte *out,    size_t len)
+{
+    ocb_context<E> ctx {key};
+    return ctx.encrypt(nonce, nonce_len, aad, aad_len, tag, tag_len, in, out, len);
+}
+
+/**
+ * @brief Decrypt with block cipher in OCB3 mode. All pointers MUST be valid when 
+ * relevant length is not 0. Nonce length MUST be from 1 to 15 and tag length 
+ * from 1 to 16: https://www.rfc-editor.org/rfc/rfc7253
+ * 
+ * @tparam E Block cipher
+ * @param key Key
+ * @param nonce Nonce
+ * @param nonce_len Nonce length
+ * @param aad Additional authenticated data
+ * @param aad_len Additional authenticated data length
+ * @param tag Input tag
+ * @param tag_len Input tag length
+ * @param in Cipher text
+ * @param out Plain text
+ * @param len Text length
+ * @return true on success, false if nonce or tag length is invalid or authentication failed
+ */
+template<class E>
+inline bool ocb_decrypt(
+    span_i<E::key_size> key,
+    const byte *nonce,  size_t nonce_len,
+    const byte *aad,    size_t aad_len,
+    const byte *tag,    size_t tag_len,
+    const byte *in,
+          byte *out,    size_t len)
+{
+    ocb_context<E> ctx {key};
+    return ctx.decrypt(nonce, nonce_len, aad, aad_len, tag, tag_len, in, out, len);
+}
+
+}
+
+#endif
@@ -6,30 +6,63 @@
 namespace shoc {
 
 /**
- * @brief Encrypt with block cipher in output feedback mode.
+ * @brief Generate keystream in output feedback mode. Keystream doesn't depend on 
+ * data, so it can be produced ahead of time, e.g. on an idle core or before data 
+ * arrives, and later XOR-ed with xorb(...). Consecutive calls continue the same 
+ * keystream as long as every length, except the last one, is multiple of 16. 
  * All pointers MUST be valid.
  * 
  * @tparam E Block cipher
+ * @param ciph Cipher object, must be already initialized
+ * @param reg Feedback register, initially IV, receives last full output block
+ * @param out Keystream output
+ * @param len Keystream length
+ */
+template<class E>
+inline void ofb_keystream(E &ciph, byte *reg, byte *out, size_t len)
+{
+    for (; len >= 16; len -= 16, out += 16) {
+        ciph.encrypt(span_i<16>{reg, 16}, span_o<16>{out, 16});
+        copy(reg, out, 16);
+    }
+    if (len) {
+        byte buf[16];
+        ciph.encrypt(span_i<16>{reg, 16}, buf);
+        copy(out, buf, len);
+        zero(buf, sizeof(buf));
+    }
+}
+
+/**
+ * @brief Encrypt with block cipher in output feedback mode. Keystream is
+ * generated in batches of B blocks and XOR-ed in words. All pointers MUST be valid.
+ * 
+ * @tparam E Block cipher
+ * @tparam B Number of blocks per batch, default is 8
  * @param key Key
  * @param iv Initial vector
  * @param in Plain text
  * @param out Cipher text
  * @param len Text length
  */
-template<class E>
-inline void ofb_encrypt(const byte *key, const byte *iv, const byte *in, byte *out, size_t len)
+template<class E, size_t B = 8>
+inline void ofb_encrypt(span_i<E::key_size> key, const byte *iv, const byte *in, byte *out, size_t len)
 {
     E ciph {key};
 
-    byte buf[16];
-    copy(buf, iv, 16);
+    byte reg[16];
+    byte buf[B * 16];
+    copy(reg, iv, 16);
 
-    for (size_t i = 0; i < len; ++i) {
-        size_t idx = i & 0xf;
-        if (idx == 0) 
-            ciph.encrypt(buf, buf);
-        *out++ = buf[idx] ^ *in++;
+    while (len) {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        ofb_keystream(ciph, reg, buf, n);
+        xorb(out, in, buf, n);
+        in  += n;
+        out += n;
+        len -= n;
     }
+    zero(buf, sizeof(buf));
 }
 
 /**
@@ -44,11 +77,136 @@ inline void ofb_encrypt(const byte *key, const byte *iv, const byte *in, byte *o
  * @param len Text length
  */
 template<class E>
-inline void ofb_decrypt(const byte *key, const byte *iv, const byte *in, byte *out, size_t len)
+inline void ofb_decrypt(span_i<E::key_size> key, const byte *iv, const byte *in, byte *out, size_t len)
 {
     ofb_encrypt<E>(key, iv, in, out, len);
 }
 
+/**
+ * @brief Streaming output feedback mode. Holds expanded key, feedback 
+ * register and unused part of the last keystream block, so data may be 
+ * fed in chunks of any size. Result is identical to ofb_encrypt(...) 
+ * for any chunking.
+ * 
+ * @tparam E Block cipher
+ * @tparam B Number of blocks per batch, default is 8
+ */
+template<class E, size_t B = 8>
+class ofb_context {
+public:
+    ofb_context() = default;
+    ofb_context(span_i<E::key_size> key, const byte *iv) { init(key, iv); }
+    ~ofb_context() { deinit(); }
+public:
+    void init(span_i<E::key_size> key, const byte *iv);
+    void deinit();
+    void update(const byte *in, byte *out, size_t len);
+    void finish();
+private:
+    E ciph;
+    byte reg[16] = {};
+    byte ks[16] = {};
+    size_t idx = 0;
+};
+
+template<class E, size_t B>
+void ofb_context<E, B>::init(span_i<E::key_size> key, const byte *iv)
+{
+    ciph.init(key);
+    copy(reg, iv, 16);
+    idx = 0;
+}
+
+template<class E, size_t B>
+void ofb_context<E, B>::deinit()
+{
+    ciph.deinit();
+    zero(reg, sizeof(reg));
+    zero(ks, sizeof(ks));
+    idx = 0;
+}
+
+/**
+ * @brief Process next chunk of data. Input and output may be the same array.
+ * 
+ * @param in Input data
+ * @param out Output data
+ * @param len Data length
+ */
+template<class E, size_t B>
+void ofb_context<E, B>::update(const byte *in, byte *out, size_t len)
+{
+    if (idx) {
+        size_t n = 16 - idx < len ? 16 - idx : len;
+        xorb(out, in, ks + idx, n);
+        idx = (idx + n) & 0xf;
+        in  += n;
+        out += n;
+        len -= n;
+    }
+    byte buf[B * 16];
+
+    while (len >= 16) {
+        size_t n = len < sizeof(buf) ? len & ~size_t(0xf) : sizeof(buf);
+        ofb_keystream(ciph, reg, buf, n);
+        xorb(out, in, buf, n);
+        in  += n;
+        out += n;
+        len -= n;
+    }
+    zero(buf, sizeof(buf));
+
+    if (len) {
+        ofb_keystream(ciph, reg, ks, 16);
+        xorb(out, in, ks, len);
+        idx = len;
+    }
+}
+
+/**
+ * @brief Finish processing and wipe the context.
+ * 
+ */
+template<class E, size_t B>
+void ofb_context<E, B>::finish()
+{
+    deinit();
+}
+
+/**
+ * @brief Encrypt chain of segments in-place with block cipher in output 
+ * feedback mode. Unused keystream is carried across segment boundaries.
+ * 
+ * @tparam E Block cipher
+ * @tparam B Number of blocks of keystream generated at once, default is 8
+ * @param key Key
+ * @param iv Initial vector
+ * @param data Segments of text
+ */
+template<class E, size_t B = 8>
+inline void ofb_encrypt(span_i<E::key_size> key, const byte *iv, std::span<const span_o<>> data)
+{
+    ofb_context<E, B> ctx {key, iv};
+    for (auto s : data)
+        ctx.update(s.data(), s.data(), s.size());
+}
+
+/**
+ * @brief Decrypt chain of segments in-place with block cipher in output 
+ * feedback mode. Unused keystream is carried across segment boundaries.
+ * 
+ * @tparam E Block cipher
+ * @tparam B Number of blocks of keystream generated at once, default is 8
+ * @param key Key
+ * @param iv Initial vector
+ * @param data Segments of text
+ */
+template<class E, size_t B = 8>
+inline void ofb_decrypt(span_i<E::key_size> key, const byte *iv, std::span<const span_o<>> data)
+{
+    ofb_encrypt<E, B>(key, iv, data);
+}
+
 }
 
-#endif
\ No newline at end of file
+#endif
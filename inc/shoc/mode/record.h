@@ -0,0 +1,164 @@
+#ifndef SHOC_MODE_RECORD_H
+#define SHOC_MODE_RECORD_H
+
+#include "shoc/mode/aead.h"
+
+namespace shoc {
+
+/**
+ * @brief AEAD record layer, which seals and opens records in-place within
+ * a single caller-provided frame laid out as [nonce | cipher text | tag],
+ * so no intermediate buffers or copies are needed per record. Per-record
+ * nonce is base IV XOR-ed with 64-bit big endian sequence number, as in
+ * TLS 1.3. Sender and receiver each keep their own sequence number, opening
+ * accepts only the record with the next expected one.
+ *
+ * @tparam A AEAD context: gcm_context<E>, ccm_context<E, 3> or chacha20_poly1305_context
+ */
+template<class A>
+class record_context {
+public:
+    static constexpr size_t key_size    = A::key_size;
+    static constexpr size_t nonce_size  = 12;
+    static constexpr size_t tag_size    = 16;
+    static constexpr size_t overhead    = nonce_size + tag_size;
+public:
+    record_context() = default;
+    record_context(span_i<key_size> key, const byte *iv, uint64_t seq = 0) { init(key, iv, seq); }
+    ~record_context() { deinit(); }
+public:
+    void init(span_i<key_size> key, const byte *iv, uint64_t seq = 0);
+    void deinit();
+    span_o<> seal(byte *frame, size_t len, span_i<> aad = {});
+    span_o<> seal(const byte *in, size_t len, byte *frame, span_i<> aad = {});
+    span_o<> open(byte *frame, size_t frame_len, span_i<> aad = {});
+    uint64_t sequence() const   { return seq; }
+    static constexpr byte* payload(byte *frame) { return frame + nonce_size; }
+private:
+    void nonce(byte *out) const;
+private:
+    A aead;
+    byte iv[nonce_size] = {};
+    uint64_t seq = 0;
+};
+
+template<class A>
+void record_context<A>::init(span_i<key_size> key, const byte *iv, uint64_t seq)
+{
+    aead.init(key);
+    copy(this->iv, iv, nonce_size);
+    this->seq = seq;
+}
+
+template<class A>
+void record_context<A>::deinit()
+{
+    aead.deinit();
+    zero(iv, sizeof(iv));
+    seq = 0;
+}
+
+/**
+ * @brief Seal record in-place. Plain text MUST be already placed at
+ * payload(frame), i.e. after room for nonce, and frame MUST have room for
+ * len + overhead bytes. Sequence number is incremented.
+ *
+ * @param frame Frame buffer
+ * @param len Plain text length
+ * @param aad Additional authenticated data, e.g. record header
+ * @return Span over the whole frame, or empty span with nullptr data if
+ * sequence numbers are exhausted or AEAD rejects the length, e.g. CCM
+ * record of 2^24 bytes or more
+ */
+template<class A>
+span_o<> record_context<A>::seal(byte *frame, size_t len, span_i<> aad)
+{
+    return seal(frame + nonce_size, len, frame, aad);
+}
+
+/**
+ * @brief Seal record, encrypting plain text directly into the frame. Input
+ * may be payload(frame). Frame MUST have room for len + overhead bytes.
+ * Sequence number is incremented.
+ *
+ * @param in Plain text
+ * @param len Plain text length
+ * @param frame Frame buffer
+ * @param aad Additional authenticated data, e.g. record header
+ * @return Span over the whole frame, or empty span with nullptr data if
+ * sequence numbers are exhausted or AEAD rejects the length, e.g. CCM
+ * record of 2^24 bytes or more
+ */
+template<class A>
+span_o<> record_context<A>::seal(const byte *in, size_t len, byte *frame, span_i<> aad)
+{
+    if (seq == UINT64_MAX)
+        return {};
+
+    nonce(frame);
+
+    if (!impl::aead::start(aead, frame, aad.size(), len, direction::encrypt))
+        return {};
+
+    aead.aad(aad.data(), aad.size());
+    aead.update(in, frame + nonce_size, len);
+    impl::aead::finish(aead, frame + nonce_size + len);
+    ++seq;
+
+    return {frame, len + overhead};
+}
+
+/**
+ * @brief Open record in-place. Nonce in the frame MUST match the next
+ * expected sequence number, so reordered and replayed records are rejected.
+ * On success sequence number is incremented, on failure payload is zeroed.
+ *
+ * @param frame Frame buffer
+ * @param frame_len Frame length, including nonce and tag
+ * @param aad Additional authenticated data, e.g. record header
+ * @return Span over plain text within the frame, or empty span with
+ * nullptr data if frame is invalid, AEAD rejects the length or
+ * authentication failed
+ */
+template<class A>
+span_o<> record_context<A>::open(byte *frame, size_t frame_len, span_i<> aad)
+{
+    byte n[nonce_size];
+
+    if (frame_len < overhead || seq == UINT64_MAX)
+        return {};
+
+    nonce(n);
+
+    if (memcmp(n, frame, nonce_size))
+        return {};
+
+    auto p = frame + nonce_size;
+    auto len = frame_len - overhead;
+
+    if (!impl::aead::start(aead, frame, aad.size(), len, direction::decrypt))
+        return {};
+
+    aead.aad(aad.data(), aad.size());
+    aead.update(p, p, len);
+
+    if (!impl::aead::verify(aead, p + len)) {
+        zero(p, len);
+        return {};
+    }
+    ++seq;
+
+    return {p, len};
+}
+
+template<class A>
+void record_context<A>::nonce(byte *out) const
+{
+    copy(out, iv, nonce_size);
+    for (int i = 0; i < 8; ++i)
+        out[nonce_size - 1 - i] ^= byte(seq >> (i * 8));
+}
+
+}
+
+#endif
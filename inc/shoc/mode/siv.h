@@ -0,0 +1,316 @@
+#ifndef SHOC_MODE_SIV_H
+#define SHOC_MODE_SIV_H
+
+#include "shoc/mac/cmac.h"
+#include "shoc/mode/ctr.h"
+#include <cstring>
+
+namespace shoc {
+
+/**
+ * @brief Synthetic initialization vector deterministic AEAD (RFC 5297).
+ * Key is MAC key for S2V followed by CTR key. Output of encryption is
+ * synthetic IV followed by cipher text, so the same plain text and
+ * associated data always give the same output. Nonce, if any, is passed
+ * as the last associated data component.
+ *
+ * @tparam E Block cipher
+ */
+template<class E>
+class siv_context {
+    static constexpr size_t B = 8; // Components or messages per batch
+public:
+    static constexpr size_t key_size = 2 * E::key_size;
+public:
+    siv_context() = default;
+    siv_context(span_i<key_size> key) { init(key); }
+    ~siv_context() { deinit(); }
+public:
+    void init(span_i<key_size> key);
+    void deinit();
+    void encrypt(std::span<const span_i<>> aad, const byte *in, byte *out, size_t len);
+    bool decrypt(std::span<const span_i<>> aad, const byte *in, byte *out, size_t len);
+    void encrypt_batch(std::span<const span_i<>> aad, std::span<const span_i<>> in, std::span<const span_o<>> out);
+private:
+    void s2v_aad(std::span<const span_i<>> aad, byte *d);
+    void s2v(std::span<const span_i<>> aad, const byte *in, size_t len, byte *v);
+    static void siv_ctr(const byte *v, byte *q);
+private:
+    cmac_context<E> mac;
+    E ciph;
+};
+
+template<class E>
+void siv_context<E>::init(span_i<key_size> key)
+{
+    mac.init(key.template first<E::key_size>());
+    ciph.init(key.template last<E::key_size>());
+}
+
+template<class E>
+void siv_context<E>::deinit()
+{
+    mac.deinit();
+    ciph.deinit();
+}
+
+/**
+ * @brief Encrypt. Input may be out + 16, i.e. plain text may be already
+ * placed after room for synthetic IV.
+ *
+ * @param aad Associated data components, at most 126
+ * @param in Plain text
+ * @param out Synthetic IV followed by cipher text, len + 16 bytes
+ * @param len Plain text length
+ */
+template<class E>
+void siv_context<E>::encrypt(std::span<const span_i<>> aad, const byte *in, byte *out, size_t len)
+{
+    byte q[16];
+
+    s2v(aad, in, len, q);
+    copy(out, q, 16);
+    siv_ctr(q, q);
+    ctrf<E, 8>(q, in, out + 16, len, ciph);
+    zero(q, sizeof(q));
+}
+
+/**
+ * @brief Decrypt and verify. Output may be in + 16. On failure output is zeroed.
+ *
+ * @param aad Associated data components, at most 126
+ * @param in Synthetic IV followed by cipher text
+ * @param out Plain text, len - 16 bytes
+ * @param len Input length, at least 16
+ * @return true on success, false if length is invalid or authentication failed
+ */
+template<class E>
+bool siv_context<E>::decrypt(std::span<const span_i<>> aad, const byte *in, byte *out, size_t len)
+{
+    if (len < 16)
+        return false;
+
+    byte v[16];
+    byte q[16];
+
+    copy(v, in, 16);
+    siv_ctr(v, q);
+    ctrf<E, 8>(q, in + 16, out, len - 16, ciph);
+    s2v(aad, out, len - 16, q);
+
+    bool valid = !memcmp(q, v, 16);
+    if (!valid)
+        zero(out, len - 16);
+    zero(q, sizeof(q));
+
+    return valid;
+}
+
+/**
+ * @brief Encrypt many short messages under the same associated data, which
+ * is typical for deterministic encryption of index keys. Associated data
+ * part of S2V is computed once. Then up to 8 messages at a time have their
+ * final CMAC passes interleaved with cmac_context::batch(...) and all their
+ * keystream blocks gathered into a single ecb_process(...) call. Input and
+ * output MUST NOT overlap.
+ *
+ * @param aad Associated data components, common for all messages, at most 126
+ * @param in Plain texts
+ * @param out Synthetic IV followed by cipher text, each in[i].size() + 16 bytes
+ */
+template<class E>
+void siv_context<E>::encrypt_batch(std::span<const span_i<>> aad, std::span<const span_i<>> in, std::span<const span_o<>> out)
+{
+    assert(in.size() == out.size());
+
+    byte d[16];
+    byte dd[16];
+    byte tags[B * 16];
+    byte ks[B * 16];
+    span_i<> t[B];
+    const byte *src[B];
+    byte *dst[B];
+    size_t num[B];
+    size_t n = 0;
+
+    auto flush = [&] {
+        ecb_process<direction::encrypt>(ciph, span_i<>{ks, n * 16}, span_o<>{ks, n * 16});
+        for (size_t j = 0; j < n; ++j)
+            xorb(dst[j], src[j], ks + j * 16, num[j]);
+        n = 0;
+    };
+
+    s2v_aad(aad, d);
+    copy(dd, d, 16);
+    dbl(dd);
+
+    for (size_t g = 0; g < in.size(); g += B) {
+        size_t m = std::min(B, in.size() - g);
+
+        for (size_t k = 0; k < m; ++k) {
+            auto p = in[g + k];
+            auto o = out[g + k].data();
+            assert(out[g + k].size() >= p.size() + 16);
+            if (p.size() >= 16) {
+                copy(o + 16, p.data(), p.size());
+                xorb(o + p.size(), d);
+                t[k] = span_i<>{o + 16, p.size()};
+            } else {
+                xorb(o, dd, p.data(), p.size());
+                copy(o + p.size(), dd + p.size(), 16 - p.size());
+                o[p.size()] ^= 0x80;
+                t[k] = span_i<>{o, 16};
+            }
+        }
+        mac.batch(std::span<const span_i<>>{t, m}, span_o<>{tags, m * 16});
+
+        for (size_t k = 0; k < m; ++k) {
+            auto p = in[g + k];
+            auto o = out[g + k].data();
+            copy(o, tags + k * 16, 16);
+            siv_ctr(o, tags + k * 16);
+            for (size_t pos = 0; pos < p.size(); pos += 16) {
+                copy(ks + n * 16, tags + k * 16, 16);
+                incc<8>(tags + k * 16);
+                src[n] = p.data() + pos;
+                dst[n] = o + 16 + pos;
+                num[n] = std::min<size_t>(16, p.size() - pos);
+                if (++n == B)
+                    flush();
+            }
+        }
+    }
+    if (n)
+        flush();
+
+    zero(ks, sizeof(ks));
+    zero(tags, sizeof(tags));
+}
+
+/**
+ * @brief S2V over associated data only. CMAC of the zero block and of all
+ * components are independent, so they are computed in batches, then folded
+ * with dbl/xor chain.
+ *
+ * @param aad Associated data components
+ * @param d Output intermediate value, 16 bytes
+ */
+template<class E>
+void siv_context<E>::s2v_aad(std::span<const span_i<>> aad, byte *d)
+{
+    static constexpr byte zeros[16] = {};
+
+    byte tags[B * 16];
+    span_i<> c[B];
+
+    for (size_t i = 0; i <= aad.size(); i += B) {
+        size_t m = std::min(B, aad.size() + 1 - i);
+
+        for (size_t k = 0; k < m; ++k)
+            c[k] = i + k ? aad[i + k - 1] : span_i<>{zeros, 16};
+        mac.batch(std::span<const span_i<>>{c, m}, span_o<>{tags, m * 16});
+
+        for (size_t k = 0; k < m; ++k) {
+            if (i + k) {
+                dbl(d);
+                xorb(d, tags + k * 16);
+            } else {
+                copy(d, tags, 16);
+            }
+        }
+    }
+}
+
+/**
+ * @brief S2V over associated data and plain text as the last component.
+ *
+ * @param aad Associated data components
+ * @param in Plain text
+ * @param len Plain text length
+ * @param v Output synthetic IV, 16 bytes
+ */
+template<class E>
+void siv_context<E>::s2v(std::span<const span_i<>> aad, const byte *in, size_t len, byte *v)
+{
+    byte d[16];
+
+    s2v_aad(aad, d);
+
+    if (len >= 16) {
+        mac.update(in, len - 16);
+        xorb(d, in + len - 16);
+    } else {
+        dbl(d);
+        xorb(d, in, len);
+        d[len] ^= 0x80;
+    }
+    mac.update(d, 16);
+    mac.finish(v);
+    zero(d, sizeof(d));
+}
+
+/**
+ * @brief Derive initial counter block from synthetic IV by clearing
+ * bits 63 and 31, so 64-bit counter never wraps.
+ *
+ * @param v Synthetic IV
+ * @param q Output counter block, may be the same array
+ */
+template<class E>
+void siv_context<E>::siv_ctr(const byte *v, byte *q)
+{
+    copy(q, v, 16);
+    q[8]  &= 0x7f;
+    q[12] &= 0x7f;
+}
+
+/**
+ * @brief Encrypt with block cipher in SIV mode with single associated data component.
+ *
+ * @tparam E Block cipher
+ * @param key MAC key followed by CTR key
+ * @param aad Associated data
+ * @param aad_len Associated data length
+ * @param in Plain text
+ * @param out Synthetic IV followed by cipher text, len + 16 bytes
+ * @param len Plain text length
+ */
+template<class E>
+inline void siv_encrypt(
+    span_i<2 * E::key_size> key,
+    const byte *aad, size_t aad_len,
+    const byte *in,
+          byte *out, size_t len)
+{
+    span_i<> c[] = { {aad, aad_len} };
+    siv_context<E> ctx {key};
+    ctx.encrypt(c, in, out, len);
+}
+
+/**
+ * @brief Decrypt with block cipher in SIV mode with single associated data component.
+ *
+ * @tparam E Block cipher
+ * @param key MAC key followed by CTR key
+ * @param aad Associated data
+ * @param aad_len Associated data length
+ * @param in Synthetic IV followed by cipher text
+ * @param out Plain text, len - 16 bytes
+ * @param len Input length, at least 16
+ * @return true on success, false if length is invalid or authentication failed
+ */
+template<class E>
+inline bool siv_decrypt(
+    span_i<2 * E::key_size> key,
+    const byte *aad, size_t aad_len,
+    const byte *in,
+          byte *out, size_t len)
+{
+    span_i<> c[] = { {aad, aad_len} };
+    siv_context<E> ctx {key};
+    return ctx.decrypt(c, in, out, len);
+}
+
+}
+
+#endif
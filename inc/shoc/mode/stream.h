@@ -0,0 +1,584 @@
+#ifndef SHOC_MODE_STREAM_H
+#define SHOC_MODE_STREAM_H
+
+#include "shoc/mode/aead.h"
+#include "shoc/kdf/hkdf.h"
+#include "shoc/hash/sha2.h"
+#include "shoc/parallel.h"
+#include <atomic>
+#include <vector>
+
+namespace shoc {
+namespace impl::stream {
+
+inline constexpr byte version           = 1;
+inline constexpr size_t params_size     = 7;    // version | aead kind | key size | segment size
+inline constexpr size_t salt_size       = 16;
+inline constexpr size_t prefix_size     = 7;
+inline constexpr size_t seed_size       = salt_size + prefix_size;
+inline constexpr size_t commit_size     = 32;
+inline constexpr size_t header_size     = params_size + seed_size + commit_size;
+inline constexpr size_t tag_size        = 16;
+inline constexpr size_t grain_bytes     = 1 << 16;  // Minimum bytes per thread in parallel mode
+
+inline constexpr char label[] = "shoc segmented stream";
+
+/**
+ * @brief Number of segments for plain text of given length, at least one,
+ * since even empty stream ends with authenticated last segment. 0 if
+ * segment size is invalid.
+ *
+ */
+constexpr uint64_t segments(uint64_t len, uint32_t segment_size)
+{
+    if (!segment_size)
+        return 0;
+    return len ? (len + uint64_t(segment_size) - 1) / segment_size : 1;
+}
+
+/**
+ * @brief Number of segments in stream body of given length, 0 if length
+ * is malformed, i.e. the last segment is shorter than a tag.
+ *
+ */
+constexpr uint64_t body_segments(uint64_t body_len, uint32_t segment_size)
+{
+    const uint64_t cs = uint64_t(segment_size) + tag_size;
+
+    if (!segment_size || !body_len)
+        return 0;
+
+    auto n = (body_len + cs - 1) / cs;
+
+    if (body_len - (n - 1) * cs < tag_size || n - 1 > UINT32_MAX)
+        return 0;
+    return n;
+}
+
+/**
+ * @brief Whether segment size and count fit the format and the AEAD, e.g.
+ * ccm_context<E, 3> takes less than 2^24 bytes per message.
+ *
+ */
+template<class A>
+constexpr bool valid(uint32_t segment_size, uint64_t segments)
+{
+    return segment_size &&
+        segment_size <= UINT32_MAX - tag_size &&
+        segment_size <= A::max_msg_len &&
+        segments - 1 <= UINT32_MAX;
+}
+
+/**
+ * @brief Derive key commitment and segment key from master key with
+ * HKDF-SHA256. Salt comes from header, parameters are bound in info, so
+ * a header can't be replayed with altered segment size or algorithm.
+ *
+ */
+template<class A>
+inline void derive(A &ctx, span_i<> key, const byte *header, byte *commit)
+{
+    byte info[params_size + sizeof(label) - 1];
+    byte okm[commit_size + A::key_size];
+
+    copy(info, header, params_size);
+    copy(info + params_size, label, sizeof(label) - 1);
+    hkdf<Sha2<SHA_256>>(okm, sizeof(okm), key.data(), key.size(), header + params_size, salt_size, info, sizeof(info));
+    copy(commit, okm, commit_size);
+    ctx.init(span_i<A::key_size>{okm + commit_size, A::key_size});
+    zero(okm, sizeof(okm));
+}
+
+template<class A>
+inline bool setup(A &ctx, span_i<> key, span_i<seed_size> seed, uint32_t segment_size, byte *header)
+{
+    if (!valid<A>(segment_size, 1))
+        return false;
+
+    header[0] = version;
+    header[1] = aead::kind<A>;
+    header[2] = A::key_size;
+    putbe(segment_size, header + 3);
+    copy(header + params_size, seed.data(), seed_size);
+    derive(ctx, key, header, header + params_size + seed_size);
+
+    return true;
+}
+
+template<class A>
+inline bool parse(A &ctx, span_i<> key, const byte *header, uint32_t &segment_size)
+{
+    byte commit[commit_size];
+
+    if (header[0] != version || header[1] != aead::kind<A> || header[2] != A::key_size)
+        return false;
+
+    segment_size = uint32_t(header[3]) << 24 | uint32_t(header[4]) << 16 | uint32_t(header[5]) << 8 | header[6];
+
+    if (!valid<A>(segment_size, 1))
+        return false;
+
+    derive(ctx, key, header, commit);
+    bool ok = !memcmp(commit, header + params_size + seed_size, commit_size);
+    zero(commit, sizeof(commit));
+
+    if (!ok)
+        ctx.deinit();
+    return ok;
+}
+
+inline void nonce(byte *out, const byte *prefix, uint32_t idx, bool last)
+{
+    copy(out, prefix, prefix_size);
+    putbe(idx, out + prefix_size);
+    out[11] = last;
+}
+
+template<class A>
+inline void seal(A &ctx, const byte *prefix, uint32_t idx, bool last, const byte *in, size_t len, byte *out)
+{
+    byte n[12];
+    nonce(n, prefix, idx, last);
+    aead::start(ctx, n, 0, len, direction::encrypt);
+    ctx.update(in, out, len);
+    aead::finish(ctx, out + len);
+}
+
+template<class A>
+inline bool open(A &ctx, const byte *prefix, uint32_t idx, bool last, const byte *in, size_t len, byte *out)
+{
+    byte n[12];
+    nonce(n, prefix, idx, last);
+    aead::start(ctx, n, 0, len, direction::decrypt);
+    ctx.update(in, out, len);
+
+    if (!aead::verify(ctx, in + len)) {
+        zero(out, len);
+        return false;
+    }
+    return true;
+}
+
+}
+
+/**
+ * @brief Length of a whole segmented stream for plain text of given length.
+ *
+ * @param len Plain text length
+ * @param segment_size Plain text bytes per segment
+ * @return Header plus all segments with their tags
+ */
+constexpr uint64_t stream_size(uint64_t len, uint32_t segment_size)
+{
+    return impl::stream::header_size + len + impl::stream::segments(len, segment_size) * impl::stream::tag_size;
+}
+
+/**
+ * @brief Sequential writer of segmented AEAD stream, laid out as
+ * [header | segment 0 | ... | segment n-1], where every segment is
+ * [cipher text | tag] with segment_size bytes of plain text, except the last
+ * one, which may be shorter or even empty. Header holds parameters, random
+ * seed and key commitment. Segment key is derived from master key and salt,
+ * segment nonce is [prefix | 32-bit big endian index | last flag], so
+ * segments can't be reordered, dropped or truncated unnoticed.
+ *
+ * @tparam A AEAD context: gcm_context<E>, ccm_context<E, 3> or chacha20_poly1305_context
+ */
+template<class A>
+class stream_writer {
+public:
+    static constexpr size_t header_size = impl::stream::header_size;
+    static constexpr size_t seed_size   = impl::stream::seed_size;
+    static constexpr size_t tag_size    = impl::stream::tag_size;
+public:
+    stream_writer() = default;
+    ~stream_writer() { deinit(); }
+public:
+    bool init(span_i<> key, span_i<seed_size> seed, uint32_t segment_size, byte *header);
+    void deinit();
+    size_t update(const byte *in, size_t len, byte *out);
+    size_t finish(byte *out);
+    uint32_t segment_size() const   { return seg; }
+private:
+    bool seal(const byte *in, size_t len, bool last, byte *out);
+private:
+    A aead;
+    std::vector<byte> buf;
+    byte prefix[impl::stream::prefix_size] = {};
+    uint64_t idx = 0;
+    size_t buf_idx = 0;
+    uint32_t seg = 0;
+    bool failed = false;
+};
+
+/**
+ * @brief Start new stream and output its header.
+ *
+ * @param key Master key, any length, e.g. 32 bytes
+ * @param seed Random bytes, MUST be unique per stream under the same key
+ * @param segment_size Plain text bytes per segment, not 0 and at most A::max_msg_len
+ * @param header Output header, header_size bytes
+ * @return true on success, false if segment size is invalid
+ */
+template<class A>
+bool stream_writer<A>::init(span_i<> key, span_i<seed_size> seed, uint32_t segment_size, byte *header)
+{
+    if (!impl::stream::setup(aead, key, seed, segment_size, header))
+        return false;
+
+    copy(prefix, seed.data() + impl::stream::salt_size, sizeof(prefix));
+    buf.resize(segment_size);
+    seg     = segment_size;
+    idx     = 0;
+    buf_idx = 0;
+    failed  = false;
+
+    return true;
+}
+
+template<class A>
+void stream_writer<A>::deinit()
+{
+    aead.deinit();
+    zero(buf.data(), buf.size());
+    zero(prefix, sizeof(prefix));
+    idx = buf_idx = 0;
+}
+
+/**
+ * @brief Feed next chunk of plain text and output all segments completed
+ * by it. Full segments are encrypted directly from input, only the tail is
+ * buffered. Last full segment is held back until more data comes or
+ * finish(), since it may turn out to be the last one. Output MUST have room
+ * for (len / segment_size + 1) * (segment_size + tag_size) bytes.
+ *
+ * @param in Plain text chunk
+ * @param len Chunk length
+ * @param out Output segments
+ * @return Number of bytes written to output
+ */
+template<class A>
+size_t stream_writer<A>::update(const byte *in, size_t len, byte *out)
+{
+    size_t written = 0;
+
+    if (buf_idx) {
+        size_t n = seg - buf_idx < len ? seg - buf_idx : len;
+        copy(&buf[buf_idx], in, n);
+        buf_idx += n;
+        in  += n;
+        len -= n;
+        if (buf_idx < seg || !len || !seal(buf.data(), seg, false, out))
+            return 0;
+        written += seg + tag_size;
+        buf_idx = 0;
+    }
+    for (; len > seg; in += seg, len -= seg) {
+        if (!seal(in, seg, false, out + written))
+            return written;
+        written += seg + tag_size;
+    }
+    copy(buf.data(), in, len);
+    buf_idx = len;
+
+    return written;
+}
+
+/**
+ * @brief Output the last segment, which is always present. Output MUST
+ * have room for segment_size + tag_size bytes.
+ *
+ * @param out Output segment
+ * @return Number of bytes written, 0 if stream exceeded 2^32 segments, in
+ * which case whole stream MUST be discarded
+ */
+template<class A>
+size_t stream_writer<A>::finish(byte *out)
+{
+    if (!seal(buf.data(), buf_idx, true, out))
+        return 0;
+
+    size_t written = buf_idx + tag_size;
+    zero(buf.data(), buf.size());
+    buf_idx = 0;
+
+    return written;
+}
+
+template<class A>
+bool stream_writer<A>::seal(const byte *in, size_t len, bool last, byte *out)
+{
+    if (failed || idx > UINT32_MAX || (!last && idx == UINT32_MAX)) {
+        failed = true;
+        return false;
+    }
+    impl::stream::seal(aead, prefix, uint32_t(idx++), last, in, len, out);
+    return true;
+}
+
+/**
+ * @brief Random-access reader of segmented AEAD stream. Any range of plain
+ * text can be decrypted by authenticating only the segments covering it.
+ *
+ * @tparam A AEAD context: gcm_context<E>, ccm_context<E, 3> or chacha20_poly1305_context
+ */
+template<class A>
+class stream_reader {
+public:
+    static constexpr size_t header_size = impl::stream::header_size;
+    static constexpr size_t tag_size    = impl::stream::tag_size;
+public:
+    stream_reader() = default;
+    ~stream_reader() { deinit(); }
+public:
+    bool init(span_i<> key, const byte *header);
+    void deinit();
+    bool open(uint64_t index, bool last, const byte *in, size_t len, byte *out);
+    bool read(const byte *body, uint64_t body_len, uint64_t offset, byte *out, size_t len);
+    uint64_t segments(uint64_t body_len) const;
+    uint64_t plaintext_size(uint64_t body_len) const;
+    uint32_t segment_size() const   { return seg; }
+private:
+    A aead;
+    std::vector<byte> buf;
+    byte prefix[impl::stream::prefix_size] = {};
+    uint32_t seg = 0;
+};
+
+/**
+ * @brief Parse stream header and check key commitment.
+ *
+ * @param key Master key
+ * @param header Stream header, header_size bytes
+ * @return true on success, false if header is malformed, made for another
+ * AEAD or under another key
+ */
+template<class A>
+bool stream_reader<A>::init(span_i<> key, const byte *header)
+{
+    if (!impl::stream::parse(aead, key, header, seg))
+        return false;
+
+    copy(prefix, header + impl::stream::params_size + impl::stream::salt_size, sizeof(prefix));
+    buf.resize(seg);
+
+    return true;
+}
+
+template<class A>
+void stream_reader<A>::deinit()
+{
+    aead.deinit();
+    zero(buf.data(), buf.size());
+    zero(prefix, sizeof(prefix));
+    seg = 0;
+}
+
+/**
+ * @brief Decrypt single segment, e.g. read from file at offset
+ * header_size + index * (segment_size + tag_size). Input and output may
+ * be the same array. On failure output is zeroed.
+ *
+ * @param index Segment index
+ * @param last Whether this is the last segment of the stream
+ * @param in Segment, cipher text followed by tag
+ * @param len Segment length, including tag
+ * @param out Plain text, len - tag_size bytes
+ * @return true on success, false if authentication failed
+ */
+template<class A>
+bool stream_reader<A>::open(uint64_t index, bool last, const byte *in, size_t len, byte *out)
+{
+    if (len < tag_size || len - tag_size > seg || (!last && len - tag_size != seg) || index > UINT32_MAX)
+        return false;
+
+    return impl::stream::open(aead, prefix, uint32_t(index), last, in, len - tag_size, out);
+}
+
+/**
+ * @brief Decrypt range of plain text from stream body in memory, e.g.
+ * mapped file. Only segments covering the range are authenticated,
+ * segments fully inside the range are decrypted directly into output,
+ * so truncation of the stream is detected only by a range reaching its end.
+ * On failure output is zeroed.
+ *
+ * @param body Stream body, i.e. everything after header
+ * @param body_len Body length
+ * @param offset Offset in plain text
+ * @param out Plain text
+ * @param len Range length
+ * @return true on success, false if range is out of bounds, body is
+ * malformed or authentication failed
+ */
+template<class A>
+bool stream_reader<A>::read(const byte *body, uint64_t body_len, uint64_t offset, byte *out, size_t len)
+{
+    auto n = segments(body_len);
+    auto total = plaintext_size(body_len);
+
+    if (!n || offset > total || len > total - offset)
+        return false;
+
+    const uint64_t cs = uint64_t(seg) + tag_size;
+    auto dst = out;
+    auto rest = len;
+    auto i = offset / seg;
+    size_t skip = offset % seg;
+    bool ok = true;
+
+    while (rest && ok) {
+        bool last = i == n - 1;
+        size_t plen = last ? total - i * seg : seg;
+        size_t take = plen - skip < rest ? plen - skip : rest;
+        auto src = body + i * cs;
+
+        if (!skip && take == plen) {
+            ok = impl::stream::open(aead, prefix, uint32_t(i), last, src, plen, dst);
+        } else {
+            ok = impl::stream::open(aead, prefix, uint32_t(i), last, src, plen, buf.data());
+            copy(dst, &buf[skip], take);
+            zero(buf.data(), plen);
+        }
+        dst  += take;
+        rest -= take;
+        skip  = 0;
+        ++i;
+    }
+    if (!ok)
+        zero(out, len);
+    return ok;
+}
+
+/**
+ * @brief Number of segments in stream body of given length.
+ *
+ * @param body_len Body length
+ * @return Number of segments, 0 if length is malformed
+ */
+template<class A>
+uint64_t stream_reader<A>::segments(uint64_t body_len) const
+{
+    return impl::stream::body_segments(body_len, seg);
+}
+
+/**
+ * @brief Plain text length of stream body of given length.
+ *
+ * @param body_len Body length
+ * @return Plain text length, 0 if length is malformed
+ */
+template<class A>
+uint64_t stream_reader<A>::plaintext_size(uint64_t body_len) const
+{
+    auto n = segments(body_len);
+    return n ? body_len - n * tag_size : 0;
+}
+
+/**
+ * @brief Encrypt whole plain text into segmented AEAD stream, spreading
+ * segments across threads. Output is identical to stream_writer.
+ *
+ * @tparam A AEAD context: gcm_context<E>, ccm_context<E, 3> or chacha20_poly1305_context
+ * @param key Master key
+ * @param seed Random bytes, MUST be unique per stream under the same key
+ * @param segment_size Plain text bytes per segment, not 0 and at most A::max_msg_len
+ * @param in Plain text
+ * @param len Plain text length
+ * @param out Output stream, stream_size(len, segment_size) bytes
+ * @param threads Maximum number of threads, 0 means default_threads()
+ * @return Stream length, 0 if segment size is invalid or text too long
+ */
+template<class A>
+size_t stream_encrypt(
+    span_i<> key,
+    span_i<impl::stream::seed_size> seed,
+    uint32_t segment_size,
+    const byte *in, size_t len,
+    byte *out,
+    size_t threads = 0)
+{
+    using namespace impl::stream;
+
+    auto n = segments(len, segment_size);
+    A aead;
+
+    if (!valid<A>(segment_size, n) || !setup(aead, key, seed, segment_size, out))
+        return 0;
+
+    auto prefix = seed.data() + salt_size;
+    auto body = out + header_size;
+
+    parallel_for(n, threads, grain_bytes / segment_size, [&](size_t begin, size_t end) {
+        A ctx = aead;
+        for (size_t i = begin; i < end; ++i) {
+            bool last = i == n - 1;
+            size_t plen = last ? len - i * segment_size : segment_size;
+            seal(ctx, prefix, uint32_t(i), last, in + i * segment_size, plen, body + i * (uint64_t(segment_size) + tag_size));
+        }
+    });
+    return stream_size(len, segment_size);
+}
+
+/**
+ * @brief Decrypt whole segmented AEAD stream, spreading segments across
+ * threads. On failure output is zeroed.
+ *
+ * @tparam A AEAD context: gcm_context<E>, ccm_context<E, 3> or chacha20_poly1305_context
+ * @param key Master key
+ * @param in Input stream
+ * @param len Stream length
+ * @param out Plain text, at least len - header_size bytes
+ * @param out_len Output plain text length
+ * @param threads Maximum number of threads, 0 means default_threads()
+ * @return true on success, false if stream is malformed, made under another
+ * key or authentication of any segment failed
+ */
+template<class A>
+bool stream_decrypt(
+    span_i<> key,
+    const byte *in, size_t len,
+    byte *out, size_t *out_len,
+    size_t threads = 0)
+{
+    using namespace impl::stream;
+
+    A aead;
+    uint32_t seg;
+
+    *out_len = 0;
+
+    if (len < header_size || !parse(aead, key, in, seg))
+        return false;
+
+    auto body = in + header_size;
+    auto body_len = len - header_size;
+    auto n = body_segments(body_len, seg);
+    auto total = body_len - n * tag_size;
+    auto prefix = in + params_size + salt_size;
+    std::atomic<bool> ok = true;
+
+    if (!n)
+        return false;
+
+    parallel_for(n, threads, grain_bytes / seg, [&](size_t begin, size_t end) {
+        A ctx = aead;
+        bool part = true;
+        for (size_t i = begin; i < end; ++i) {
+            bool last = i == n - 1;
+            size_t plen = last ? total - i * seg : seg;
+            part &= open(ctx, prefix, uint32_t(i), last, body + i * (uint64_t(seg) + tag_size), plen, out + i * seg);
+        }
+        if (!part)
+            ok = false;
+    });
+    if (!ok) {
+        zero(out, total);
+        return false;
+    }
+    *out_len = total;
+    return true;
+}
+
+}
+
+#endif
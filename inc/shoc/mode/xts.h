@@ -0,0 +1,295 @@
+#ifndef SHOC_MODE_XTS_H
+#define SHOC_MODE_XTS_H
+
+#include "shoc/mode/ecb.h"
+
+namespace shoc {
+
+/**
+ * @brief Multiply tweak by primitive element alpha in GF(2^128), 
+ * tweak is treated as little endian 128-bit integer as in IEEE 1619.
+ * 
+ * @param t Tweak, 16 bytes
+ */
+constexpr void xts_mul_alpha(byte *t)
+{
+    byte carry = t[15] >> 7;
+
+    for (int i = 15; i > 0; --i)
+        t[i] = (t[i] << 1) | (t[i - 1] >> 7);
+    t[0] = (t[0] << 1) ^ (carry * 0x87);
+}
+
+/**
+ * @brief Produce N consecutive tweaks at once, so that N blocks can 
+ * be processed as one batch.
+ * 
+ * @tparam N Number of tweaks
+ * @param t Current tweak, advanced by N steps
+ * @param out Output tweaks, N * 16 bytes
+ */
+template<size_t N>
+constexpr void xts_tweaks(byte *t, byte *out)
+{
+    for (size_t i = 0; i < N; ++i, out += 16) {
+        copy(out, t, 16);
+        xts_mul_alpha(t);
+    }
+}
+
+/**
+ * @brief XEX step over a batch of full blocks: XOR with tweak, apply block 
+ * cipher through ecb_process(...), XOR with tweak again.
+ * 
+ * @tparam D Direction
+ * @tparam E Block cipher
+ * @param ciph Data cipher object, must be already initialized
+ * @param tw Tweaks, one per block
+ * @param in Input blocks
+ * @param out Output blocks
+ * @param len Length in bytes, multiple of 16
+ */
+template<direction D, class E>
+inline void xts_xex(E &ciph, const byte *tw, const byte *in, byte *out, size_t len)
+{
+    xorb(out, in, tw, len);
+    ecb_process<D>(ciph, span_i<>{out, len}, span_o<>{out, len});
+    xorb(out, tw, len);
+}
+
+/**
+ * @brief XTS engine for a single data unit (sector). Tweaks are computed 8 at a 
+ * time so that blocks are passed to the cipher in batches. Last partial block 
+ * is handled with ciphertext stealing. Input and output may be the same array.
+ * 
+ * @tparam D Direction
+ * @tparam E Block cipher
+ * @param ciph Data cipher object, must be already initialized
+ * @param tciph Tweak cipher object, must be already initialized
+ * @param iv Data unit number as 16-byte little endian integer
+ * @param in Input data
+ * @param out Output data
+ * @param len Data length, at least 16
+ * @return true on success, false if length is less than 16
+ */
+template<direction D, class E>
+inline bool xts_crypt(E &ciph, E &tciph, const byte *iv, const byte *in, byte *out, size_t len)
+{
+    constexpr size_t B = 8;
+
+    if (len < 16)
+        return false;
+
+    byte t[16];
+    byte tw[B * 16];
+
+    tciph.encrypt(span_i<16>{iv, 16}, t);
+
+    auto remain = len & 0xf;
+    auto blocks = (len >> 4) - (remain != 0); // Keep last full block for stealing
+
+    for (; blocks >= B; blocks -= B, in += B * 16, out += B * 16) {
+        xts_tweaks<B>(t, tw);
+        xts_xex<D>(ciph, tw, in, out, B * 16);
+    }
+    for (; blocks; --blocks, in += 16, out += 16) {
+        xts_tweaks<1>(t, tw);
+        xts_xex<D>(ciph, tw, in, out, 16);
+    }
+    if (remain) {
+        byte buf[16];
+        byte tail[16];
+
+        // Tweaks for the last full block and stolen block, decryption swaps their order
+        xts_tweaks<2>(t, tw);
+        if constexpr (D == direction::decrypt)
+            std::swap_ranges(tw, tw + 16, tw + 16);
+
+        copy(tail, in + 16, remain);
+        xts_xex<D>(ciph, tw, in, buf, 16);
+        copy(out + 16, buf, remain);
+        copy(buf, tail, remain);
+        xts_xex<D>(ciph, tw + 16, buf, out, 16);
+        zero(buf, sizeof(buf));
+        zero(tail, sizeof(tail));
+    }
+    zero(t, sizeof(t));
+    zero(tw, sizeof(tw));
+
+    return true;
+}
+
+/**
+ * @brief XTS mode context, holds expanded data and tweak keys, so that many 
+ * sectors can be processed without key setup. Key is concatenation of data 
+ * key and tweak key, as in IEEE 1619.
+ * 
+ * @tparam E Block cipher
+ */
+template<class E>
+class xts_context {
+public:
+    static constexpr size_t key_size = 2 * E::key_size;
+public:
+    xts_context() = default;
+    xts_context(span_i<key_size> key) { init(key); }
+    ~xts_context() { deinit(); }
+public:
+    void init(span_i<key_size> key);
+    void deinit();
+    bool encrypt(uint64_t sector, const byte *in, byte *out, size_t len);
+    bool decrypt(uint64_t sector, const byte *in, byte *out, size_t len);
+    bool encrypt_sectors(uint64_t first, size_t sector_size, const byte *in, byte *out, size_t len, size_t threads = 0);
+    bool decrypt_sectors(uint64_t first, size_t sector_size, const byte *in, byte *out, size_t len, size_t threads = 0);
+private:
+    template<direction D>
+    bool sectors(uint64_t first, size_t sector_size, const byte *in, byte *out, size_t len, size_t threads);
+private:
+    E ciph;
+    E tciph;
+};
+
+template<class E>
+void xts_context<E>::init(span_i<key_size> key)
+{
+    ciph.init(key.template first<E::key_size>());
+    tciph.init(key.template last<E::key_size>());
+}
+
+template<class E>
+void xts_context<E>::deinit()
+{
+    ciph.deinit();
+    tciph.deinit();
+}
+
+/**
+ * @brief Encrypt single sector. Input and output may be the same array.
+ * 
+ * @param sector Sector number
+ * @param in Plain text
+ * @param out Cipher text
+ * @param len Sector length, at least 16
+ * @return true on success, false if length is less than 16
+ */
+template<class E>
+bool xts_context<E>::encrypt(uint64_t sector, const byte *in, byte *out, size_t len)
+{
+    byte iv[16] = {};
+    putle(sector, iv);
+    return xts_crypt<direction::encrypt>(ciph, tciph, iv, in, out, len);
+}
+
+/**
+ * @brief Decrypt single sector. Input and output may be the same array.
+ * 
+ * @param sector Sector number
+ * @param in Cipher text
+ * @param out Plain text
+ * @param len Sector length, at least 16
+ * @return true on success, false if length is less than 16
+ */
+template<class E>
+bool xts_context<E>::decrypt(uint64_t sector, const byte *in, byte *out, size_t len)
+{
+    byte iv[16] = {};
+    putle(sector, iv);
+    return xts_crypt<direction::decrypt>(ciph, tciph, iv, in, out, len);
+}
+
+/**
+ * @brief Encrypt run of consecutive sectors, spread across threads.
+ * 
+ * @param first Number of the first sector
+ * @param sector_size Sector size, at least 16
+ * @param in Plain text
+ * @param out Cipher text
+ * @param len Data length, multiple of sector size
+ * @param threads Maximum number of threads, 0 means default_threads()
+ * @return true on success, false if sector size or length is invalid
+ */
+template<class E>
+bool xts_context<E>::encrypt_sectors(uint64_t first, size_t sector_size, const byte *in, byte *out, size_t len, size_t threads)
+{
+    return sectors<direction::encrypt>(first, sector_size, in, out, len, threads);
+}
+
+/**
+ * @brief Decrypt run of consecutive sectors, spread across threads.
+ * 
+ * @param first Number of the first sector
+ * @param sector_size Sector size, at least 16
+ * @param in Cipher text
+ * @param out Plain text
+ * @param len Data length, multiple of sector size
+ * @param threads Maximum number of threads, 0 means default_threads()
+ * @return true on success, false if sector size or length is invalid
+ */
+template<class E>
+bool xts_context<E>::decrypt_sectors(uint64_t first, size_t sector_size, const byte *in, byte *out, size_t len, size_t threads)
+{
+    return sectors<direction::decrypt>(first, sector_size, in, out, len, threads);
+}
+
+template<class E>
+template<direction D>
+bool xts_context<E>::sectors(uint64_t first, size_t sector_size, const byte *in, byte *out, size_t len, size_t threads)
+{
+    constexpr size_t grain = 64 * 1024; // Bytes per thread at least
+
+    if (sector_size < 16 || len % sector_size)
+        return false;
+
+    parallel_for(len / sector_size, threads, (grain + sector_size - 1) / sector_size, [&](size_t begin, size_t end) {
+        E c = ciph;
+        E t = tciph;
+        byte iv[16] = {};
+        for (size_t i = begin; i < end; ++i) {
+            putle(uint64_t(first + i), iv);
+            xts_crypt<D>(c, t, iv, in + i * sector_size, out + i * sector_size, sector_size);
+        }
+    });
+    return true;
+}
+
+/**
+ * @brief Encrypt single sector with block cipher in XTS mode. Input 
+ * and output may be the same array.
+ * 
+ * @tparam E Block cipher
+ * @param key Data key followed by tweak key
+ * @param sector Sector number
+ * @param in Plain text
+ * @param out Cipher text
+ * @param len Text length, at least 16
+ * @return true on success, false if length is less than 16
+ */
+template<class E>
+inline bool xts_encrypt(span_i<2 * E::key_size> key, uint64_t sector, const byte *in, byte *out, size_t len)
+{
+    xts_context<E> ctx {key};
+    return ctx.encrypt(sector, in, out, len);
+}
+
+/**
+ * @brief Decrypt single sector with block cipher in XTS mode. Input 
+ * and output may be the same array.
+ * 
+ * @tparam E Block cipher
+ * @param key Data key followed by tweak key
+ * @param sector Sector number
+ * @param in Cipher text
+ * @param out Plain text
+ * @param len Text length, at least 16
+ * @return true on success, false if length is less than 16
+ */
+template<class E>
+inline bool xts_decrypt(span_i<2 * E::key_size> key, uint64_t sector, const byte *in, byte *out, size_t len)
+{
+    xts_context<E> ctx {key};
+    return ctx.decrypt(sector, in, out, len);
+}
+
+}
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef SHOC_PARALLEL_H
+#define SHOC_PARALLEL_H
+
+#include "shoc/util.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace shoc {
+
+/**
+ * @brief Default number of worker threads, at least 1.
+ * 
+ * @return Number of hardware threads
+ */
+inline size_t default_threads()
+{
+    auto n = std::thread::hardware_concurrency();
+    return n ? n : 1;
+}
+
+/**
+ * @brief Split range [0, count) into contiguous parts of at least grain 
+ * items and call f(begin, end) for each one on a separate thread. The 
+ * last part is processed by the calling thread. Returns after all parts 
+ * are done.
+ * 
+ * @tparam F Callable with signature void(size_t, size_t)
+ * @param count Number of items
+ * @param threads Maximum number of threads, 0 means default_threads()
+ * @param grain Minimum number of items per thread
+ * @param f Function to call
+ */
+template<class F>
+inline void parallel_for(size_t count, size_t threads, size_t grain, F &&f)
+{
+    if (!count)
+        return;
+    if (!threads)
+        threads = default_threads();
+    if (!grain)
+        grain = 1;
+    if (threads > (count + grain - 1) / grain)
+        threads = (count + grain - 1) / grain;
+
+    if (threads <= 1) {
+        f(size_t(0), count);
+        return;
+    }
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+
+    size_t part = count / threads;
+    size_t rest = count % threads;
+    size_t begin = 0;
+
+    for (size_t i = 0; i < threads - 1; ++i) {
+        size_t end = begin + part + (i < rest);
+        pool.emplace_back([&f, begin, end] { f(begin, end); });
+        begin = end;
+    }
+    f(begin, count);
+
+    for (auto &t : pool)
+        t.join();
+}
+
+/**
+ * @brief Like parallel_for(), but balanced dynamically for items of uneven
+ * cost or threads of uneven speed. Range is cut into chunks of grain items
+ * and every thread starts with an equal share of chunks, taking them one
+ * by one from the front. A thread that runs out steals back half of the
+ * largest remaining share of another thread. Shares are packed into single
+ * atomic words, so both taking and stealing is one compare-and-swap.
+ *
+ * @tparam F Callable with signature void(size_t, size_t)
+ * @param count Number of items
+ * @param threads Maximum number of threads, 0 means default_threads()
+ * @param grain Number of items per call, at least 1
+ * @param f Function to call
+ */
+template<class F>
+inline void parallel_for_steal(size_t count, size_t threads, size_t grain, F &&f)
+{
+    if (!count)
+        return;
+    if (!threads)
+        threads = default_threads();
+    if (!grain)
+        grain = 1;
+
+    uint64_t chunks = (count + grain - 1) / grain;
+
+    if (threads > chunks)
+        threads = chunks;
+
+    if (threads <= 1) {
+        f(size_t(0), count);
+        return;
+    }
+    assert(chunks >> 32 == 0);
+
+    auto pack   = [](uint64_t b, uint64_t e) { return b << 32 | e; };
+    auto shares = std::make_unique<std::atomic<uint64_t>[]>(threads);
+
+    for (uint64_t i = 0; i < threads; ++i)
+        shares[i] = pack(chunks * i / threads, chunks * (i + 1) / threads);
+
+    auto run = [&](size_t chunk) {
+        f(chunk * grain, std::min(count, (chunk + 1) * grain));
+    };
+    auto work = [&](size_t self) {
+        for (;;) {
+            uint64_t cur = shares[self].load();
+            uint64_t b = cur >> 32;
+            uint64_t e = cur & 0xffffffff;
+
+            if (b < e) {
+                if (shares[self].compare_exchange_weak(cur, pack(b + 1, e)))
+                    run(b);
+                continue;
+            }
+            size_t victim = self;
+            uint64_t most = 0;
+
+            for (size_t i = 0; i < threads; ++i) {
+                uint64_t v = shares[i].load();
+                uint64_t n = (v & 0xffffffff) - std::min(v >> 32, v & 0xffffffff);
+                if (n > most) {
+                    most = n;
+                    victim = i;
+                }
+            }
+            if (!most)
+                return;
+
+            cur = shares[victim].load();
+            b = cur >> 32;
+            e = cur & 0xffffffff;
+
+            if (b >= e)
+                continue;
+
+            uint64_t mid = b + (e - b) / 2;
+
+            if (shares[victim].compare_exchange_strong(cur, pack(b, mid)))
+                shares[self] = pack(mid, e);
+        }
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+
+    for (size_t i = 1; i < threads; ++i)
+        pool.emplace_back(work, i);
+    work(0);
+
+    for (auto &t : pool)
+        t.join();
+}
+
+}
+
+#endif
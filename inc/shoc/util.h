@@ -3,6 +3,15 @@
 
 #include "utl/bit.h"
 #include "utl/str.h"
+#include <cstring>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SHOC_ALWAYS_INLINE inline __attribute__((always_inline))
+#define SHOC_ALWAYS_INLINE_LAMBDA __attribute__((always_inline))
+#else
+#define SHOC_ALWAYS_INLINE inline
+#define SHOC_ALWAYS_INLINE_LAMBDA
+#endif
 
 namespace shoc {
 
@@ -30,6 +39,15 @@ using span_i = std::span<const T, N>;
 template<size_t N = std::dynamic_extent, class T = byte>
 using span_o = std::span<T, N>;
 
+/**
+ * @brief Direction of operation for stateful block cipher mode contexts.
+ * 
+ */
+enum class direction {
+    encrypt,
+    decrypt,
+};
+
 /**
  * @brief Wrapper for swap function.
  * 
@@ -87,6 +105,18 @@ constexpr void copy(void* dst, const void *src, size_t cnt)
     std::copy(static_cast<const byte*>(src), static_cast<const byte*>(src) + cnt, static_cast<byte*>(dst));
 }
 
+/**
+ * @brief Copy from one byte array to another, usable in constant expressions.
+ * 
+ * @param dst Destination
+ * @param src Source
+ * @param cnt Number of bytes
+ */
+constexpr void copy(byte *dst, const byte *src, size_t cnt)
+{
+    std::copy(src, src + cnt, dst);
+}
+
 /**
  * @brief Fill memory with given byte value.
  * 
@@ -107,11 +137,47 @@ constexpr void fill(void* dst, byte val, size_t cnt)
  */
 constexpr void zero(void* dst, size_t cnt)
 {
-    // if (std::is_constant_evaluated()) {
-    //     std::fill_n(static_cast<byte*>(dst), cnt, 0);
-    // } else {
+    std::fill_n(static_cast<volatile byte*>(dst), cnt, 0);
+}
+
+/**
+ * @brief Reliably zero out byte array, usable in constant expressions.
+ * 
+ * @param dst Memory to zero out
+ * @param cnt Number of bytes
+ */
+constexpr void zero(byte *dst, size_t cnt)
+{
+    if (std::is_constant_evaluated())
+        std::fill_n(dst, cnt, 0);
+    else
         std::fill_n(static_cast<volatile byte*>(dst), cnt, 0);
-    // }
+}
+
+/**
+ * @brief XOR two blocks of bytes into output, 64-bit word at a time outside 
+ * of constant evaluation. Output may be the same array as any of inputs.
+ * 
+ * @param out Output array
+ * @param x First array
+ * @param y Second array
+ * @param len Length of arrays in bytes
+ */
+constexpr void xorb(byte *out, const byte *x, const byte *y, size_t len)
+{
+    size_t i = 0;
+
+    if (!std::is_constant_evaluated()) {
+        for (; i + 8 <= len; i += 8) {
+            uint64_t a, b;
+            std::memcpy(&a, x + i, 8);
+            std::memcpy(&b, y + i, 8);
+            a ^= b;
+            std::memcpy(out + i, &a, 8);
+        }
+    }
+    for (; i < len; ++i)
+        out[i] = x[i] ^ y[i];
 }
 
 /**
@@ -124,8 +190,7 @@ constexpr void zero(void* dst, size_t cnt)
  */
 constexpr void xorb(byte *x, const byte *y, size_t len = 16)
 {
-    for (size_t i = 0; i < len; ++i)
-        x[i] ^= y[i];
+    xorb(x, x, y, len);
 }
 
 /**
@@ -170,7 +235,7 @@ constexpr T byteswap(T x)
 template<class T>
 constexpr void putle(T val, byte *out)
 {
-    for (int i = 0; i < sizeof(T) * 8; i += 8)
+    for (size_t i = 0; i < sizeof(T) * 8; i += 8)
         *out++ = val >> i;
 }
 
@@ -188,6 +253,38 @@ constexpr void putbe(T val, byte *out)
         *out++ = val >> i;
 }
 
+/**
+ * @brief Get integer from array in little endian order.
+ *
+ * @tparam T Integer type
+ * @param in Input array
+ * @return Integer
+ */
+template<class T>
+constexpr T getle(const byte *in)
+{
+    T val = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+        val |= T(in[i]) << (i * 8);
+    return val;
+}
+
+/**
+ * @brief Get integer from array in big endian order.
+ *
+ * @tparam T Integer type
+ * @param in Input array
+ * @return Integer
+ */
+template<class T>
+constexpr T getbe(const byte *in)
+{
+    T val = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+        val = T(val << 8) | in[i];
+    return val;
+}
+
 /**
  * @brief Choose function, used in SHA and MD.
  */
@@ -230,6 +327,97 @@ constexpr void incc(byte *block)
     while (++block[--i] == 0 && i >= B - L);
 }
 
+/**
+ * @brief Double 128-bit block in Galois field 2^128 with big endian bit order, 
+ * i.e. shift left by 1 and reduce with 0x87. Used in OCB, CMAC and SIV.
+ * 
+ * @param block Pointer to 16-byte block
+ */
+constexpr void dbl(byte *block)
+{
+    byte carry = block[0] >> 7;
+
+    for (size_t i = 0; i < 15; ++i)
+        block[i] = (block[i] << 1) | (block[i + 1] >> 7);
+    block[15] = (block[15] << 1) ^ (carry * 0x87);
+}
+
+/**
+ * @brief Total length of a chain of segments.
+ *
+ * @param iov Segments
+ * @return Sum of segment lengths
+ */
+constexpr size_t iov_size(std::span<const span_i<>> iov)
+{
+    size_t len = 0;
+    for (auto s : iov)
+        len += s.size();
+    return len;
+}
+
+constexpr size_t iov_size(std::span<const span_o<>> iov)
+{
+    size_t len = 0;
+    for (auto s : iov)
+        len += s.size();
+    return len;
+}
+
+/**
+ * @brief Walk a chain of writable segments in blocks of N bytes and process
+ * them in-place. Runs of full blocks within a segment are passed to the
+ * function directly, only a block straddling segment boundary is gathered
+ * into a temporary block and scattered back after processing.
+ *
+ * @tparam N Block size
+ * @param iov Segments
+ * @param f Function f(byte *blocks, size_t count), called in order of data
+ * @return true on success, false if total length isn't multiple of N,
+ * in which case the trailing partial block is left untouched
+ */
+template<size_t N, class F>
+constexpr bool iov_blocks(std::span<const span_o<>> iov, F &&f)
+{
+    byte tmp[N];
+    size_t idx = 0;
+    size_t seg = 0;
+    size_t off = 0;
+
+    for (size_t s = 0; s < iov.size(); ++s) {
+        auto p = iov[s].data();
+        auto len = iov[s].size();
+
+        if (idx) {
+            size_t n = N - idx < len ? N - idx : len;
+            copy(tmp + idx, p, n);
+            idx += n;
+            p   += n;
+            len -= n;
+            if (idx < N)
+                continue;
+            f(tmp, size_t(1));
+            for (size_t i = 0; i < N; ++seg, off = 0) {
+                n = iov[seg].size() - off < N - i ? iov[seg].size() - off : N - i;
+                copy(iov[seg].data() + off, tmp + i, n);
+                i += n;
+            }
+            idx = 0;
+        }
+        if (len >= N)
+            f(p, len / N);
+
+        if ((idx = len % N)) {
+            copy(tmp, p + len - idx, idx);
+            seg = s;
+            off = iov[s].size() - idx;
+        }
+    }
+    zero(tmp, sizeof(tmp));
+
+    return idx == 0;
+}
+
 template<class H>
 struct Eater {
     void operator()(const void *in, size_t len, byte *out)
@@ -243,6 +431,126 @@ private:
     friend H;
 };
 
+namespace impl::hash {
+
+/**
+ * @brief Version of saved hash state layout, first byte of every
+ * saved state.
+ *
+ */
+inline constexpr byte state_version = 1;
+
+/**
+ * @brief Size of saved state header: version, 2-byte algorithm id
+ * and 8-byte message length.
+ *
+ */
+inline constexpr size_t state_header = 11;
+
+/**
+ * @brief Algorithm id stored in saved state, distinct for every hash
+ * with save_state(), so that state of one is never accepted by another.
+ *
+ */
+enum class state_id : uint16_t {
+    md5 = 1,
+    sha1,
+    sha224,
+    sha256,
+    sha384,
+    sha512,
+    sha512_224,
+    sha512_256,
+    gimli,
+};
+
+/**
+ * @brief Maximum size of saved state of Merkle-Damgard hash.
+ *
+ * @tparam W Word type
+ * @param words Number of chaining words
+ * @param block_size Block size in bytes
+ * @return Size in bytes
+ */
+template<class W>
+constexpr size_t md_state_size(size_t words, size_t block_size)
+{
+    return state_header + words * sizeof(W) + block_size - 1;
+}
+
+/**
+ * @brief Save state of Merkle-Damgard hash as: version, algorithm id,
+ * message length, chaining words, then only buffered bytes of incomplete
+ * block, whose count follows from length. All integers are little endian.
+ *
+ * @tparam W Word type
+ * @param id Algorithm id
+ * @param length Message length in bytes
+ * @param state Chaining words
+ * @param words Number of chaining words
+ * @param block Incomplete block
+ * @param block_size Block size in bytes
+ * @param out Output, at least md_state_size() bytes
+ * @return Number of bytes written
+ */
+template<class W>
+constexpr size_t md_save(state_id id, uint64_t length, const W *state, size_t words,
+    const byte *block, size_t block_size, byte *out)
+{
+    size_t idx = length % block_size;
+    size_t len = state_header + words * sizeof(W) + idx;
+
+    out[0] = state_version;
+    putle(uint16_t(id), out + 1);
+    putle(length, out + 3);
+    out += state_header;
+
+    for (size_t i = 0; i < words; ++i, out += sizeof(W))
+        putle(state[i], out);
+    copy(out, block, idx);
+
+    return len;
+}
+
+/**
+ * @brief Load state saved by md_save(). Nothing is modified on failure.
+ *
+ * @tparam W Word type
+ * @param id Expected algorithm id
+ * @param in Saved state
+ * @param len Length of saved state
+ * @param length Message length in bytes, output
+ * @param state Chaining words, output
+ * @param words Number of chaining words
+ * @param block Incomplete block, output
+ * @param block_size Block size in bytes
+ * @return true on success, false if version, id or length don't match
+ */
+template<class W>
+constexpr bool md_load(state_id id, const byte *in, size_t len, uint64_t &length, W *state, size_t words,
+    byte *block, size_t block_size)
+{
+    if (!in || len < state_header || in[0] != state_version || getle<uint16_t>(in + 1) != uint16_t(id))
+        return false;
+
+    uint64_t l = getle<uint64_t>(in + 3);
+    size_t idx = l % block_size;
+
+    if (len != state_header + words * sizeof(W) + idx)
+        return false;
+
+    in += state_header;
+    length = l;
+
+    for (size_t i = 0; i < words; ++i, in += sizeof(W))
+        state[i] = getle<W>(in);
+    copy(block, in, idx);
+
+    return true;
+}
+
+}
+
 }
 
 #endif
\ No newline at end of file
@@ -1,60 +1,531 @@
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
-#include "shoc/util.h"
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "shoc/cipher/aes.h"
 #include "shoc/ecc/crc.h"
-#include "shoc/_experimental/elliptic.h"
-#include "shoc/_experimental/bigint.h"
-    
-int main()
-{
-    // printf("0x%04x\n", shoc::bitswap(uint16_t(0x0001)));
-    // printf("0x%04x\n", shoc::byteswap(uint16_t(0x0001)));
-
-    // printf("%d %% %d = %d \n", -9, 19, shoc::ff_mod(-9, 19));
-    // printf("%d ** %d = %d \n", 7, 3, shoc::ff_pow(7, 3, 19));
-
-    // using fint = shoc::ff_int<int, 223>;
-    // using fpoint = shoc::ff_point<fint, 0, 7>;
-
-    // auto p1 = fpoint{192, 105};
-    // auto p2 = fpoint{17, 56};
-    // auto p3 = p1 + p2;
-
-    // printf("%d %d %d \n", p3.is_infinity(), p3.get_x(), p3.get_y());
-
-    // auto p = fpoint{47, 71};
-
-    // for (int i = 1; i <= 21; ++i) {
-    //     auto r = p * i;
-    //     printf("%2d * (%d, %d) = (%3d, %3d) | %d \n", i, p.get_x(), p.get_y(), r.get_x(), r.get_y(), r.is_infinity());
-    // }
-
-    using bigint_base = uint32_t;
-    using uint128 = shoc::bigint<bigint_base, 128>;
-
-    printf("sizeof(bigint_base):    %lu \n", sizeof(bigint_base));
-    printf("sizeof(uint128):        %lu \n", sizeof(uint128));
-    // shoc::bigint<128> 
-
-    uint128 a(0x1337);
-    uint128 b(0xffffffffffffffffull, 1);
-    uint128 c{{0xdead, 0x1}};
-    uint128 d(1);
-    uint128 e(0xffffffffffffffffull, 2);
-    // uint128 f("12345");
-    uint128 g = {{0x1337, 0x1}};
-
-    a.print();
-    // b.print();
-    c.print();
-    // d.print();
-    // e.print();
-    // f.print();
-    // g.print();
-
-    // (c - a).print();
-    (a - c).print();
-    // (g - c).print();
-    (b + d).print();
-    (e + d).print();
-    (a + g).print();
+#include "shoc/hash/any.h"
+#include "shoc/mode/ctr.h"
+#include "shoc/mode/gcm.h"
+#include "shoc/parallel.h"
+
+using namespace shoc;
+
+namespace {
+
+constexpr size_t chunk_size = 1 << 20;  // Bytes per read and per call into hash or cipher
+constexpr size_t page_size  = 4096;     // Alignment of read buffers
+constexpr size_t tag_size   = 16;
+
+using clk = std::chrono::steady_clock;
+
+/**
+ * @brief How file contents are brought into memory.
+ *
+ */
+enum class input {
+    map,    // mmap whole file, kernel does read-ahead
+    read,   // Aligned reads into two buffers, next one filled by background thread
+};
+
+struct options {
+    input in        = input::map;
+    size_t threads  = 0;
+    bool quiet      = false;
+};
+
+/**
+ * @brief CRC-32 (IEEE 802.3) with the same init/feed/stop interface as hashes.
+ *
+ */
+struct Crc32 {
+    static constexpr size_t SIZE        = 4;
+    static constexpr size_t BLOCK_SIZE  = 1;
+public:
+    void init()                             { val = bitswap(uint32_t(0xffffffff)); }
+    void feed(const void *in, size_t len)   { val = crc_feed_fast<uint32_t, 0x04c11db7, true>(val, in, len); }
+    void stop(byte *out)                    { putbe(val ^ 0xffffffff, out); }
+private:
+    uint32_t val;
+};
+
+/**
+ * @brief File descriptor owner.
+ *
+ */
+struct file {
+    file() = default;
+    file(const file&) = delete;
+    ~file() { if (fd >= 0) close(fd); }
+
+    bool open_read(const char *path)
+    {
+        struct stat st;
+        if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st))
+            return false;
+        size = st.st_size;
+        dev = st.st_dev;
+        ino = st.st_ino;
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        return true;
+    }
+    bool open_write(const char *path)
+    {
+        struct stat st;
+        if ((fd = open(path, O_WRONLY | O_CREAT, 0644)) < 0 || fstat(fd, &st))
+            return false;
+        dev = st.st_dev;
+        ino = st.st_ino;
+        return true;
+    }
+    bool same(const file &other) const
+    {
+        return dev == other.dev && ino == other.ino;
+    }
+    bool truncate()
+    {
+        return !ftruncate(fd, 0);
+    }
+    bool write_all(const byte *p, size_t len)
+    {
+        while (len) {
+            auto n = write(fd, p, len);
+            if (n <= 0)
+                return false;
+            p   += n;
+            len -= n;
+        }
+        return true;
+    }
+    bool read_at(byte *p, size_t len, uint64_t off)
+    {
+        while (len) {
+            auto n = pread(fd, p, len, off);
+            if (n <= 0)
+                return false;
+            p   += n;
+            len -= n;
+            off += n;
+        }
+        return true;
+    }
+    int fd = -1;
+    uint64_t size = 0;
+    dev_t dev = 0;
+    ino_t ino = 0;
+};
+
+/**
+ * @brief Feed first len bytes of memory-mapped file to f(const byte*, size_t)
+ * in chunks.
+ *
+ */
+template<class F>
+bool feed_mapped(file &f, uint64_t len, F &&fn)
+{
+    if (!len)
+        return true;
+
+    auto p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, f.fd, 0);
+    if (p == MAP_FAILED)
+        return false;
+
+    madvise(p, len, MADV_SEQUENTIAL);
+
+    for (uint64_t off = 0, n; off < len; off += n) {
+        n = len - off < chunk_size ? len - off : chunk_size;
+        fn(static_cast<const byte*>(p) + off, size_t(n));
+    }
+    munmap(p, len);
+
+    return true;
+}
+
+/**
+ * @brief Feed first len bytes of file to f(const byte*, size_t) in chunks
+ * using two aligned buffers. Background thread reads next chunk while
+ * the caller processes current one.
+ *
+ */
+template<class F>
+bool feed_buffered(file &f, uint64_t len, F &&fn)
+{
+    struct slot {
+        byte *data  = nullptr;
+        size_t len  = 0;
+        bool full   = false;
+    } s[2];
+    std::mutex m;
+    std::condition_variable cv;
+    bool error  = false;
+    bool cancel = false;
+
+    for (auto &it : s) {
+        if (!(it.data = static_cast<byte*>(std::aligned_alloc(page_size, chunk_size)))) {
+            std::free(s[0].data);
+            return false;
+        }
+    }
+    std::thread reader([&] {
+        uint64_t off = 0;
+        for (int k = 0; off < len; k ^= 1) {
+            {
+                std::unique_lock lock {m};
+                cv.wait(lock, [&] { return !s[k].full || cancel; });
+                if (cancel)
+                    return;
+            }
+            size_t n = len - off < chunk_size ? len - off : chunk_size;
+            bool ok = f.read_at(s[k].data, n, off);
+            {
+                std::lock_guard lock {m};
+                s[k].len  = n;
+                s[k].full = true;
+                error = !ok;
+            }
+            cv.notify_all();
+            if (!ok)
+                return;
+            off += n;
+        }
+    });
+    uint64_t off = 0;
+    bool ok = true;
+
+    for (int k = 0; off < len; k ^= 1) {
+        {
+            std::unique_lock lock {m};
+            cv.wait(lock, [&] { return s[k].full; });
+            if (error) {
+                ok = false;
+                break;
+            }
+        }
+        fn(static_cast<const byte*>(s[k].data), s[k].len);
+        off += s[k].len;
+        {
+            std::lock_guard lock {m};
+            s[k].full = false;
+        }
+        cv.notify_all();
+    }
+    {
+        std::lock_guard lock {m};
+        cancel = true;
+    }
+    cv.notify_all();
+    reader.join();
+
+    for (auto &it : s)
+        std::free(it.data);
+    return ok;
+}
+
+template<class F>
+bool feed(file &f, uint64_t len, input in, F &&fn)
+{
+    return in == input::map ?
+        feed_mapped(f, len, fn) :
+        feed_buffered(f, len, fn);
+}
+
+double seconds_since(clk::time_point t)
+{
+    return std::chrono::duration<double>(clk::now() - t).count();
+}
+
+void report(const char *name, uint64_t bytes, double sec)
+{
+    fprintf(stderr, "%s: %llu bytes in %.3f s, %.1f MB/s\n",
+        name, (unsigned long long) bytes, sec, sec > 0 ? bytes / sec / 1e6 : 0.0);
+}
+
+/**
+ * @brief Parse hex string of exactly len bytes.
+ *
+ */
+bool parse_hex(const char *str, byte *out, size_t len)
+{
+    size_t n = strlen(str);
+    if (n != len * 2)
+        return false;
+    for (size_t i = 0; i < n; ++i)
+        if (!isxdigit(static_cast<unsigned char>(str[i])))
+            return false;
+    return utl::str_to_bin(str, n, out, len) == len;
+}
+
+struct digest {
+    std::string hex;
+    uint64_t bytes  = 0;
+    double sec      = 0;
+    int err         = 0;
+    bool ok         = false;
+};
+
+digest hash_file(any_hash h, const char *path, input in)
+{
+    digest d;
+    file f;
+    byte out[64];
+    char str[sizeof(out) * 2 + 1];
+    auto start = clk::now();
+
+    if (!f.open_read(path)) {
+        d.err = errno;
+        return d;
+    }
+    h.init();
+    d.ok = feed(f, f.size, in, [&](const byte *p, size_t n) { h.feed(p, n); });
+    d.err = d.ok ? 0 : errno ? errno : EIO;
+    h.stop(out);
+    d.sec = seconds_since(start);
+    d.bytes = f.size;
+
+    utl::bin_to_cstr(out, h.size(), str, sizeof(str));
+    d.hex = str;
+
+    return d;
+}
+
+/**
+ * @brief Hash by name: library registry plus CRC-32, which isn't a
+ * cryptographic hash and so isn't registered in the library.
+ *
+ */
+any_hash find_hash(const char *name)
+{
+    if (!strcmp(name, "crc32"))
+        return any_hash(std::in_place_type<Crc32>);
+    return make_hash(name);
+}
+
+/**
+ * @brief Hash all files, spreading them across threads. Digests are
+ * printed in order of arguments, like sha256sum does.
+ *
+ */
+int cmd_hash(const options &opt, const char *name, std::vector<const char*> paths)
+{
+    auto h = find_hash(name);
+
+    if (!h) {
+        fprintf(stderr, "unknown hash algorithm: %s\n", name);
+        return 2;
+    }
+    std::vector<digest> res(paths.size());
+    auto start = clk::now();
+
+    parallel_for(paths.size(), opt.threads, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            res[i] = hash_file(h, paths[i], opt.in);
+    });
+    auto sec = seconds_since(start);
+    uint64_t total = 0;
+    int ret = 0;
+
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (!res[i].ok) {
+            fprintf(stderr, "%s: %s\n", paths[i], strerror(res[i].err));
+            ret = 1;
+            continue;
+        }
+        printf("%s  %s\n", res[i].hex.c_str(), paths[i]);
+        if (!opt.quiet)
+            report(paths[i], res[i].bytes, res[i].sec);
+        total += res[i].bytes;
+    }
+    if (!opt.quiet && paths.size() > 1)
+        report("total", total, sec);
+    return ret;
+}
+
+/**
+ * @brief Encrypt or decrypt file with AES in CTR or GCM mode. GCM output
+ * is cipher text followed by 16-byte tag. On failed authentication output
+ * file is removed, since it was written before the tag could be checked.
+ * Input over GCM length limit is refused before output is touched.
+ *
+ */
+template<class E>
+int crypt_file(const options &opt, bool gcm, direction dir, const byte *key, const byte *iv, const char *src, const char *dst)
+{
+    file in;
+    file out;
+    std::vector<byte> buf(chunk_size);
+    byte tag[tag_size];
+    bool ok = true;
+    auto start = clk::now();
+
+    if (!in.open_read(src)) {
+        fprintf(stderr, "%s: %s\n", src, strerror(errno));
+        return 1;
+    }
+    if (gcm && in.size - (dir == direction::decrypt && in.size >= tag_size ? tag_size : 0) > gcm_context<E>::max_msg_len) {
+        fprintf(stderr, "%s: too long for gcm, at most %llu bytes\n", src, (unsigned long long) gcm_context<E>::max_msg_len);
+        return 1;
+    }
+    if (!out.open_write(dst)) {
+        fprintf(stderr, "%s: %s\n", dst, strerror(errno));
+        return 1;
+    }
+    if (out.same(in)) {
+        fprintf(stderr, "%s: input and output are the same file\n", dst);
+        return 1;
+    }
+    if (!out.truncate()) {
+        fprintf(stderr, "%s: %s\n", dst, strerror(errno));
+        return 1;
+    }
+    auto len = in.size;
+
+    if (!gcm) {
+        ctr_context<E> ctx {span_i<E::key_size>{key, E::key_size}, iv};
+        ok = feed(in, len, opt.in, [&](const byte *p, size_t n) {
+            ctx.update(p, buf.data(), n);
+            ok = ok && out.write_all(buf.data(), n);
+        }) && ok;
+        ctx.finish();
+    } else {
+        gcm_context<E> ctx {span_i<E::key_size>{key, E::key_size}};
+
+        if (dir == direction::decrypt) {
+            if (len < tag_size || !in.read_at(tag, tag_size, len - tag_size)) {
+                fprintf(stderr, "%s: too short\n", src);
+                unlink(dst);
+                return 1;
+            }
+            len -= tag_size;
+        }
+        ctx.start(iv, 12, dir);
+        ok = feed(in, len, opt.in, [&](const byte *p, size_t n) {
+            ctx.update(p, buf.data(), n);
+            ok = ok && out.write_all(buf.data(), n);
+        }) && ok;
+
+        if (dir == direction::encrypt) {
+            ctx.finish(tag, tag_size);
+            ok = ok && out.write_all(tag, tag_size);
+        } else if (!ctx.verify(tag, tag_size)) {
+            fprintf(stderr, "%s: authentication failed\n", src);
+            unlink(dst);
+            return 1;
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: I/O error\n", src);
+        unlink(dst);
+        return 1;
+    }
+    if (!opt.quiet)
+        report(src, len, seconds_since(start));
+    return 0;
+}
+
+int cmd_crypt(const options &opt, direction dir, const char *mode, const char *key_hex, const char *iv_hex, const char *src, const char *dst)
+{
+    bool gcm = !strcmp(mode, "gcm");
+    byte key[32];
+    byte iv[16];
+    size_t key_len = strlen(key_hex) / 2;
+
+    if (!gcm && strcmp(mode, "ctr")) {
+        fprintf(stderr, "unknown mode: %s\n", mode);
+        return 2;
+    }
+    if ((key_len != 16 && key_len != 24 && key_len != 32) || !parse_hex(key_hex, key, key_len)) {
+        fprintf(stderr, "key must be 32, 48 or 64 hex digits\n");
+        return 2;
+    }
+    if (!parse_hex(iv_hex, iv, gcm ? 12 : 16)) {
+        fprintf(stderr, "%s IV must be %d hex digits\n", mode, gcm ? 24 : 32);
+        return 2;
+    }
+    int ret;
+
+    switch (key_len) {
+        case 16: ret = crypt_file<aes128>(opt, gcm, dir, key, iv, src, dst); break;
+        case 24: ret = crypt_file<aes192>(opt, gcm, dir, key, iv, src, dst); break;
+        default: ret = crypt_file<aes256>(opt, gcm, dir, key, iv, src, dst); break;
+    }
+    zero(key, sizeof(key));
+
+    return ret;
+}
+
+void usage()
+{
+    fprintf(stderr,
+        "usage: shoc [options] hash <algorithm> <file>...\n"
+        "       shoc [options] encrypt|decrypt ctr|gcm <key> <iv> <in> <out>\n"
+        "\n"
+        "options:\n"
+        "  -m             memory-map input (default)\n"
+        "  -r             read input with double-buffered read-ahead\n"
+        "  -j<n>, -j <n>  hash up to n files in parallel, default is number of cores\n"
+        "  -q             don't report throughput\n"
+        "\n"
+        "algorithms:");
+    for (auto &it : hash_registry)
+        fprintf(stderr, " %.*s", int(it.name.size()), it.name.data());
+    fprintf(stderr, " crc32");
+    fprintf(stderr,
+        "\n\n"
+        "key is 16, 24 or 32 bytes in hex, selecting AES-128/192/256.\n"
+        "iv is 16 bytes in hex for ctr, 12 bytes for gcm, whose output\n"
+        "has 16-byte tag appended. gcm text is limited to 2^36 - 32 bytes.\n");
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    options opt;
+    int i = 1;
+
+    for (; i < argc && argv[i][0] == '-'; ++i) {
+        std::string_view arg = argv[i];
+
+        if (arg == "-m")
+            opt.in = input::map;
+        else if (arg == "-r")
+            opt.in = input::read;
+        else if (arg == "-q")
+            opt.quiet = true;
+        else if (arg == "-j" && i + 1 < argc)
+            opt.threads = strtoul(argv[++i], nullptr, 10);
+        else if (arg.starts_with("-j") && arg.size() > 2)
+            opt.threads = strtoul(argv[i] + 2, nullptr, 10);
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (i >= argc) {
+        usage();
+        return 2;
+    }
+    std::string_view cmd = argv[i++];
+    int rest = argc - i;
+
+    if (cmd == "hash" && rest >= 2)
+        return cmd_hash(opt, argv[i], {argv + i + 1, argv + argc});
+    if ((cmd == "encrypt" || cmd == "decrypt") && rest == 5) {
+        auto dir = cmd == "encrypt" ? direction::encrypt : direction::decrypt;
+        return cmd_crypt(opt, dir, argv[i], argv[i + 1], argv[i + 2], argv[i + 3], argv[i + 4]);
+    }
+    usage();
+    return 2;
 }
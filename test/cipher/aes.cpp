@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include "shoc/cipher/aes.h"
+#include <vector>
 
 using namespace shoc;
 
@@ -87,4 +88,38 @@ TEST(Cipher, AesConstexpr)
     }();
     compare(span_i{encrypt_res}, span_i{exp});
     compare(span_i{decrypt_res}, span_i{msg});
-}
\ No newline at end of file
+}
+
+template<class E>
+static void check_blocks()
+{
+    byte key[E::key_size];
+    std::vector<byte> in(33 * E::block_size);
+    std::vector<byte> exp(in.size());
+    std::vector<byte> out(in.size());
+
+    for (size_t i = 0; i < sizeof(key); ++i)
+        key[i] = i * 7 + 1;
+    for (size_t i = 0; i < in.size(); ++i)
+        in[i] = i * 13 + (i >> 4);
+
+    E cipher {key};
+
+    for (size_t i = 0; i < in.size(); i += E::block_size)
+        cipher.encrypt(span_i<E::block_size>{in.data() + i, E::block_size}, span_o<E::block_size>{exp.data() + i, E::block_size});
+
+    for (size_t n = 0; n <= 33; ++n) {
+        size_t len = n * E::block_size;
+        cipher.encrypt_blocks({in.data(), len}, {out.data(), len});
+        ASSERT_EQ(0, memcmp(exp.data(), out.data(), len)) << n << " blocks";
+        cipher.decrypt_blocks({out.data(), len}, {out.data(), len});
+        ASSERT_EQ(0, memcmp(in.data(), out.data(), len)) << n << " blocks, in-place decrypt";
+    }
+}
+
+TEST(Cipher, AesBlocks)
+{
+    check_blocks<aes128>();
+    check_blocks<aes192>();
+    check_blocks<aes256>();
+}
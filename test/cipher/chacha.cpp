@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "shoc/cipher/chacha.h"
+
+using namespace shoc;
+
+static const char sunscreen[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+
+static void compare(const byte *out, const byte *exp, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+        ASSERT_EQ(out[i], exp[i]) << "at index " << i;
+}
+
+TEST(Cipher, Chacha20)
+{
+    static_assert(chacha20::key_size == 32);
+    static_assert(chacha20::nonce_size == 12);
+    static_assert(chacha20::block_size == 64);
+
+    const byte nonce[12] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x4a, 0x00, 0x00, 0x00, 0x00 };
+    const byte exp[114] = {
+        0x6e, 0x2e, 0x35, 0x9a, 0x25, 0x68, 0xf9, 0x80, 0x41, 0xba, 0x07, 0x28, 0xdd, 0x0d, 0x69, 0x81,
+        0xe9, 0x7e, 0x7a, 0xec, 0x1d, 0x43, 0x60, 0xc2, 0x0a, 0x27, 0xaf, 0xcc, 0xfd, 0x9f, 0xae, 0x0b,
+        0xf9, 0x1b, 0x65, 0xc5, 0x52, 0x47, 0x33, 0xab, 0x8f, 0x59, 0x3d, 0xab, 0xcd, 0x62, 0xb3, 0x57,
+        0x16, 0x39, 0xd6, 0x24, 0xe6, 0x51, 0x52, 0xab, 0x8f, 0x53, 0x0c, 0x35, 0x9f, 0x08, 0x61, 0xd8,
+        0x07, 0xca, 0x0d, 0xbf, 0x50, 0x0d, 0x6a, 0x61, 0x56, 0xa3, 0x8e, 0x08, 0x8a, 0x22, 0xb6, 0x5e,
+        0x52, 0xbc, 0x51, 0x4d, 0x16, 0xcc, 0xf8, 0x06, 0x81, 0x8c, 0xe9, 0x1a, 0xb7, 0x79, 0x37, 0x36,
+        0x5a, 0xf9, 0x0b, 0xbf, 0x74, 0xa3, 0x5b, 0xe6, 0xb4, 0x0b, 0x8e, 0xed, 0xf2, 0x78, 0x5e, 0x42,
+        0x87, 0x4d,
+    };
+    byte key[32];
+    byte out[114];
+
+    for (size_t i = 0; i < sizeof(key); ++i)
+        key[i] = i;
+
+    chacha20_encrypt(key, nonce, 1, (const byte*) sunscreen, out, sizeof(out));
+    compare(out, exp, sizeof(exp));
+    chacha20_decrypt(key, nonce, 1, out, out, sizeof(out));
+    compare(out, (const byte*) sunscreen, sizeof(out));
+}
+
+TEST(Cipher, Chacha20Kernels)
+{
+    constexpr size_t blocks = 37;
+    const byte nonce[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    std::vector<byte> in(blocks * 64);
+    std::vector<byte> exp(blocks * 64);
+    std::vector<byte> out(blocks * 64);
+    byte key[32];
+
+    for (size_t i = 0; i < sizeof(key); ++i)
+        key[i] = i * 7;
+    for (size_t i = 0; i < in.size(); ++i)
+        in[i] = i * 13;
+
+    impl::chacha::word st[16];
+    impl::chacha::word ref[16] = {
+        impl::chacha::sigma[0], impl::chacha::sigma[1], impl::chacha::sigma[2], impl::chacha::sigma[3],
+    };
+    for (int i = 0; i < 8; ++i)
+        ref[4 + i] = impl::chacha::getle(key + i * 4);
+    ref[12] = 0xfffffffa; // Counter wraps within a batch
+    for (int i = 0; i < 3; ++i)
+        ref[13 + i] = impl::chacha::getle(nonce + i * 4);
+
+    std::copy(ref, ref + 16, st);
+    ASSERT_EQ(impl::chacha::crypt_scalar(st, in.data(), exp.data(), blocks), blocks);
+    ASSERT_EQ(st[12], impl::chacha::word(ref[12] + blocks));
+#ifdef __SSE2__
+    std::copy(ref, ref + 16, st);
+    ASSERT_EQ(impl::chacha::crypt_sse2(st, in.data(), out.data(), blocks), 36u);
+    ASSERT_EQ(st[12], impl::chacha::word(ref[12] + 36));
+    compare(out.data(), exp.data(), 36 * 64);
+#endif
+#ifdef SHOC_X86
+    if (cpu_avx2()) {
+        std::copy(ref, ref + 16, st);
+        ASSERT_EQ(impl::chacha::crypt_avx2(st, in.data(), out.data(), blocks), 32u);
+        ASSERT_EQ(st[12], impl::chacha::word(ref[12] + 32));
+        compare(out.data(), exp.data(), 32 * 64);
+    }
+#endif
+    chacha20 ciph {key};
+    ciph.start(nonce, ref[12]);
+    for (size_t pos = 0, n = 1; pos < in.size(); pos += n, n = n * 3 % 700 + 1) {
+        n = std::min(n, in.size() - pos);
+        ciph.crypt(&in[pos], &out[pos], n);
+    }
+    compare(out.data(), exp.data(), out.size());
+}
@@ -1,9 +1,14 @@
 #include <gtest/gtest.h>
+#include <random>
 #include "shoc/hash/md2.h"
 #include "shoc/hash/md4.h"
 #include "shoc/hash/md5.h"
 #include "shoc/hash/sha1.h"
 #include "shoc/hash/sha2.h"
+#include "shoc/hash/sha2_multi.h"
+#include "shoc/hash/any.h"
+#include "shoc/hash/tree.h"
+#include "shoc/hash/merkle.h"
 // #include "shoc/hash/sha3.h"
 #include "shoc/hash/gimli.h"
 
@@ -28,6 +33,71 @@ static void check(const Data (&test)[N])
     }
 }
 
+/**
+ * @brief Initial chaining words of H, taken from saved state of fresh H.
+ *
+ */
+template<class H, class W>
+static void initial_state(W *state)
+{
+    H h;
+    byte iv[H::SAVE_SIZE];
+
+    h.init();
+    h.save_state(iv);
+    for (size_t i = 0; i < H::STATE_SIZE; ++i)
+        state[i] = getle<W>(iv + impl::hash::state_header + i * sizeof(W));
+}
+
+/**
+ * @brief Hash H computed with given compression function instead of its
+ * own dispatch, so portable code is tested on CPUs with SIMD kernels too.
+ * Message is buffered and padded at stop().
+ *
+ */
+template<class H, class W, void (*C)(W*, const byte*, size_t)>
+struct Compressed {
+    static constexpr size_t SIZE = H::SIZE;
+    static constexpr size_t BLOCK_SIZE = H::BLOCK_SIZE;
+
+    void init() { msg.clear(); }
+    void feed(const void *in, size_t len)
+    {
+        auto p = static_cast<const byte*>(in);
+        msg.insert(msg.end(), p, p + len);
+    }
+    void stop(byte *out)
+    {
+        W state[8];
+        uint64_t bits = msg.size() * 8;
+
+        initial_state<H>(state);
+
+        msg.push_back(0x80);
+        while (msg.size() % BLOCK_SIZE != BLOCK_SIZE - 2 * sizeof(W))
+            msg.push_back(0);
+        msg.resize(msg.size() + 2 * sizeof(W));
+        putbe(bits, msg.data() + msg.size() - 8);
+        C(state, msg.data(), msg.size() / BLOCK_SIZE);
+
+        for (size_t i = 0; i < SIZE; ++i)
+            out[i] = state[i / sizeof(W)] >> (8 * (sizeof(W) - 1 - i % sizeof(W)));
+    }
+    void operator()(const void *in, size_t len, byte *out)
+    {
+        init();
+        feed(in, len);
+        stop(out);
+    }
+private:
+    std::vector<byte> msg;
+};
+
+using PortableSha1 = Compressed<Sha1, uint32_t, impl::sha1::compress_portable>;
+
+template<Sha2Type T, class W = std::conditional_t<Sha2<T>::BLOCK_SIZE == 128, uint64_t, uint32_t>>
+using PortableSha2 = Compressed<Sha2<T>, W, impl::sha2::compress_portable<W>>;
+
 TEST(Hash, Md2) 
 {
     const Data test[] = {
@@ -108,6 +178,7 @@ TEST(Hash, Sha1)
             "de9f2c7fd25e1b3afad3e85a0bd17d9b100db4b3" },
     };
     check<Sha1>(test);
+    check<PortableSha1>(test);
 }
 
 TEST(Hash, Sha224)
@@ -123,6 +194,7 @@ TEST(Hash, Sha224)
             "c97ca9a559850ce97a04a96def6d99a9e0e0e2ab14e6b8df265fc0b3" },
     };
     check<Sha2<SHA_224>>(test);
+    check<PortableSha2<SHA_224>>(test);
 }
 
 TEST(Hash, Sha256)
@@ -138,6 +210,7 @@ TEST(Hash, Sha256)
             "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
     };
     check<Sha2<SHA_256>>(test);
+    check<PortableSha2<SHA_256>>(test);
 }
 
 TEST(Hash, Sha384)
@@ -153,6 +226,7 @@ TEST(Hash, Sha384)
             "09330c33f71147e83d192fc782cd1b4753111b173b3b05d22fa08086e3b0f712fcc7c71a557e2db966c3e9fa91746039" },
     };
     check<Sha2<SHA_384>>(test);
+    check<PortableSha2<SHA_384>>(test);
 }
 
 TEST(Hash, Sha512)
@@ -168,6 +242,7 @@ TEST(Hash, Sha512)
             "8e959b75dae313da8cf4f72814fc143f8f7779c6eb9f7fa17299aeadb6889018501d289e4900f7e4331b99dec4b5433ac7d329eeb6dd26545e96e55b874be909" },
     };
     check<Sha2<SHA_512>>(test);
+    check<PortableSha2<SHA_512>>(test);
 }
 
 TEST(Hash, Sha512_224)
@@ -183,6 +258,7 @@ TEST(Hash, Sha512_224)
             "23fec5bb94d60b23308192640b0c453335d664734fe40e7268674af9" },
     };
     check<Sha2<SHA_512_224>>(test);
+    check<PortableSha2<SHA_512_224>>(test);
 }
 
 TEST(Hash, Sha512_256)
@@ -198,6 +274,7 @@ TEST(Hash, Sha512_256)
             "3928e184fb8690f840da3988121d31be65cb9d3ef83ee6146feac861e19b563a" },
     };
     check<Sha2<SHA_512_256>>(test);
+    check<PortableSha2<SHA_512_256>>(test);
 }
 
 TEST(Hash, Gimli)
@@ -215,4 +292,497 @@ TEST(Hash, Gimli)
             "b0634b2c0b082aedc5c0a2fe4ee3adcfc989ec05de6f00addb04b3aaac271f67" },
     };
     check<Gimli>(test);
-}
\ No newline at end of file
+}
+
+template<class Hash>
+static void check_long(std::string_view exp)
+{
+    const std::string msg(1000000, 'a');
+    Hash hash;
+    byte one[Hash::SIZE] = {};
+    byte bin[Hash::SIZE] = {};
+    char str[Hash::SIZE * 2 + 1] = {};
+
+    hash(msg.data(), msg.size(), one);
+    utl::bin_to_str(one, sizeof(one), str, sizeof(str));
+    EXPECT_STREQ(exp.data(), str);
+
+    hash(msg.data(), 3000, one);
+
+    for (size_t step : {1, 3, 63, 64, 65, 127, 128, 129, 1000}) {
+        hash.init();
+        for (size_t i = 0; i < 3000; i += step)
+            hash.feed(msg.data() + i, std::min(step, 3000 - i));
+        hash.stop(bin);
+        EXPECT_EQ(0, memcmp(one, bin, sizeof(bin))) << "Step " << step;
+    }
+}
+
+TEST(Hash, LongChunked)
+{
+    check_long<Md4>("bbce80cc6bb65e5c6745e30d4eeca9a4");
+    check_long<Md5>("7707d6ae4e027c70eea2a935c2296f21");
+    check_long<Sha1>("34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    check_long<Sha2<SHA_224>>("20794655980c91d8bbb4c1ea97618a4bf03f42581948b2ee4ee7ad67");
+    check_long<Sha2<SHA_256>>("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    check_long<Sha2<SHA_384>>("9d0e1809716474cb086e834e310a4a1ced149e9c00f248527972cec5704c2a5b07b8b3dc38ecc4ebae97ddd87f3d8985");
+    check_long<Sha2<SHA_512>>("e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973ebde0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b");
+    check_long<Sha2<SHA_512_224>>("37ab331d76f0d36de422bd0edeb22a28accd487b7a8453ae965dd287");
+    check_long<Sha2<SHA_512_256>>("9a59a052930187a97038cae692f30708aa6491923ef5194394dc68d56c74fb21");
+    check_long<PortableSha1>("34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    check_long<PortableSha2<SHA_224>>("20794655980c91d8bbb4c1ea97618a4bf03f42581948b2ee4ee7ad67");
+    check_long<PortableSha2<SHA_256>>("cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    check_long<PortableSha2<SHA_384>>("9d0e1809716474cb086e834e310a4a1ced149e9c00f248527972cec5704c2a5b07b8b3dc38ecc4ebae97ddd87f3d8985");
+    check_long<PortableSha2<SHA_512>>("e718483d0ce769644e2e42c7bc15b4638e1f98b13b2044285632a803afa973ebde0ff244877ea60a4cb0432ce577c31beb009c5c2c49aa2e4eadb217ad8cc09b");
+    check_long<PortableSha2<SHA_512_224>>("37ab331d76f0d36de422bd0edeb22a28accd487b7a8453ae965dd287");
+    check_long<PortableSha2<SHA_512_256>>("9a59a052930187a97038cae692f30708aa6491923ef5194394dc68d56c74fb21");
+}
+
+template<size_t L>
+static void check_multi(std::span<const span_i<>> msgs, impl::sha2::multi_kernel kernel)
+{
+    std::vector<sha256_digest> out(msgs.size());
+    impl::sha2::multi_run<L>(msgs, out, kernel);
+
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        sha256_digest exp;
+        Sha2<SHA_256>{}(msgs[i].data(), msgs[i].size(), exp.data());
+        EXPECT_EQ(exp, out[i]) << "Lanes " << L << ", message " << i;
+    }
+}
+
+TEST(Hash, Sha256Multi)
+{
+    std::vector<byte> data(4096);
+    std::vector<span_i<>> msgs;
+
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = i * 7 + (i >> 8);
+
+    for (size_t len = 0; len <= 200; ++len)
+        msgs.emplace_back(data.data() + len, len);
+    for (size_t i = 0; i < 40; ++i)
+        msgs.emplace_back(data.data() + i, 64);
+    for (size_t i = 0; i < 20; ++i)
+        msgs.emplace_back(data.data(), (i * 997) % data.size());
+
+    std::vector<sha256_digest> out(msgs.size());
+    sha256_multi(msgs, out);
+    sha256_multi({}, {});
+
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        sha256_digest exp;
+        Sha2<SHA_256>{}(msgs[i].data(), msgs[i].size(), exp.data());
+        EXPECT_EQ(exp, out[i]) << "Message " << i;
+    }
+#ifdef SHOC_X86
+    if (cpu_avx2())
+        check_multi<8>(msgs, impl::sha2::multi_avx2);
+    if (cpu_avx512())
+        check_multi<16>(msgs, impl::sha2::multi_avx512);
+#endif
+}
+
+/**
+ * @brief Compare compression kernel with portable one on random blocks,
+ * starting from initial state of H and chaining calls of various length.
+ *
+ */
+template<class H, class W>
+static void check_compress(void (*kernel)(W*, const byte*, size_t), void (*portable)(W*, const byte*, size_t))
+{
+    std::mt19937 gen {H::SIZE};
+    std::vector<byte> data(32 * H::BLOCK_SIZE);
+    W exp[H::STATE_SIZE];
+    W res[H::STATE_SIZE];
+
+    for (auto &it : data)
+        it = gen();
+
+    initial_state<H>(exp);
+    initial_state<H>(res);
+
+    for (size_t off = 0, n = 1; off + n * H::BLOCK_SIZE <= data.size(); off += n * H::BLOCK_SIZE, n += 2) {
+        portable(exp, data.data() + off, n);
+        kernel(res, data.data() + off, n);
+        ASSERT_EQ(0, memcmp(exp, res, sizeof(exp))) << H::SIZE * 8 << " bits, " << n << " blocks at " << off;
+    }
+}
+
+TEST(Hash, Sha256Shani)
+{
+#ifdef SHOC_X86
+    if (cpu_sha()) {
+        check_compress<Sha2<SHA_224>>(impl::sha2::compress_shani, impl::sha2::compress_portable<uint32_t>);
+        check_compress<Sha2<SHA_256>>(impl::sha2::compress_shani, impl::sha2::compress_portable<uint32_t>);
+    }
+#endif
+}
+
+TEST(Hash, Sha1Shani)
+{
+#ifdef SHOC_X86
+    if (cpu_sha())
+        check_compress<Sha1>(impl::sha1::compress_shani, impl::sha1::compress_portable);
+#endif
+}
+
+TEST(Hash, Sha512Avx2)
+{
+#ifdef SHOC_X86
+    if (cpu_avx2()) {
+        check_compress<Sha2<SHA_384>>(impl::sha2::compress512_avx2, impl::sha2::compress_portable<uint64_t>);
+        check_compress<Sha2<SHA_512>>(impl::sha2::compress512_avx2, impl::sha2::compress_portable<uint64_t>);
+        check_compress<Sha2<SHA_512_256>>(impl::sha2::compress512_avx2, impl::sha2::compress_portable<uint64_t>);
+    }
+#endif
+}
+
+template<class... H>
+struct hash_list {};
+
+using state_hashes = hash_list<Md5, Sha1, Sha2<SHA_224>, Sha2<SHA_256>, Sha2<SHA_384>, Sha2<SHA_512>,
+    Sha2<SHA_512_224>, Sha2<SHA_512_256>, Gimli>;
+
+template<class H, class... Other>
+static void check_foreign_state(const byte *saved, size_t len, hash_list<Other...>)
+{
+    auto reject = [&]<class O>(O other) {
+        if constexpr (!std::is_same_v<H, O>) {
+            EXPECT_FALSE(other.load_state(saved, len)) << typeid(H).name() << " state loaded into " << typeid(O).name();
+        }
+    };
+    (reject(Other{}), ...);
+}
+
+template<class H>
+static void check_state()
+{
+    std::vector<byte> msg(1000);
+    byte exp[H::SIZE];
+    byte out[H::SIZE];
+    byte saved[H::SAVE_SIZE];
+
+    for (size_t i = 0; i < msg.size(); ++i)
+        msg[i] = i * 13 + 1;
+
+    H{}(msg.data(), msg.size(), exp);
+
+    for (size_t split : {0, 1, 9, 63, 64, 65, 127, 128, 500, 999, 1000}) {
+        H hash, resumed;
+        hash.init();
+        hash.feed(msg.data(), split);
+
+        size_t len = hash.save_state(saved);
+        EXPECT_LE(len, H::SAVE_SIZE);
+        ASSERT_TRUE(resumed.load_state(saved, len)) << "Split " << split;
+        resumed.feed(msg.data() + split, msg.size() - split);
+        resumed.stop(out);
+        EXPECT_EQ(0, memcmp(exp, out, sizeof(out))) << "Split " << split;
+
+        auto fork = hash.clone();
+        fork.feed(msg.data() + split, msg.size() - split);
+        fork.stop(out);
+        EXPECT_EQ(0, memcmp(exp, out, sizeof(out))) << "Split " << split;
+
+        check_foreign_state<H>(saved, len, state_hashes{});
+        EXPECT_FALSE(resumed.load_state(saved, len - 1));
+        EXPECT_FALSE(resumed.load_state(saved, len + 1));
+        saved[0] ^= 1;
+        EXPECT_FALSE(resumed.load_state(saved, len));
+        saved[0] ^= 1;
+        saved[1] ^= 1;
+        EXPECT_FALSE(resumed.load_state(saved, len));
+    }
+}
+
+TEST(Hash, State)
+{
+    check_state<Md5>();
+    check_state<Sha1>();
+    check_state<Sha2<SHA_224>>();
+    check_state<Sha2<SHA_256>>();
+    check_state<Sha2<SHA_384>>();
+    check_state<Sha2<SHA_512>>();
+    check_state<Sha2<SHA_512_224>>();
+    check_state<Sha2<SHA_512_256>>();
+    check_state<Gimli>();
+}
+
+struct Wide {
+    static constexpr size_t SIZE        = Sha2<SHA_256>::SIZE;
+    static constexpr size_t BLOCK_SIZE  = Sha2<SHA_256>::BLOCK_SIZE;
+public:
+    void init()                             { hash.init(); }
+    void feed(const void *in, size_t len)   { hash.feed(in, len); }
+    void stop(byte *out)                    { hash.stop(out); }
+private:
+    Sha2<SHA_256> hash;
+    byte pad[any_hash::BUFFER_SIZE];
+};
+
+static_assert(hash_function<Md5>);
+static_assert(hash_function<Sha2<SHA_512>>);
+static_assert(hash_function<Gimli>);
+static_assert(hash_function<Wide>);
+static_assert(!hash_function<int>);
+
+TEST(Hash, Any)
+{
+    const char *msg = "The quick brown fox jumps over the lazy dog";
+    const size_t len = strlen(msg);
+    char str[129];
+    byte bin[64];
+
+    auto hex = [&](any_hash &h) {
+        h(msg, len, bin);
+        utl::bin_to_str(bin, h.size(), str, h.size() * 2 + 1);
+        return std::string(str, h.size() * 2);
+    };
+    auto sha256 = make_hash("sha256");
+    ASSERT_TRUE(sha256);
+    EXPECT_EQ(32u, sha256.size());
+    EXPECT_EQ(64u, sha256.block_size());
+    EXPECT_EQ("d7a8fbb307d7809469ca9abcb0082e4f8d5651e46d3cdb762d02d0bf37c9e592", hex(sha256));
+
+    auto md5 = make_hash("md5");
+    EXPECT_EQ("9e107d9d372bb6826bd81d3542a419d6", hex(md5));
+
+    EXPECT_FALSE(make_hash("sha3-256"));
+    EXPECT_EQ(0u, make_hash("").size());
+
+    for (auto &it : hash_registry) {
+        auto h = it.make();
+        ASSERT_TRUE(h) << it.name;
+        EXPECT_LE(h.size(), sizeof(bin)) << it.name;
+    }
+
+    for (auto h : {any_hash(std::in_place_type<Sha2<SHA_256>>), any_hash(std::in_place_type<Wide>)}) {
+        h.init();
+        h.feed(msg, 10);
+
+        auto copy = h;
+        any_hash moved;
+        moved = std::move(copy);
+        EXPECT_FALSE(copy);
+
+        h.feed(msg + 10, len - 10);
+        moved.feed(msg + 10, len - 10);
+
+        byte a[32], b[32];
+        h.stop(a);
+        moved.stop(b);
+        EXPECT_EQ(0, memcmp(a, b, 32));
+        EXPECT_EQ("d7a8fbb307d7809469ca9abcb0082e4f8d5651e46d3cdb762d02d0bf37c9e592", hex(h));
+    }
+}
+
+static std::string tree_hex(const byte *bin)
+{
+    char str[65];
+    utl::bin_to_cstr(bin, 32, str, sizeof(str));
+    return str;
+}
+
+TEST(Hash, Tree)
+{
+    const struct {
+        size_t len;
+        size_t leaf;
+        std::string_view exp;
+    } test[] = {
+        { 0,                    100,        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { 1,                    100,        "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d" },
+        { 100,                  100,        "56fee4b12b280ea1e7c1b550002bb18b342ccbd7229cd4b147ea07aa1a691294" },
+        { 1000,                 100,        "7f93d4da68f5e258c11f9d9237a0fac391272dbc4cb3591e9873386019fe935e" },
+        { 1001,                 100,        "c8af2bc9998b2d5609f32b2abf15fe8a73fad29b6c07c8ea3d2f67b273aa7ccd" },
+        { 6400,                 100,        "620905399edeae7a28ed06c96dd27bf9d50557ff9afb90dec652480487b02358" },
+        { 3 * (1 << 20) + 12345, 1 << 20,   "d67e1b4151ada69f45ed5da5959e1315268d88da73fa8cb5bef882c240215e67" },
+    };
+    std::vector<byte> data(3 * (1 << 20) + 12345);
+    byte out[32];
+
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = i * 7 + (i >> 8);
+
+    for (auto &it : test) {
+        for (size_t threads : {1, 3, 8}) {
+            sha256_tree_hash(data.data(), it.len, out, it.leaf, threads);
+            EXPECT_EQ(it.exp, tree_hex(out)) << it.len << " bytes, " << threads << " threads";
+        }
+        sha256_tree tree;
+        tree.build(data.data(), it.len, out, it.leaf, 4);
+        EXPECT_EQ(it.exp, tree_hex(out)) << it.len << " bytes";
+
+        tree.init(it.leaf);
+        for (size_t off = 0; off < it.len; off += 77)
+            tree.feed(data.data() + off, std::min<size_t>(77, it.len - off));
+        tree.stop(out);
+        EXPECT_EQ(it.exp, tree_hex(out)) << it.len << " bytes, streamed";
+        EXPECT_EQ(impl::tree::leaves(it.len, it.leaf), tree.leaves().size());
+    }
+}
+
+TEST(Hash, TreeUpdate)
+{
+    std::vector<byte> data(1234);
+    sha256_tree tree;
+    byte out[32];
+    byte exp[32];
+
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = i * 7 + (i >> 8);
+
+    tree.build(data.data(), data.size(), out, 100);
+    ASSERT_EQ(13u, tree.leaves().size());
+
+    for (size_t leaf : {0, 5, 11, 12}) {
+        auto p = data.data() + leaf * 100;
+        size_t n = std::min<size_t>(100, data.size() - leaf * 100);
+
+        EXPECT_TRUE(tree.verify(leaf, p, n));
+        p[n / 2] ^= 0x5a;
+        EXPECT_FALSE(tree.verify(leaf, p, n));
+        ASSERT_TRUE(tree.update(leaf, p, n));
+        EXPECT_TRUE(tree.verify(leaf, p, n));
+
+        sha256_tree_hash(data.data(), data.size(), exp, 100, 1);
+        EXPECT_EQ(tree_hex(exp), tree_hex(tree.root().data())) << "Leaf " << leaf;
+    }
+    EXPECT_FALSE(tree.verify(13, data.data(), 100));
+    EXPECT_FALSE(tree.update(12, data.data(), 100));
+    EXPECT_FALSE(tree.update(3, data.data(), 99));
+}
+
+TEST(Hash, ParallelForSteal)
+{
+    for (size_t count : {0, 1, 7, 1000, 12345}) {
+        for (size_t grain : {1, 3, 64}) {
+            std::vector<std::atomic<int>> hits(count);
+            parallel_for_steal(count, 4, grain, [&](size_t begin, size_t end) {
+                EXPECT_LE(end - begin, grain);
+                for (size_t i = begin; i < end; ++i)
+                    hits[i]++;
+            });
+            for (size_t i = 0; i < count; ++i)
+                ASSERT_EQ(1, hits[i]) << count << " items, grain " << grain << ", item " << i;
+        }
+    }
+}
+
+template<size_t N>
+static std::string merkle_hex(const std::array<byte, N> &bin)
+{
+    char str[N * 2 + 1];
+    utl::bin_to_cstr(bin.data(), N, str, sizeof(str));
+    return str;
+}
+
+template<Sha2Type T>
+static void check_proofs(const merkle_tree<T> &tree, size_t size)
+{
+    using digest = typename merkle_tree<T>::digest;
+
+    auto root = tree.root(size);
+    digest bad = root;
+    bad[0] ^= 1;
+
+    for (size_t i = 0; i < size; ++i) {
+        auto proof = tree.prove(i, size);
+        EXPECT_TRUE(merkle_tree<T>::verify(tree.leaf(i), i, size, proof, root)) << "Leaf " << i << " of " << size;
+        EXPECT_FALSE(merkle_tree<T>::verify(tree.leaf(i), i, size, proof, bad));
+        EXPECT_FALSE(merkle_tree<T>::verify(tree.leaf(i), size, size, proof, root));
+        if ((i ^ 1) < size) {
+            EXPECT_FALSE(merkle_tree<T>::verify(tree.leaf(i), i ^ 1, size, proof, root));
+        }
+        if (!proof.empty()) {
+            proof.back()[7] ^= 0x80;
+            EXPECT_FALSE(merkle_tree<T>::verify(tree.leaf(i), i, size, proof, root));
+            proof.pop_back();
+            EXPECT_FALSE(merkle_tree<T>::verify(tree.leaf(i), i, size, proof, root));
+        }
+    }
+}
+
+TEST(Hash, Merkle)
+{
+    // Leaves and roots of RFC 6962 reference tests
+    const std::string_view leaves[] = {
+        { "", 0 },
+        { "\x00", 1 },
+        { "\x10", 1 },
+        { "\x20\x21", 2 },
+        { "\x30\x31", 2 },
+        { "\x40\x41\x42\x43", 4 },
+        { "\x50\x51\x52\x53\x54\x55\x56\x57", 8 },
+        { "\x60\x61\x62\x63\x64\x65\x66\x67\x68\x69\x6a\x6b\x6c\x6d\x6e\x6f", 16 },
+    };
+    const std::string_view roots[] = {
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+        "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d",
+        "fac54203e7cc696cf0dfcb42c92a1d9dbaf70ad9e621f4bd8d98662f00e3c125",
+        "aeb6bcfe274b70a14fb067a5e5578264db0fa9b51af5e0ba159158f329e06e77",
+        "d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7",
+        "4e3bbb1f7b478dcfe71fb631631519a3bca12c9aefca1612bfce4c13a86264d4",
+        "76e67dadbcdf1e10e1b74ddc608abd2f98dfb16fbce75277b5232a127f2087ef",
+        "ddb89be403809e325750d3d263cd78929c2942b7942a34b77e122c9594a74c8c",
+        "5dc9da79a70659a9ad559cb701ded9a2ab9d823aad2f4960cfe370eff4604328",
+    };
+    merkle_tree tree;
+
+    EXPECT_EQ(roots[0], merkle_hex(tree.root()));
+
+    for (size_t i = 0; i < std::size(leaves); ++i) {
+        tree.append(leaves[i].data(), leaves[i].size());
+        EXPECT_EQ(i + 1, tree.size());
+        EXPECT_EQ(roots[i + 1], merkle_hex(tree.root())) << i + 1 << " leaves";
+    }
+    for (size_t n = 0; n <= std::size(leaves); ++n) {
+        EXPECT_EQ(roots[n], merkle_hex(tree.root(n))) << n << " leaves, historical";
+        check_proofs(tree, n);
+    }
+    merkle_tree<SHA_224> tree224;
+    merkle_tree<SHA_512> tree512;
+    std::vector<span_i<>> spans;
+
+    for (auto it : leaves)
+        spans.push_back({ reinterpret_cast<const byte*>(it.data()), it.size() });
+    tree224.append({ spans.data(), 7 });
+    tree512.append({ spans.data(), 7 });
+
+    EXPECT_EQ("96e05f7a768d65e7e2712d91f2f96b1968856145ecf8e996a5d63927", merkle_hex(tree224.root()));
+    EXPECT_EQ("63f7a63312288705b17d764fa8147bfaffe9d5f2968be4532e50280fa04fa6e2"
+              "926463d7ed17f5c7a49892aaccd377f4b034147b18c88e7019a83bd52c9f6dd2", merkle_hex(tree512.root()));
+    check_proofs(tree512, 7);
+}
+
+TEST(Hash, MerkleBatch)
+{
+    std::vector<std::vector<byte>> data(1000);
+    std::vector<span_i<>> spans;
+
+    for (size_t i = 0; i < data.size(); ++i) {
+        for (size_t j = 0; j < i % 70; ++j)
+            data[i].push_back(i * 7 + j);
+        spans.push_back(data[i]);
+    }
+    merkle_tree one;
+    for (auto &it : data)
+        one.append(it.data(), it.size());
+
+    EXPECT_EQ("1dc68f5f612ae90829dedf20d613bf342f6db879d55a22991c87a557e1dd5291", merkle_hex(one.root()));
+    EXPECT_EQ("770b1254cf35c4a007d33935c9f16595e1bc625bdccf38e79bf0476463fee42b", merkle_hex(one.root(777)));
+
+    for (size_t step : {1, 3, 64, 255, 1000}) {
+        merkle_tree tree;
+        for (size_t i = 0; i < spans.size(); i += step)
+            tree.append({ spans.data() + i, std::min(step, spans.size() - i) });
+
+        ASSERT_EQ(data.size(), tree.size());
+        EXPECT_EQ(merkle_hex(one.root()), merkle_hex(tree.root())) << "Step " << step;
+        for (size_t i = 0; i < data.size(); ++i)
+            ASSERT_EQ(one.leaf(i), tree.leaf(i)) << "Step " << step << ", leaf " << i;
+    }
+    for (size_t size : {1, 2, 513, 777, 1000})
+        check_proofs(one, size);
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include "shoc/mac/cmac.h"
+#include "shoc/cipher/aes.h"
+#include <vector>
+
+using namespace shoc;
+
+static const byte key[16] = {
+    0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c, 
+};
+
+static const byte msg[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a, 
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51, 
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10,
+};
+
+static const struct {
+    size_t len;
+    byte exp[16];
+} vectors[] = {
+    { 0,  { 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28, 0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 } },
+    { 16, { 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44, 0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c } },
+    { 40, { 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30, 0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 } },
+    { 64, { 0x51, 0xf0, 0xbe, 0xbf, 0x7e, 0x3b, 0x9d, 0x92, 0xfc, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3c, 0xfe } },
+};
+
+static void compare(const byte *out, const byte *exp, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+        ASSERT_EQ(out[i], exp[i]) << "At index " << i;
+}
+
+TEST(Cmac, Aes128)
+{
+    byte tag[16];
+
+    for (auto &it : vectors) {
+        cmac<aes128>(key, msg, it.len, tag);
+        compare(tag, it.exp, sizeof(tag));
+    }
+}
+
+TEST(Cmac, ContextAes128)
+{
+    byte tag[16];
+    cmac_context<aes128> ctx {key};
+
+    for (auto &it : vectors) {
+        for (size_t step : {1, 3, 15, 16, 17}) {
+            for (size_t pos = 0; pos < it.len; pos += step)
+                ctx.update(msg + pos, std::min(step, it.len - pos));
+            ctx.finish(tag);
+            compare(tag, it.exp, sizeof(tag));
+        }
+    }
+}
+
+TEST(Cmac, BatchAes128)
+{
+    std::vector<byte> data(4096);
+    std::vector<span_i<>> msgs;
+    std::vector<byte> tags;
+    byte exp[16];
+
+    for (size_t i = 0; i < data.size(); ++i)
+        data[i] = i * 7;
+    for (size_t i = 0, pos = 0; pos + i <= data.size(); pos += i, i = (i * 5 + 3) % 97)
+        msgs.push_back(span_i<>{&data[pos], i});
+    tags.resize(msgs.size() * 16);
+
+    cmac_context<aes128> ctx {key};
+    ctx.batch(msgs, tags);
+
+    for (size_t i = 0; i < msgs.size(); ++i) {
+        cmac<aes128>(key, msgs[i].data(), msgs[i].size(), exp);
+        compare(&tags[i * 16], exp, sizeof(exp));
+    }
+    for (auto &it : vectors)
+        msgs[&it - vectors] = span_i<>{msg, it.len};
+    ctx.batch(std::span<const span_i<>>{msgs.data(), 4}, tags);
+    for (auto &it : vectors)
+        compare(&tags[(&it - vectors) * 16], it.exp, 16);
+}
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include "shoc/mac/poly1305.h"
+
+using namespace shoc;
+
+static void compare(const byte *out, const byte *exp, size_t len)
+{
+    for (size_t i = 0; i < len; ++i)
+        ASSERT_EQ(out[i], exp[i]) << "At index " << i;
+}
+
+TEST(Poly1305, Rfc8439)
+{
+    const byte key[32] = {
+        0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33, 0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd, 0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b,
+    };
+    const byte exp[16] = {
+        0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6, 0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9,
+    };
+    const char msg[] = "Cryptographic Forum Research Group";
+    byte tag[16];
+
+    poly1305(key, msg, sizeof(msg) - 1, tag);
+    compare(tag, exp, sizeof(exp));
+
+    for (size_t step : {1, 5, 16, 17}) {
+        poly1305_context ctx {key};
+        for (size_t pos = 0; pos < sizeof(msg) - 1; pos += step)
+            ctx.update(msg + pos, std::min(step, sizeof(msg) - 1 - pos));
+        ctx.finish(tag);
+        compare(tag, exp, sizeof(exp));
+    }
+}
+
+TEST(Poly1305, Wrap)
+{
+    // RFC 8439 Appendix A.3 test vectors #6 and #9, exercise final reduction
+    byte key[32] = { 2 };
+    byte msg[16];
+    byte tag[16];
+    byte exp[16] = { 3 };
+
+    for (auto &m : msg)
+        m = 0xff;
+    poly1305(key, msg, sizeof(msg), tag);
+    compare(tag, exp, sizeof(exp));
+
+    for (auto &k : key)
+        k = 0;
+    key[0] = 2;
+    for (auto &m : msg)
+        m = 0xff;
+    msg[0] = 0xfd;
+    const byte exp_9[16] = { 0xfa, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    poly1305(key, msg, sizeof(msg), tag);
+    compare(tag, exp_9, sizeof(exp_9));
+}
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <random>
+#include <vector>
 #include "shoc/cipher/aes.h"
 #include "shoc/mode/ecb.h"
 #include "shoc/mode/cbc.h"
@@ -7,6 +9,13 @@
 #include "shoc/mode/ctr.h"
 #include "shoc/mode/ccm.h"
 #include "shoc/mode/gcm.h"
+#include "shoc/mode/ocb.h"
+#include "shoc/mode/xts.h"
+#include "shoc/mode/kw.h"
+#include "shoc/mode/siv.h"
+#include "shoc/mode/chacha20_poly1305.h"
+#include "shoc/mode/record.h"
+#include "shoc/mode/stream.h"
 
 using namespace shoc;
 
@@ -31,6 +40,26 @@ static void compare(byte *out, const byte *exp, size_t len)
     }
 }
 
+static constexpr size_t stream_len = 1000;
+
+template<class F>
+static void feed_chunks(F &&f, size_t len, unsigned seed)
+{
+    std::mt19937 gen {seed};
+    std::uniform_int_distribution<size_t> dist {0, 40};
+
+    for (size_t pos = 0, n; pos < len; pos += n) {
+        n = std::min(dist(gen), len - pos);
+        f(pos, n);
+    }
+}
+
+static void stream_input(byte *in)
+{
+    for (size_t i = 0; i < stream_len; ++i)
+        in[i] = i * 13 + 5;
+}
+
 TEST(Ecb, EncryptDecryptAes128)
 {
     const byte exp[64] = {
@@ -41,12 +70,31 @@ TEST(Ecb, EncryptDecryptAes128)
     };
     byte out[64] = {};
 
-    ecb_encrypt<aes128>(test_key, test_in, out, sizeof(test_in));
+    ecb_encrypt<aes128>(test_key, test_in, out);
     compare(out, exp, sizeof(out));
-    ecb_decrypt<aes128>(test_key, out, out, sizeof(out));
+    ecb_decrypt<aes128>(test_key, out, out);
     compare(out, test_in, sizeof(test_in));
 }
 
+TEST(Ecb, ParallelAes128)
+{
+    std::vector<byte> in(16 * 20000);
+    std::vector<byte> exp(in.size());
+    std::vector<byte> out(in.size());
+
+    for (size_t i = 0; i < in.size(); ++i)
+        in[i] = i * 31;
+
+    ecb_encrypt<aes128>(test_key, in, exp);
+
+    for (size_t threads : {1, 2, 3, 7}) {
+        ecb_encrypt_parallel<aes128>(test_key, in, out, threads);
+        compare(out.data(), exp.data(), out.size());
+        ecb_decrypt_parallel<aes128>(test_key, out, out, threads);
+        compare(out.data(), in.data(), in.size());
+    }
+}
+
 TEST(Cbc, EncryptDecryptAes128)
 {
     const byte iv[16] = {
@@ -104,6 +152,51 @@ TEST(Ofb, EncryptDecryptAes128)
     compare(out, test_in, sizeof(test_in));
 }
 
+TEST(Cfb, DecryptBatchAes128)
+{
+    const byte iv[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    };
+    byte in[301];
+    byte enc[301];
+    byte dec[301];
+
+    for (size_t i = 0; i < sizeof(in); ++i)
+        in[i] = i * 7;
+
+    for (size_t len : {0, 1, 15, 16, 17, 64, 128, 143, 301}) {
+        cfb_encrypt<aes128>(test_key, iv, in, enc, len);
+        cfb_decrypt<aes128>(test_key, iv, enc, dec, len);
+        compare(dec, in, len);
+        cfb_decrypt<aes128>(test_key, iv, enc, enc, len);
+        compare(enc, in, len);
+    }
+}
+
+TEST(Ofb, KeystreamAes128)
+{
+    const byte iv[16] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    };
+    const byte nil[200] = {};
+    byte exp[200];
+    byte out[200];
+    byte reg[16];
+
+    ofb_encrypt<aes128>(test_key, iv, nil, exp, sizeof(exp));
+
+    aes128 ciph {test_key};
+    copy(reg, iv, 16);
+    ofb_keystream(ciph, reg, out, 48);
+    ofb_keystream(ciph, reg, out + 48, 144);
+    ofb_keystream(ciph, reg, out + 192, 8);
+    compare(out, exp, sizeof(exp));
+
+    xorb(out, test_in, out, sizeof(test_in));
+    ofb_decrypt<aes128>(test_key, iv, out, out, sizeof(test_in));
+    compare(out, test_in, sizeof(test_in));
+}
+
 TEST(Ctr, EncryptDecryptAes128)
 {
     const byte iv[16] = {
@@ -123,6 +216,96 @@ TEST(Ctr, EncryptDecryptAes128)
     compare(out, test_in, sizeof(test_in));
 }
 
+TEST(Cbc, ContextAes128)
+{
+    const byte iv[16] = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf };
+    const size_t len = stream_len & ~size_t(0xf);
+    byte in[stream_len];
+    byte exp[stream_len];
+    byte out[stream_len + 16];
+
+    stream_input(in);
+    cbc_encrypt<aes128>(test_key, iv, in, exp, len);
+
+    for (unsigned seed = 0; seed < 4; ++seed) {
+        size_t done = 0;
+        cbc_context<aes128> enc {test_key, iv};
+        feed_chunks([&](size_t pos, size_t n) { done += enc.update(in + pos, out + done, n); }, len, seed);
+        ASSERT_TRUE(enc.finish());
+        ASSERT_EQ(done, len);
+        compare(out, exp, len);
+
+        done = 0;
+        cbc_context<aes128> dec {test_key, iv, direction::decrypt};
+        feed_chunks([&](size_t pos, size_t n) { done += dec.update(exp + pos, out + done, n); }, len, seed);
+        ASSERT_TRUE(dec.finish());
+        ASSERT_EQ(done, len);
+        compare(out, in, len);
+    }
+    cbc_context<aes128> ctx {test_key, iv};
+    ASSERT_EQ(ctx.update(in, out, 20), 16u);
+    ASSERT_FALSE(ctx.finish());
+}
+
+TEST(Cfb, ContextAes128)
+{
+    const byte iv[16] = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf };
+    byte in[stream_len];
+    byte exp[stream_len];
+    byte out[stream_len];
+
+    stream_input(in);
+    cfb_encrypt<aes128>(test_key, iv, in, exp, stream_len);
+
+    for (unsigned seed = 0; seed < 4; ++seed) {
+        cfb_context<aes128> enc {test_key, iv};
+        feed_chunks([&](size_t pos, size_t n) { enc.update(in + pos, out + pos, n); }, stream_len, seed);
+        enc.finish();
+        compare(out, exp, stream_len);
+
+        cfb_context<aes128> dec {test_key, iv, direction::decrypt};
+        feed_chunks([&](size_t pos, size_t n) { dec.update(out + pos, out + pos, n); }, stream_len, seed);
+        dec.finish();
+        compare(out, in, stream_len);
+    }
+}
+
+TEST(Ofb, ContextAes128)
+{
+    const byte iv[16] = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf };
+    byte in[stream_len];
+    byte exp[stream_len];
+    byte out[stream_len];
+
+    stream_input(in);
+    ofb_encrypt<aes128>(test_key, iv, in, exp, stream_len);
+
+    for (unsigned seed = 0; seed < 4; ++seed) {
+        ofb_context<aes128> ctx {test_key, iv};
+        feed_chunks([&](size_t pos, size_t n) { ctx.update(in + pos, out + pos, n); }, stream_len, seed);
+        ctx.finish();
+        compare(out, exp, stream_len);
+    }
+}
+
+TEST(Ctr, ContextAes128)
+{
+    const byte iv[16] = { 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xfe };
+    byte in[stream_len];
+    byte exp[stream_len];
+    byte out[stream_len];
+
+    stream_input(in);
+    ctr_encrypt<aes128, 2>(test_key, iv, in, exp, stream_len);
+
+    for (unsigned seed = 0; seed < 4; ++seed) {
+        ctr_context<aes128, 2> ctx {test_key, iv};
+        feed_chunks([&](size_t pos, size_t n) { ctx.update(in + pos, out + pos, n); }, stream_len, seed);
+        ctx.finish();
+        compare(out, exp, stream_len);
+    }
+}
+
 TEST(Ccm, EncryptDecryptAes128)
 {
     byte enc[23];
@@ -143,6 +326,90 @@ TEST(Ccm, EncryptDecryptAes128)
     compare(dec, in, sizeof(in));
 }
 
+TEST(Ccm, FusedAes128)
+{
+    const byte nonce[] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c };
+    byte in[stream_len];
+    byte enc[stream_len];
+    byte dec[stream_len];
+    byte tag[16];
+
+    stream_input(in);
+
+    for (size_t len : {0, 1, 16, 31, 48, 255, 1000}) {
+        for (size_t aad_len : {0, 14, 40}) {
+            ASSERT_TRUE(ccm_encrypt<aes128>(test_key, nonce, in, aad_len, tag, sizeof(tag), in, enc, len));
+            ASSERT_TRUE(ccm_decrypt<aes128>(test_key, nonce, in, aad_len, tag, sizeof(tag), enc, dec, len));
+            compare(dec, in, len);
+            ASSERT_TRUE(ccm_decrypt<aes128>(test_key, nonce, in, aad_len, tag, sizeof(tag), enc, enc, len));
+            compare(enc, in, len);
+        }
+    }
+    ASSERT_FALSE(ccm_encrypt<aes128>(test_key, nonce, nullptr, 0, tag, 5, in, enc, 16));
+    ASSERT_TRUE(ccm_encrypt<aes128>(test_key, nonce, nullptr, 0, tag, 8, in, enc, 16));
+    enc[3] ^= 1;
+    ASSERT_FALSE(ccm_decrypt<aes128>(test_key, nonce, nullptr, 0, tag, 8, enc, dec, 16));
+}
+
+TEST(Ccm, ContextAes128)
+{
+    const byte nonce[] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c };
+    const size_t aad_len = 100;
+    byte in[stream_len];
+    byte exp[stream_len];
+    byte out[stream_len];
+    byte exp_tag[12];
+    byte tag[12];
+
+    stream_input(in);
+    ASSERT_TRUE(ccm_encrypt<aes128>(test_key, nonce, in, aad_len, exp_tag, sizeof(exp_tag), in, exp, stream_len));
+
+    for (unsigned seed = 0; seed < 4; ++seed) {
+        ccm_context<aes128> ctx {test_key};
+
+        ASSERT_TRUE(ctx.start(nonce, aad_len, stream_len, sizeof(tag)));
+        feed_chunks([&](size_t pos, size_t n) { ctx.aad(in + pos, n); }, aad_len, seed);
+        feed_chunks([&](size_t pos, size_t n) { ctx.update(in + pos, out + pos, n); }, stream_len, seed + 1);
+        ASSERT_TRUE(ctx.finish(tag));
+        compare(out, exp, stream_len);
+        compare(tag, exp_tag, sizeof(tag));
+
+        ASSERT_TRUE(ctx.start(nonce, aad_len, stream_len, sizeof(tag), direction::decrypt));
+        feed_chunks([&](size_t pos, size_t n) { ctx.aad(in + pos, n); }, aad_len, seed + 2);
+        feed_chunks([&](size_t pos, size_t n) { ctx.update(out + pos, out + pos, n); }, stream_len, seed + 3);
+        ASSERT_TRUE(ctx.verify(tag));
+        compare(out, in, stream_len);
+    }
+    ccm_context<aes128> ctx {test_key};
+    ASSERT_FALSE(ctx.start(nonce, 0, 16, 3));
+    ASSERT_TRUE(ctx.start(nonce, 0, 16, 8));
+    ctx.update(in, out, 15);
+    ASSERT_FALSE(ctx.finish(tag));
+}
+
+TEST(Ccm, MaxLengthAes128)
+{
+    const byte nonce[] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c };
+    const size_t max = ccm_context<aes128, 2>::max_msg_len;
+    std::vector<byte> in(max + 1, 0x5a);
+    std::vector<byte> enc(in.size());
+    std::vector<byte> dec(in.size());
+    byte tag[16];
+
+    ASSERT_EQ(65535, max);
+    ASSERT_TRUE(ccm_encrypt<aes128>(test_key, nonce, nullptr, 0, tag, sizeof(tag), in.data(), enc.data(), max));
+    ASSERT_TRUE(ccm_decrypt<aes128>(test_key, nonce, nullptr, 0, tag, sizeof(tag), enc.data(), dec.data(), max));
+    compare(dec.data(), in.data(), max);
+    ASSERT_FALSE(ccm_encrypt<aes128>(test_key, nonce, nullptr, 0, tag, sizeof(tag), in.data(), enc.data(), max + 1));
+    ASSERT_FALSE(ccm_decrypt<aes128>(test_key, nonce, nullptr, 0, tag, sizeof(tag), enc.data(), dec.data(), max + 1));
+
+    ccm_context<aes128, 2> ctx {test_key};
+    ASSERT_TRUE(ctx.start(nonce, 0, max, sizeof(tag)));
+    ASSERT_FALSE(ctx.start(nonce, 0, max + 1, sizeof(tag)));
+    ASSERT_EQ((uint64_t(1) << 24) - 1, (ccm_context<aes128, 3>::max_msg_len));
+    ASSERT_EQ(UINT64_MAX, (ccm_context<aes128, 8>::max_msg_len));
+}
+
 TEST(Gcm, EncryptDecryptAes128_1)
 {
     byte tag[16];
@@ -285,4 +552,882 @@ TEST(Gcm, EncryptDecryptAes128_6)
     compare(tag, exp_tag, sizeof(exp_tag));
     ASSERT_TRUE(gcm_decrypt<aes128>(key, iv, sizeof(iv), aad, sizeof(aad), tag, sizeof(exp_tag), enc, dec, sizeof(in)));
     compare(dec, in, sizeof(in));
-}
\ No newline at end of file
+}
+
+TEST(Xts, EncryptDecryptAes128)
+{
+    const byte key_1[32]    = { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22 };
+    const byte in_1[32]     = { 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44,
+                                0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x44 };
+    const byte exp_1[32]    = { 0xc4, 0x54, 0x18, 0x5e, 0x6a, 0x16, 0x93, 0x6e, 0x39, 0x33, 0x40, 0x38, 0xac, 0xef, 0x83, 0x8b,
+                                0xfb, 0x18, 0x6f, 0xff, 0x74, 0x80, 0xad, 0xc4, 0x28, 0x93, 0x82, 0xec, 0xd6, 0xd3, 0x94, 0xf0 };
+    const byte key_2[32]    = { 0xff, 0xfe, 0xfd, 0xfc, 0xfb, 0xfa, 0xf9, 0xf8, 0xf7, 0xf6, 0xf5, 0xf4, 0xf3, 0xf2, 0xf1, 0xf0,
+                                0xbf, 0xbe, 0xbd, 0xbc, 0xbb, 0xba, 0xb9, 0xb8, 0xb7, 0xb6, 0xb5, 0xb4, 0xb3, 0xb2, 0xb1, 0xb0 };
+    const byte in_2[18]     = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+                                0x10, 0x11 };
+    const byte exp_2[17]    = { 0x6c, 0x16, 0x25, 0xdb, 0x46, 0x71, 0x52, 0x2d, 0x3d, 0x75, 0x99, 0x60, 0x1d, 0xe7, 0xca, 0x09,
+                                0xed };
+    const byte exp_3[18]    = { 0xd0, 0x69, 0x44, 0x4b, 0x7a, 0x7e, 0x0c, 0xab, 0x09, 0xe2, 0x44, 0x47, 0xd2, 0x4d, 0xeb, 0x1f,
+                                0xed, 0xbf };
+    byte out[32];
+
+    ASSERT_TRUE(xts_encrypt<aes128>(key_1, 0x3333333333, in_1, out, sizeof(in_1)));
+    compare(out, exp_1, sizeof(exp_1));
+    ASSERT_TRUE(xts_decrypt<aes128>(key_1, 0x3333333333, out, out, sizeof(in_1)));
+    compare(out, in_1, sizeof(in_1));
+
+    ASSERT_TRUE(xts_encrypt<aes128>(key_2, 0x123456789a, in_2, out, sizeof(exp_2)));
+    compare(out, exp_2, sizeof(exp_2));
+    ASSERT_TRUE(xts_decrypt<aes128>(key_2, 0x123456789a, out, out, sizeof(exp_2)));
+    compare(out, in_2, sizeof(exp_2));
+
+    ASSERT_TRUE(xts_encrypt<aes128>(key_2, 0x123456789a, in_2, out, sizeof(exp_3)));
+    compare(out, exp_3, sizeof(exp_3));
+    ASSERT_TRUE(xts_decrypt<aes128>(key_2, 0x123456789a, out, out, sizeof(exp_3)));
+    compare(out, in_2, sizeof(exp_3));
+
+    ASSERT_FALSE(xts_encrypt<aes128>(key_2, 0, in_2, out, 15));
+}
+
+TEST(Xts, SectorsAes256)
+{
+    const size_t sector = 520;
+    const size_t count = 300;
+    byte key[64];
+    std::vector<byte> in(sector * count);
+    std::vector<byte> exp(in.size());
+    std::vector<byte> out(in.size());
+
+    for (size_t i = 0; i < sizeof(key); ++i)
+        key[i] = i * 3 + 1;
+    for (size_t i = 0; i < in.size(); ++i)
+        in[i] = i * 11;
+
+    xts_context<aes256> ctx {key};
+
+    for (size_t i = 0; i < count; ++i)
+        ASSERT_TRUE(ctx.encrypt(1000 + i, &in[i * sector], &exp[i * sector], sector));
+
+    for (size_t threads : {1, 4}) {
+        ASSERT_TRUE(ctx.encrypt_sectors(1000, sector, in.data(), out.data(), out.size(), threads));
+        compare(out.data(), exp.data(), out.size());
+        ASSERT_TRUE(ctx.decrypt_sectors(1000, sector, out.data(), out.data(), out.size(), threads));
+        compare(out.data(), in.data(), in.size());
+    }
+    ASSERT_FALSE(ctx.encrypt_sectors(0, sector, in.data(), out.data(), out.size() - 1));
+}
+
+TEST(Ocb, EncryptDecryptAes128)
+{
+    const byte key[16]      = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+    const byte in[40]       = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+                                0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+                                0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27 };
+    const byte exp_tag_1[]  = { 0x78, 0x54, 0x07, 0xbf, 0xff, 0xc8, 0xad, 0x9e, 0xdc, 0xc5, 0x52, 0x0a, 0xc9, 0x11, 0x1e, 0xe6 };
+    const byte exp_out_2[]  = { 0x68, 0x20, 0xb3, 0x65, 0x7b, 0x6f, 0x61, 0x5a };
+    const byte exp_tag_2[]  = { 0x57, 0x25, 0xbd, 0xa0, 0xd3, 0xb4, 0xeb, 0x3a, 0x25, 0x7c, 0x9a, 0xf1, 0xf8, 0xf0, 0x30, 0x09 };
+    const byte exp_out_3[]  = { 0xd5, 0xca, 0x91, 0x74, 0x84, 0x10, 0xc1, 0x75, 0x1f, 0xf8, 0xa2, 0xf6, 0x18, 0x25, 0x5b, 0x68,
+                                0xa0, 0xa1, 0x2e, 0x09, 0x3f, 0xf4, 0x54, 0x60, 0x6e, 0x59, 0xf9, 0xc1, 0xd0, 0xdd, 0xc5, 0x4b,
+                                0x65, 0xe8, 0x62, 0x8e, 0x56, 0x8b, 0xad, 0x7a };
+    const byte exp_tag_3[]  = { 0xed, 0x07, 0xba, 0x06, 0xa4, 0xa6, 0x94, 0x83, 0xa7, 0x03, 0x54, 0x90, 0xc5, 0x76, 0x9e, 0x60 };
+    byte nonce[12]          = { 0xbb, 0xaa, 0x99, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00 };
+    byte out[40];
+    byte tag[16];
+
+    ASSERT_TRUE(ocb_encrypt<aes128>(key, nonce, sizeof(nonce), nullptr, 0, tag, sizeof(tag), nullptr, nullptr, 0));
+    compare(tag, exp_tag_1, sizeof(exp_tag_1));
+    ASSERT_TRUE(ocb_decrypt<aes128>(key, nonce, sizeof(nonce), nullptr, 0, tag, sizeof(tag), nullptr, nullptr, 0));
+
+    nonce[11] = 0x01;
+    ASSERT_TRUE(ocb_encrypt<aes128>(key, nonce, sizeof(nonce), in, 8, tag, sizeof(tag), in, out, 8));
+    compare(out, exp_out_2, sizeof(exp_out_2));
+    compare(tag, exp_tag_2, sizeof(exp_tag_2));
+    ASSERT_TRUE(ocb_decrypt<aes128>(key, nonce, sizeof(nonce), in, 8, tag, sizeof(tag), out, out, 8));
+    compare(out, in, 8);
+
+    nonce[11] = 0x0d;
+    ASSERT_TRUE(ocb_encrypt<aes128>(key, nonce, sizeof(nonce), in, 40, tag, sizeof(tag), in, out, 40));
+    compare(out, exp_out_3, sizeof(exp_out_3));
+    compare(tag, exp_tag_3, sizeof(exp_tag_3));
+    ASSERT_TRUE(ocb_decrypt<aes128>(key, nonce, sizeof(nonce), in, 40, tag, sizeof(tag), out, out, 40));
+    compare(out, in, 40);
+
+    ASSERT_TRUE(ocb_encrypt<aes128>(key, nonce, sizeof(nonce), in, 40, tag, sizeof(tag), in, out, 40));
+    out[39] ^= 1;
+    ASSERT_FALSE(ocb_decrypt<aes128>(key, nonce, sizeof(nonce), in, 40, tag, sizeof(tag), out, out, 40));
+    ASSERT_FALSE(ocb_encrypt<aes128>(key, nonce, 16, nullptr, 0, tag, sizeof(tag), nullptr, nullptr, 0));
+    ASSERT_FALSE(ocb_encrypt<aes128>(key, nonce, sizeof(nonce), nullptr, 0, tag, 17, nullptr, nullptr, 0));
+}
+
+template<class E, size_t T>
+static void ocb_iterative(span_i<T> exp)
+{
+    // Iterative test from RFC 7253, Appendix A
+
+    byte key[E::key_size] = {};
+    byte nonce[12] = {};
+    byte s[128] = {};
+    byte out[128 + T];
+    std::vector<byte> c;
+
+    key[sizeof(key) - 1] = T * 8;
+
+    ocb_context<E> ctx {key};
+
+    auto set_nonce = [&](size_t n) { putbe(uint32_t(n), nonce + 8); };
+
+    for (size_t i = 0; i < 128; ++i) {
+        set_nonce(3 * i + 1);
+        ASSERT_TRUE(ctx.encrypt(nonce, sizeof(nonce), s, i, out + i, T, s, out, i));
+        c.insert(c.end(), out, out + i + T);
+        set_nonce(3 * i + 2);
+        ASSERT_TRUE(ctx.encrypt(nonce, sizeof(nonce), nullptr, 0, out + i, T, s, out, i));
+        c.insert(c.end(), out, out + i + T);
+        set_nonce(3 * i + 3);
+        ASSERT_TRUE(ctx.encrypt(nonce, sizeof(nonce), s, i, out, T, nullptr, nullptr, 0));
+        c.insert(c.end(), out, out + T);
+    }
+    set_nonce(385);
+    ASSERT_TRUE(ctx.encrypt(nonce, sizeof(nonce), c.data(), c.size(), out, T, nullptr, nullptr, 0));
+    compare(out, exp.data(), T);
+}
+
+TEST(Ocb, IterativeAes)
+{
+    const byte exp_128_128[16]  = { 0x67, 0xe9, 0x44, 0xd2, 0x32, 0x56, 0xc5, 0xe0, 0xb6, 0xc6, 0x1f, 0xa2, 0x2f, 0xdf, 0x1e, 0xa2 };
+    const byte exp_192_128[16]  = { 0xf6, 0x73, 0xf2, 0xc3, 0xe7, 0x17, 0x4a, 0xae, 0x7b, 0xae, 0x98, 0x6c, 0xa9, 0xf2, 0x9e, 0x17 };
+    const byte exp_256_128[16]  = { 0xd9, 0x0e, 0xb8, 0xe9, 0xc9, 0x77, 0xc8, 0x8b, 0x79, 0xdd, 0x79, 0x3d, 0x7f, 0xfa, 0x16, 0x1c };
+    const byte exp_128_96[12]   = { 0x77, 0xa3, 0xd8, 0xe7, 0x35, 0x89, 0x15, 0x8d, 0x25, 0xd0, 0x12, 0x09 };
+    const byte exp_128_64[8]    = { 0x19, 0x2c, 0x9b, 0x7b, 0xd9, 0x0b, 0xa0, 0x6a };
+
+    ocb_iterative<aes128, 16>(exp_128_128);
+    ocb_iterative<aes192, 16>(exp_192_128);
+    ocb_iterative<aes256, 16>(exp_256_128);
+    ocb_iterative<aes128, 12>(exp_128_96);
+    ocb_iterative<aes128, 8>(exp_128_64);
+}
+
+TEST(Kw, WrapUnwrapAes)
+{
+    const byte kek[32] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+    };
+    const byte key[32] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    };
+    const byte exp_128[24] = {
+        0x1f, 0xa6, 0x8b, 0x0a, 0x81, 0x12, 0xb4, 0x47, 0xae, 0xf3, 0x4b, 0xd8, 0xfb, 0x5a, 0x7b, 0x82,
+        0x9d, 0x3e, 0x86, 0x23, 0x71, 0xd2, 0xcf, 0xe5,
+    };
+    const byte exp_256[40] = {
+        0x28, 0xc9, 0xf4, 0x04, 0xc4, 0xb8, 0x10, 0xf4, 0xcb, 0xcc, 0xb3, 0x5c, 0xfb, 0x87, 0xf8, 0x26,
+        0x3f, 0x57, 0x86, 0xe2, 0xd8, 0x0e, 0xd3, 0x26, 0xcb, 0xc7, 0xf0, 0xe7, 0x1a, 0x99, 0xf4, 0x3b,
+        0xfb, 0x98, 0x8b, 0x9b, 0x7a, 0x02, 0xdd, 0x21,
+    };
+    byte out[40];
+    byte dec[32];
+
+    ASSERT_TRUE(kw_wrap<aes128>(span_i<16>{kek, 16}, key, 16, out));
+    compare(out, exp_128, sizeof(exp_128));
+    ASSERT_TRUE(kw_unwrap<aes128>(span_i<16>{kek, 16}, out, 24, dec));
+    compare(dec, key, 16);
+
+    ASSERT_TRUE(kw_wrap<aes256>(kek, key, 32, out));
+    compare(out, exp_256, sizeof(exp_256));
+    ASSERT_TRUE(kw_unwrap<aes256>(kek, out, 40, out));
+    compare(out, key, 32);
+
+    ASSERT_TRUE(kw_wrap<aes256>(kek, key, 32, out));
+    out[39] ^= 1;
+    ASSERT_FALSE(kw_unwrap<aes256>(kek, out, 40, dec));
+    ASSERT_FALSE(kw_wrap<aes256>(kek, key, 12, out));
+    ASSERT_FALSE(kw_unwrap<aes256>(kek, out, 16, dec));
+}
+
+TEST(Kw, WrapUnwrapPadAes192)
+{
+    const byte kek[24] = {
+        0x58, 0x40, 0xdf, 0x6e, 0x29, 0xb0, 0x2a, 0xf1, 0xab, 0x49, 0x3b, 0x70, 0x5b, 0xf1, 0x6e, 0xa1,
+        0xae, 0x83, 0x38, 0xf4, 0xdc, 0xc1, 0x76, 0xa8,
+    };
+    const byte key_20[20] = {
+        0xc3, 0x7b, 0x7e, 0x64, 0x92, 0x58, 0x43, 0x40, 0xbe, 0xd1, 0x22, 0x07, 0x80, 0x89, 0x41, 0x15,
+        0x50, 0x68, 0xf7, 0x38,
+    };
+    const byte key_7[7] = { 0x46, 0x6f, 0x72, 0x50, 0x61, 0x73, 0x69 };
+    const byte exp_20[32] = {
+        0x13, 0x8b, 0xde, 0xaa, 0x9b, 0x8f, 0xa7, 0xfc, 0x61, 0xf9, 0x77, 0x42, 0xe7, 0x22, 0x48, 0xee,
+        0x5a, 0xe6, 0xae, 0x53, 0x60, 0xd1, 0xae, 0x6a, 0x5f, 0x54, 0xf3, 0x73, 0xfa, 0x54, 0x3b, 0x6a,
+    };
+    const byte exp_7[16] = {
+        0xaf, 0xbe, 0xb0, 0xf0, 0x7d, 0xfb, 0xf5, 0x41, 0x92, 0x00, 0xf2, 0xcc, 0xb5, 0x0b, 0xb2, 0x4f,
+    };
+    byte out[32];
+    byte dec[24];
+    size_t len = 0;
+    kw_context<aes192> ctx {kek};
+
+    ASSERT_TRUE(ctx.wrap_pad(key_20, sizeof(key_20), out));
+    compare(out, exp_20, sizeof(exp_20));
+    ASSERT_TRUE(ctx.unwrap_pad(out, sizeof(exp_20), dec, &len));
+    ASSERT_EQ(len, sizeof(key_20));
+    compare(dec, key_20, sizeof(key_20));
+
+    ASSERT_TRUE(ctx.wrap_pad(key_7, sizeof(key_7), out));
+    compare(out, exp_7, sizeof(exp_7));
+    ASSERT_TRUE(ctx.unwrap_pad(out, sizeof(exp_7), dec, &len));
+    ASSERT_EQ(len, sizeof(key_7));
+    compare(dec, key_7, sizeof(key_7));
+
+    out[0] ^= 1;
+    ASSERT_FALSE(ctx.unwrap_pad(out, sizeof(exp_7), dec, &len));
+}
+
+TEST(Kw, UnwrapBatchAes128)
+{
+    constexpr size_t count = 37;
+    std::vector<std::vector<byte>> keys(count);
+    std::vector<std::vector<byte>> wrapped(count);
+    std::vector<std::vector<byte>> unwrapped(count);
+    std::vector<span_i<>> in;
+    std::vector<span_o<>> out;
+    bool ok[count];
+    kw_context<aes128> ctx {test_key};
+
+    for (size_t i = 0; i < count; ++i) {
+        keys[i].resize(16 + i % 5 * 8);
+        for (size_t j = 0; j < keys[i].size(); ++j)
+            keys[i][j] = i * 31 + j;
+        wrapped[i].resize(keys[i].size() + 8);
+        unwrapped[i].resize(keys[i].size());
+        ASSERT_TRUE(ctx.wrap(keys[i].data(), keys[i].size(), wrapped[i].data()));
+        in.push_back(wrapped[i]);
+        out.push_back(unwrapped[i]);
+    }
+    wrapped[5][3] ^= 1;
+
+    ASSERT_FALSE(ctx.unwrap_batch(in, out, ok));
+
+    for (size_t i = 0; i < count; ++i) {
+        ASSERT_EQ(ok[i], i != 5) << "At key " << i;
+        if (i != 5)
+            compare(unwrapped[i].data(), keys[i].data(), keys[i].size());
+    }
+}
+
+TEST(Siv, EncryptDecryptAes128)
+{
+    const byte key[32] = {
+        0xff, 0xfe, 0xfd, 0xfc, 0xfb, 0xfa, 0xf9, 0xf8, 0xf7, 0xf6, 0xf5, 0xf4, 0xf3, 0xf2, 0xf1, 0xf0,
+        0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff,
+    };
+    const byte aad[24] = {
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+        0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+    };
+    const byte in[14] = {
+        0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee,
+    };
+    const byte exp[30] = {
+        0x85, 0x63, 0x2d, 0x07, 0xc6, 0xe8, 0xf3, 0x7f, 0x95, 0x0a, 0xcd, 0x32, 0x0a, 0x2e, 0xcc, 0x93,
+        0x40, 0xc0, 0x2b, 0x96, 0x90, 0xc4, 0xdc, 0x04, 0xda, 0xef, 0x7f, 0x6a, 0xfe, 0x5c,
+    };
+    byte out[30];
+    byte dec[14];
+
+    siv_encrypt<aes128>(key, aad, sizeof(aad), in, out, sizeof(in));
+    compare(out, exp, sizeof(exp));
+    ASSERT_TRUE(siv_decrypt<aes128>(key, aad, sizeof(aad), out, dec, sizeof(out)));
+    compare(dec, in, sizeof(in));
+
+    out[20] ^= 1;
+    ASSERT_FALSE(siv_decrypt<aes128>(key, aad, sizeof(aad), out, dec, sizeof(out)));
+}
+
+TEST(Siv, NonceAes128)
+{
+    const byte key[32] = {
+        0x7f, 0x7e, 0x7d, 0x7c, 0x7b, 0x7a, 0x79, 0x78, 0x77, 0x76, 0x75, 0x74, 0x73, 0x72, 0x71, 0x70,
+        0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,
+    };
+    const byte aad_1[40] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+        0xde, 0xad, 0xda, 0xda, 0xde, 0xad, 0xda, 0xda, 0xff, 0xee, 0xdd, 0xcc, 0xbb, 0xaa, 0x99, 0x88,
+        0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11, 0x00,
+    };
+    const byte aad_2[10] = {
+        0x10, 0x20, 0x30, 0x40, 0x50, 0x60, 0x70, 0x80, 0x90, 0xa0,
+    };
+    const byte nonce[16] = {
+        0x09, 0xf9, 0x11, 0x02, 0x9d, 0x74, 0xe3, 0x5b, 0xd8, 0x41, 0x56, 0xc5, 0x63, 0x56, 0x88, 0xc0,
+    };
+    const byte in[47] = {
+        0x74, 0x68, 0x69, 0x73, 0x20, 0x69, 0x73, 0x20, 0x73, 0x6f, 0x6d, 0x65, 0x20, 0x70, 0x6c, 0x61,
+        0x69, 0x6e, 0x74, 0x65, 0x78, 0x74, 0x20, 0x74, 0x6f, 0x20, 0x65, 0x6e, 0x63, 0x72, 0x79, 0x70,
+        0x74, 0x20, 0x75, 0x73, 0x69, 0x6e, 0x67, 0x20, 0x53, 0x49, 0x56, 0x2d, 0x41, 0x45, 0x53,
+    };
+    const byte exp[63] = {
+        0x7b, 0xdb, 0x6e, 0x3b, 0x43, 0x26, 0x67, 0xeb, 0x06, 0xf4, 0xd1, 0x4b, 0xff, 0x2f, 0xbd, 0x0f,
+        0xcb, 0x90, 0x0f, 0x2f, 0xdd, 0xbe, 0x40, 0x43, 0x26, 0x60, 0x19, 0x65, 0xc8, 0x89, 0xbf, 0x17,
+        0xdb, 0xa7, 0x7c, 0xeb, 0x09, 0x4f, 0xa6, 0x63, 0xb7, 0xa3, 0xf7, 0x48, 0xba, 0x8a, 0xf8, 0x29,
+        0xea, 0x64, 0xad, 0x54, 0x4a, 0x27, 0x2e, 0x9c, 0x48, 0x5b, 0x62, 0xa3, 0xfd, 0x5c, 0x0d,
+    };
+    const span_i<> aad[] = { aad_1, aad_2, nonce };
+    byte out[63];
+    siv_context<aes128> ctx {key};
+
+    copy(out + 16, in, sizeof(in));
+    ctx.encrypt(aad, out + 16, out, sizeof(in));
+    compare(out, exp, sizeof(exp));
+    ASSERT_TRUE(ctx.decrypt(aad, out, out + 16, sizeof(out)));
+    compare(out + 16, in, sizeof(in));
+}
+
+TEST(Siv, EncryptBatchAes256)
+{
+    constexpr size_t count = 29;
+    byte key[64];
+    byte in[count * 40];
+    byte out[count * 56];
+    byte exp[56];
+    const byte nonce[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    const span_i<> aad[] = { {test_in, 20}, nonce };
+    std::vector<span_i<>> ins;
+    std::vector<span_o<>> outs;
+
+    for (size_t i = 0; i < sizeof(key); ++i)
+        key[i] = i * 3;
+    for (size_t i = 0; i < sizeof(in); ++i)
+        in[i] = i * 11;
+    for (size_t i = 0; i < count; ++i) {
+        size_t len = i * 7 % 41;
+        ins.push_back(span_i<>{in + i * 40, len});
+        outs.push_back(span_o<>{out + i * 56, len + 16});
+    }
+    siv_context<aes256> ctx {key};
+    ctx.encrypt_batch(aad, ins, outs);
+
+    for (size_t i = 0; i < count; ++i) {
+        ctx.encrypt(aad, ins[i].data(), exp, ins[i].size());
+        compare(outs[i].data(), exp, ins[i].size() + 16);
+    }
+}
+
+TEST(Chacha20Poly1305, EncryptDecrypt)
+{
+    const byte nonce[12] = { 0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47 };
+    const byte aad[12] = { 0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7 };
+    const char in[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+    const byte exp[114] = {
+        0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb, 0x7b, 0x86, 0xaf, 0xbc, 0x53, 0xef, 0x7e, 0xc2,
+        0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe, 0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6,
+        0x3d, 0xbe, 0xa4, 0x5e, 0x8c, 0xa9, 0x67, 0x12, 0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b,
+        0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29, 0x05, 0xd6, 0xa5, 0xb6, 0x7e, 0xcd, 0x3b, 0x36,
+        0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c, 0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58,
+        0xfa, 0xb3, 0x24, 0xe4, 0xfa, 0xd6, 0x75, 0x94, 0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc,
+        0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d, 0xe5, 0x76, 0xd2, 0x65, 0x86, 0xce, 0xc6, 0x4b,
+        0x61, 0x16,
+    };
+    const byte exp_tag[16] = {
+        0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a, 0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91,
+    };
+    byte key[32];
+    byte out[114];
+    byte tag[16];
+
+    for (size_t i = 0; i < sizeof(key); ++i)
+        key[i] = 0x80 + i;
+
+    chacha20_poly1305_encrypt(key, nonce, aad, sizeof(aad), tag, (const byte*) in, out, sizeof(out));
+    compare(out, exp, sizeof(exp));
+    compare(tag, exp_tag, sizeof(exp_tag));
+    ASSERT_TRUE(chacha20_poly1305_decrypt(key, nonce, aad, sizeof(aad), tag, out, out, sizeof(out)));
+    compare(out, (const byte*) in, sizeof(out));
+
+    tag[0] ^= 1;
+    ASSERT_FALSE(chacha20_poly1305_decrypt(key, nonce, aad, sizeof(aad), tag, exp, out, sizeof(out)));
+}
+
+TEST(Chacha20Poly1305, Context)
+{
+    const byte nonce[12] = { 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, 1, 2 };
+    byte key[32];
+    byte in[stream_len];
+    byte exp[stream_len];
+    byte out[stream_len];
+    byte exp_tag[16];
+    byte tag[16];
+
+    for (size_t i = 0; i < sizeof(key); ++i)
+        key[i] = i * 5;
+    stream_input(in);
+    chacha20_poly1305_encrypt(key, nonce, test_in, sizeof(test_in), exp_tag, in, exp, stream_len);
+
+    chacha20_poly1305_context ctx {key};
+
+    for (unsigned seed = 0; seed < 8; ++seed) {
+        ctx.start(nonce, direction::encrypt);
+        feed_chunks([&](size_t pos, size_t n) { ctx.aad(test_in + pos, n); }, sizeof(test_in), seed);
+        feed_chunks([&](size_t pos, size_t n) { ctx.update(in + pos, out + pos, n); }, stream_len, seed);
+        ctx.finish(tag);
+        compare(out, exp, stream_len);
+        compare(tag, exp_tag, sizeof(tag));
+
+        ctx.start(nonce, direction::decrypt);
+        ctx.aad(test_in, sizeof(test_in));
+        feed_chunks([&](size_t pos, size_t n) { ctx.update(out + pos, out + pos, n); }, stream_len, seed);
+        ASSERT_TRUE(ctx.verify(tag));
+        compare(out, in, stream_len);
+    }
+}
+
+static std::vector<span_o<>> segments(byte *p, size_t len, unsigned seed)
+{
+    std::vector<span_o<>> iov;
+    feed_chunks([&](size_t pos, size_t n) { iov.push_back(span_o<>{p + pos, n}); }, len, seed);
+    iov.insert(iov.begin() + iov.size() / 2, span_o<>{p, size_t(0)});
+    return iov;
+}
+
+template<class F, class G>
+static void check_iov(size_t len, F &&contiguous, G &&segmented)
+{
+    byte in[stream_len];
+    byte exp[stream_len];
+    byte out[stream_len];
+
+    stream_input(in);
+    contiguous(in, exp, len);
+
+    for (unsigned seed = 0; seed < 8; ++seed) {
+        copy(out, in, len);
+        auto iov = segments(out, len, seed);
+        segmented(std::span<const span_o<>>{iov});
+        compare(out, exp, len);
+    }
+}
+
+TEST(Iov, EcbCbcAes128)
+{
+    constexpr size_t len = 992;
+    aes128 ciph {test_key};
+
+    check_iov(len, [&](const byte *in, byte *out, size_t n) {
+        ecb_encrypt(ciph, span_i<>{in, n}, span_o<>{out, n});
+    }, [&](auto iov) { ASSERT_TRUE(ecb_encrypt(ciph, iov)); });
+    check_iov(len, [&](const byte *in, byte *out, size_t n) {
+        ecb_decrypt<aes128>(test_key, span_i<>{in, n}, span_o<>{out, n});
+    }, [&](auto iov) { ASSERT_TRUE(ecb_decrypt<aes128>(test_key, iov)); });
+    check_iov(len, [&](const byte *in, byte *out, size_t n) {
+        cbc_encrypt<aes128>(test_key, test_in, in, out, n);
+    }, [&](auto iov) { ASSERT_TRUE(cbc_encrypt<aes128>(test_key, test_in, iov)); });
+    check_iov(len, [&](const byte *in, byte *out, size_t n) {
+        cbc_decrypt<aes128>(test_key, test_in, in, out, n);
+    }, [&](auto iov) { ASSERT_TRUE(cbc_decrypt<aes128>(test_key, test_in, iov)); });
+
+    byte buf[20] = {};
+    span_o<> odd[] = { {buf, 7}, {buf + 7, 13} };
+    ASSERT_FALSE(cbc_encrypt<aes128>(test_key, test_in, odd));
+    ASSERT_FALSE(ecb_encrypt(ciph, odd));
+}
+
+TEST(Iov, StreamAes128)
+{
+    check_iov(stream_len, [&](const byte *in, byte *out, size_t n) {
+        cfb_encrypt<aes128>(test_key, test_in, in, out, n);
+    }, [&](auto iov) { cfb_encrypt<aes128>(test_key, test_in, iov); });
+    check_iov(stream_len, [&](const byte *in, byte *out, size_t n) {
+        cfb_decrypt<aes128>(test_key, test_in, in, out, n);
+    }, [&](auto iov) { cfb_decrypt<aes128>(test_key, test_in, iov); });
+    check_iov(stream_len, [&](const byte *in, byte *out, size_t n) {
+        ofb_encrypt<aes128>(test_key, test_in, in, out, n);
+    }, [&](auto iov) { ofb_encrypt<aes128>(test_key, test_in, iov); });
+    check_iov(stream_len, [&](const byte *in, byte *out, size_t n) {
+        ctr_encrypt<aes128>(test_key, test_in, in, out, n);
+    }, [&](auto iov) { ctr_decrypt<aes128>(test_key, test_in, iov); });
+}
+
+template<class F, class G>
+static void check_iov_aead(size_t tag_len, F &&encrypt, G &&decrypt)
+{
+    byte in[stream_len];
+    byte exp[stream_len];
+    byte out[stream_len];
+    byte exp_tag[16];
+    byte tag[16];
+    std::vector<span_i<>> aad;
+
+    stream_input(in);
+    encrypt(std::span<const span_i<>>{}, std::span<const span_o<>>{}, in, exp, exp_tag);
+
+    for (unsigned seed = 0; seed < 8; ++seed) {
+        aad.clear();
+        feed_chunks([&](size_t pos, size_t n) { aad.push_back(span_i<>{test_in + pos, n}); }, sizeof(test_in), seed + 100);
+        copy(out, in, stream_len);
+        auto iov = segments(out, stream_len, seed);
+
+        encrypt(std::span<const span_i<>>{aad}, std::span<const span_o<>>{iov}, nullptr, nullptr, tag);
+        compare(out, exp, stream_len);
+        compare(tag, exp_tag, tag_len);
+        ASSERT_TRUE(decrypt(std::span<const span_i<>>{aad}, std::span<const span_o<>>{iov}, tag));
+        compare(out, in, stream_len);
+
+        copy(out, exp, stream_len);
+        tag[0] ^= 1;
+        ASSERT_FALSE(decrypt(std::span<const span_i<>>{aad}, std::span<const span_o<>>{iov}, tag));
+        ASSERT_EQ(std::count(out, out + stream_len, 0), ptrdiff_t(stream_len));
+    }
+}
+
+TEST(Iov, AeadAes128)
+{
+    check_iov_aead(10, [](auto aad, auto iov, const byte *in, byte *out, byte *tag) {
+        if (in)
+            ASSERT_TRUE((ccm_encrypt<aes128, 3>(test_key, test_in, test_in, sizeof(test_in), tag, 10, in, out, stream_len)));
+        else
+            ASSERT_TRUE((ccm_encrypt<aes128, 3>(test_key, test_in, aad, tag, 10, iov)));
+    }, [](auto aad, auto iov, const byte *tag) {
+        return ccm_decrypt<aes128, 3>(test_key, test_in, aad, tag, 10, iov);
+    });
+
+    gcm_context<aes128> ctx {test_key};
+
+    check_iov_aead(16, [&](auto aad, auto iov, const byte *in, byte *out, byte *tag) {
+        if (in)
+            ASSERT_TRUE(gcm_encrypt<aes128>(test_key, test_in, 60, test_in, sizeof(test_in), tag, 16, in, out, stream_len));
+        else
+            ASSERT_TRUE(gcm_encrypt(ctx, test_in, 60, aad, tag, 16, iov));
+    }, [](auto aad, auto iov, const byte *tag) {
+        return gcm_decrypt<aes128>(test_key, test_in, 60, aad, tag, 16, iov);
+    });
+}
+
+TEST(Iov, Chacha20Poly1305)
+{
+    const byte key[32] = { 1, 2, 3 };
+
+    check_iov_aead(16, [&](auto aad, auto iov, const byte *in, byte *out, byte *tag) {
+        if (in)
+            chacha20_poly1305_encrypt(key, test_in, test_in, sizeof(test_in), tag, in, out, stream_len);
+        else
+            chacha20_poly1305_encrypt(key, test_in, aad, tag, iov);
+    }, [&](auto aad, auto iov, const byte *tag) {
+        return chacha20_poly1305_decrypt(key, test_in, aad, tag, iov);
+    });
+}
+
+TEST(Iov, GcmContextAes128)
+{
+    byte in[stream_len];
+    byte exp[stream_len];
+    byte out[stream_len];
+    byte exp_tag[16];
+    byte tag[16];
+    gcm_context<aes128> ctx {test_key};
+
+    stream_input(in);
+    gcm_encrypt<aes128>(test_key, test_in, 12, test_in, sizeof(test_in), exp_tag, 16, in, exp, stream_len);
+
+    for (unsigned seed = 0; seed < 8; ++seed) {
+        ctx.start(test_in, 12, direction::encrypt);
+        feed_chunks([&](size_t pos, size_t n) { ctx.aad(test_in + pos, n); }, sizeof(test_in), seed);
+        feed_chunks([&](size_t pos, size_t n) { ctx.update(in + pos, out + pos, n); }, stream_len, seed);
+        ASSERT_TRUE(ctx.finish(tag, 16));
+        compare(out, exp, stream_len);
+        compare(tag, exp_tag, 16);
+
+        ctx.start(test_in, 12, direction::decrypt);
+        ctx.aad(test_in, sizeof(test_in));
+        feed_chunks([&](size_t pos, size_t n) { ctx.update(out + pos, out + pos, n); }, stream_len, seed + 1);
+        ASSERT_TRUE(ctx.verify(tag, 16));
+        compare(out, in, stream_len);
+    }
+    ASSERT_FALSE(ctx.finish(tag, 5));
+}
+
+template<class A, class F>
+static void check_record(span_i<A::key_size> key, F &&reference)
+{
+    const byte iv[12] = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab };
+    const byte hdr[5] = { 0x17, 0x03, 0x03, 0x00, 0x00 };
+    byte in[stream_len];
+    byte frame[stream_len + record_context<A>::overhead];
+    byte exp[stream_len];
+    byte tag[16];
+    byte n[12];
+    record_context<A> tx {key, iv, 0xfffe};
+    record_context<A> rx {key, iv, 0xfffe};
+
+    stream_input(in);
+
+    for (size_t len : {0, 1, 16, 100, 1000}) {
+        copy(n, iv, 12);
+        for (int i = 0; i < 8; ++i)
+            n[11 - i] ^= tx.sequence() >> (i * 8);
+        reference(n, hdr, in, exp, len, tag);
+
+        copy(record_context<A>::payload(frame), in, len);
+        auto sealed = tx.seal(frame, len, hdr);
+        ASSERT_EQ(sealed.data(), frame);
+        ASSERT_EQ(sealed.size(), len + record_context<A>::overhead);
+        compare(frame, n, 12);
+        compare(frame + 12, exp, len);
+        compare(frame + 12 + len, tag, 16);
+
+        auto opened = rx.open(frame, sealed.size(), hdr);
+        ASSERT_EQ(opened.data(), frame + 12);
+        ASSERT_EQ(opened.size(), len);
+        compare(opened.data(), in, len);
+    }
+    ASSERT_EQ(tx.sequence(), 0x10003u);
+    ASSERT_EQ(rx.sequence(), 0x10003u);
+
+    auto sealed = tx.seal(in, 100, frame, hdr);
+    ASSERT_FALSE(rx.open(frame, sealed.size(), {hdr, 4}).data());
+    frame[50] ^= 1;
+    ASSERT_FALSE(rx.open(frame, sealed.size(), hdr).data());
+    ASSERT_EQ(std::count(frame + 12, frame + 112, 0), 100);
+    ASSERT_FALSE(rx.open(frame, 27, hdr).data());
+
+    tx.seal(in, 100, frame, hdr);
+    ASSERT_FALSE(rx.open(frame, sealed.size(), hdr).data());
+}
+
+TEST(Record, Gcm)
+{
+    check_record<gcm_context<aes128>>(test_key, [](const byte *n, const byte *hdr, const byte *in, byte *out, size_t len, byte *tag) {
+        gcm_encrypt<aes128>(test_key, n, 12, hdr, 5, tag, 16, in, out, len);
+    });
+}
+
+TEST(Record, Ccm)
+{
+    check_record<ccm_context<aes128, 3>>(test_key, [](const byte *n, const byte *hdr, const byte *in, byte *out, size_t len, byte *tag) {
+        ccm_encrypt<aes128, 3>(test_key, n, hdr, 5, tag, 16, in, out, len);
+    });
+}
+
+TEST(Record, CcmMaxLength)
+{
+    using A = ccm_context<aes128, 3>;
+
+    const byte iv[12] = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab };
+    const size_t max = A::max_msg_len;
+    std::vector<byte> frame(max + 1 + record_context<A>::overhead, 0x5a);
+    record_context<A> tx {test_key, iv};
+    record_context<A> rx {test_key, iv};
+
+    ASSERT_FALSE(tx.seal(frame.data(), max + 1).data());
+    ASSERT_EQ(tx.sequence(), 0u);
+
+    copy(frame.data(), iv, 12);
+    ASSERT_FALSE(rx.open(frame.data(), frame.size()).data());
+    ASSERT_EQ(rx.sequence(), 0u);
+
+    auto sealed = tx.seal(frame.data(), max);
+    ASSERT_EQ(sealed.size(), max + record_context<A>::overhead);
+    ASSERT_EQ(rx.open(sealed.data(), sealed.size()).size(), max);
+}
+
+TEST(Record, Chacha20Poly1305)
+{
+    static const byte key[32] = { 7, 6, 5 };
+
+    check_record<chacha20_poly1305_context>(key, [](const byte *n, const byte *hdr, const byte *in, byte *out, size_t len, byte *tag) {
+        chacha20_poly1305_encrypt(key, n, hdr, 5, tag, in, out, len);
+    });
+}
+
+template<class A>
+static void check_stream(span_i<> key)
+{
+    const byte seed[23] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23 };
+    const uint32_t seg = 64;
+    byte in[stream_len];
+    byte exp[stream_size(stream_len, seg)];
+    byte out[stream_size(stream_len, seg)];
+    byte dec[stream_len];
+    size_t dec_len;
+
+    stream_input(in);
+
+    for (size_t len : {0, 1, 63, 64, 65, 128, 1000}) {
+        auto size = stream_size(len, seg);
+        ASSERT_EQ(stream_encrypt<A>(key, seed, seg, in, len, exp, 4), size);
+
+        for (unsigned s = 0; s < 4; ++s) {
+            stream_writer<A> wr;
+            size_t done = stream_writer<A>::header_size;
+            ASSERT_TRUE(wr.init(key, seed, seg, out));
+            feed_chunks([&](size_t pos, size_t n) { done += wr.update(in + pos, n, out + done); }, len, s);
+            done += wr.finish(out + done);
+            ASSERT_EQ(done, size);
+            compare(out, exp, size);
+        }
+        ASSERT_TRUE(stream_decrypt<A>(key, exp, size, dec, &dec_len, 4));
+        ASSERT_EQ(dec_len, len);
+        compare(dec, in, len);
+
+        stream_reader<A> rd;
+        auto body = exp + stream_reader<A>::header_size;
+        auto body_len = size - stream_reader<A>::header_size;
+        ASSERT_TRUE(rd.init(key, exp));
+        ASSERT_EQ(rd.plaintext_size(body_len), len);
+
+        for (size_t off : {size_t(0), len / 3, len / 2, len}) {
+            for (size_t n : {size_t(0), size_t(1), size_t(70), len - off}) {
+                if (n > len - off)
+                    continue;
+                fill(dec, 0, sizeof(dec));
+                ASSERT_TRUE(rd.read(body, body_len, off, dec, n));
+                compare(dec, in + off, n);
+            }
+        }
+        ASSERT_FALSE(rd.read(body, body_len, len, dec, 1));
+    }
+    auto size = stream_size(1000, seg);
+    auto body = exp + stream_reader<A>::header_size;
+    const size_t cs = seg + 16;
+    stream_reader<A> rd;
+    byte wrong[32] = {};
+
+    ASSERT_FALSE(rd.init(wrong, exp));
+    ASSERT_TRUE(rd.init(key, exp));
+    ASSERT_TRUE(rd.open(1, false, body + cs, cs, dec));
+    compare(dec, in + seg, seg);
+    ASSERT_FALSE(rd.open(1, true, body + cs, cs, dec));
+    ASSERT_FALSE(rd.open(2, false, body + cs, cs, dec));
+
+    // Truncation at segment boundary is detected, as new last segment isn't flagged
+    ASSERT_FALSE(stream_decrypt<A>(key, exp, size - (1000 % seg + 16), dec, &dec_len, 4));
+    ASSERT_FALSE(rd.read(body, size - stream_reader<A>::header_size - (1000 % seg + 16), 950, dec, 10));
+
+    // Reordered segments
+    std::swap_ranges(body, body + cs, body + cs);
+    ASSERT_FALSE(stream_decrypt<A>(key, exp, size, dec, &dec_len, 4));
+    ASSERT_EQ(std::count(dec, dec + 1000, 0), 1000);
+    ASSERT_TRUE(rd.read(body, size - stream_reader<A>::header_size, 2 * seg, dec, 10));
+    std::swap_ranges(body, body + cs, body + cs);
+
+    // Tampered parameters break key commitment
+    exp[6] ^= 1;
+    ASSERT_FALSE(rd.init(key, exp));
+    exp[6] ^= 1;
+    ASSERT_TRUE(rd.init(key, exp));
+    body[500] ^= 1;
+    ASSERT_FALSE(stream_decrypt<A>(key, exp, size, dec, &dec_len, 4));
+    ASSERT_FALSE(rd.read(body, size - stream_reader<A>::header_size, 400, dec, 200));
+    ASSERT_EQ(std::count(dec, dec + 200, 0), 200);
+    ASSERT_TRUE(rd.read(body, size - stream_reader<A>::header_size, 0, dec, 6 * seg));
+    ASSERT_EQ(stream_encrypt<A>(key, seed, 0, in, 10, exp), 0u);
+}
+
+TEST(Stream, Gcm)
+{
+    check_stream<gcm_context<aes128>>(test_key);
+}
+
+TEST(Stream, Ccm)
+{
+    check_stream<ccm_context<aes128, 3>>(test_key);
+}
+
+TEST(Stream, Chacha20Poly1305)
+{
+    static const byte key[32] = { 7, 6, 5 };
+
+    check_stream<chacha20_poly1305_context>(key);
+}
+
+TEST(Stream, Format)
+{
+    const byte seed[23] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23 };
+    const char label[] = "shoc segmented stream";
+    byte in[stream_len];
+    byte out[stream_size(100, 64)];
+    byte info[7 + sizeof(label) - 1] = { 1, 1, 16, 0, 0, 0, 64 };
+    byte okm[32 + 16];
+    byte n[12] = { 17, 18, 19, 20, 21, 22, 23, 0, 0, 0, 0, 0 };
+    byte exp[64];
+    byte tag[16];
+
+    stream_input(in);
+    copy(info + 7, label, sizeof(label) - 1);
+    hkdf<Sha2<SHA_256>>(okm, sizeof(okm), test_key, 16, seed, 16, info, sizeof(info));
+
+    ASSERT_EQ(stream_encrypt<gcm_context<aes128>>(test_key, seed, 64, in, 100, out, 1), sizeof(out));
+    compare(out, info, 7);
+    compare(out + 7, seed, 23);
+    compare(out + 30, okm, 32);
+
+    gcm_encrypt<aes128>(span_i<16>{okm + 32, 16}, n, 12, nullptr, 0, tag, 16, in, exp, 64);
+    compare(out + 62, exp, 64);
+    compare(out + 62 + 64, tag, 16);
+
+    n[10] = 1;
+    n[11] = 1;
+    gcm_encrypt<aes128>(span_i<16>{okm + 32, 16}, n, 12, nullptr, 0, tag, 16, in + 64, exp, 36);
+    compare(out + 62 + 80, exp, 36);
+    compare(out + 62 + 80 + 36, tag, 16);
+}
+
+TEST(Stream, CcmMaxSegment)
+{
+    using A = ccm_context<aes128, 3>;
+
+    const byte seed[23] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23 };
+    const char label[] = "shoc segmented stream";
+    const uint32_t max = A::max_msg_len;
+    byte in[16] = {};
+    byte out[stream_size(16, max)];
+    byte header[stream_writer<A>::header_size];
+    byte info[7 + sizeof(label) - 1];
+    byte okm[32 + 16];
+    stream_writer<A> wr;
+    stream_reader<A> rd;
+
+    ASSERT_FALSE(wr.init(test_key, seed, max + 1, header));
+    ASSERT_EQ(stream_encrypt<A>(test_key, seed, max + 1, in, sizeof(in), out), 0u);
+    ASSERT_EQ(stream_encrypt<A>(test_key, seed, max, in, sizeof(in), out), sizeof(out));
+    ASSERT_TRUE(rd.init(test_key, out));
+
+    // Header with oversized segment and matching key commitment
+    for (uint32_t seg : {max, max + 1}) {
+        copy(header, out, sizeof(header));
+        putbe(seg, header + 3);
+        copy(info, header, 7);
+        copy(info + 7, label, sizeof(label) - 1);
+        hkdf<Sha2<SHA_256>>(okm, sizeof(okm), test_key, 16, seed, 16, info, sizeof(info));
+        copy(header + 30, okm, 32);
+        ASSERT_EQ(rd.init(test_key, header), seg == max);
+    }
+}
+
+TEST(Stream, Parallel)
+{
+    const byte seed[23] = { 9 };
+    const uint32_t seg = 1000;
+    const size_t len = 1 << 18;
+    std::vector<byte> in(len);
+    std::vector<byte> exp(stream_size(len, seg));
+    std::vector<byte> out(stream_size(len, seg));
+    std::vector<byte> dec(len);
+    size_t dec_len;
+
+    for (size_t i = 0; i < len; ++i)
+        in[i] = i * 7 + (i >> 9);
+
+    ASSERT_EQ(stream_encrypt<gcm_context<aes128>>(test_key, seed, seg, in.data(), len, exp.data(), 1), exp.size());
+    ASSERT_EQ(stream_encrypt<gcm_context<aes128>>(test_key, seed, seg, in.data(), len, out.data(), 8), out.size());
+    ASSERT_TRUE(out == exp);
+    ASSERT_TRUE(stream_decrypt<gcm_context<aes128>>(test_key, out.data(), out.size(), dec.data(), &dec_len, 8));
+    ASSERT_EQ(dec_len, len);
+    ASSERT_TRUE(dec == in);
+
+    out[out.size() / 2] ^= 1;
+    ASSERT_FALSE(stream_decrypt<gcm_context<aes128>>(test_key, out.data(), out.size(), dec.data(), &dec_len, 8));
+    ASSERT_EQ(std::count(dec.begin(), dec.end(), 0), ptrdiff_t(len));
+}